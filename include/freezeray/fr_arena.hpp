@@ -0,0 +1,35 @@
+/* fr_arena.hpp
+ *
+ * contains the definition of the geometry arena, which packs long lived
+ * mesh data into a few large, huge page backed memory regions
+ */
+
+#ifndef FR_ARENA_H
+#define FR_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//allocations are bump allocated from regions of at least FR_ARENA_REGION_SIZE bytes, so the data of many meshes shares few
+//pages. regions are aligned to 2MB and, if huge pages are enabled, backed by them so a region needs a handful of TLB entries
+//instead of thousands. a region is returned to the os once every allocation in it has been freed. thread safe
+class GeometryArena
+{
+public:
+	//aligned to FR_CACHE_LINE_SIZE, throws std::bad_alloc if no region can be mapped
+	static void* allocate(size_t size);
+	static void free(void* ptr);
+
+	//only affects regions mapped afterwards. enabled by default
+	static void set_huge_pages(bool enable);
+	static size_t get_reserved_size();
+};
+
+}; //namespace fr
+
+#endif //#ifndef FR_ARENA_H
\ No newline at end of file
@@ -0,0 +1,250 @@
+/* fr_bvh.hpp
+ *
+ * contains the definition of the bvh class, a bounding volume
+ * hierarchy over a list of arbitrary primitives (objects, meshes, etc.)
+ */
+
+#ifndef FR_BVH_H
+#define FR_BVH_H
+
+#include <stdint.h>
+#include <vector>
+#include "fr_ray.hpp"
+#include "fr_globals.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+class BVH
+{
+public:
+	BVH() = default;
+	BVH(const std::vector<bound3>& primBounds, uint32_t maxPrimsPerNode, float traversalCost, float isectCost);
+
+	bound3 get_bounds() const;
+
+	//traverses the bvh front to back, calling intersectPrim(primIdx, tMax) for each primitive in every leaf
+	//whose bounds start before tMax. intersectPrim should shrink tMax whenever it finds a closer hit
+	template<typename F>
+	void intersect(const Ray& ray, float& tMax, F&& intersectPrim) const;
+
+	//same as intersect, but for a whole packet at once. nodes are visited if any ray in rayMask hits them, intersectPrim(primIdx, rayMask, tMax)
+	//is called with the rays that hit each leaf. tMax holds the closest hit for every ray, and should be shrunk the same way
+	template<typename F>
+	FR_TARGET_AVX2 void intersect8(const RayPacket8& rays, uint32_t rayMask, float* tMax, F&& intersectPrim) const;
+
+	//traverses the bvh until occludedPrim(primIdx) returns true for some primitive, in which case true is returned.
+	//traversal order is arbitrary, only leaves whose bounds start before tMax are visited
+	template<typename F>
+	bool occluded(const Ray& ray, float tMax, F&& occludedPrim) const;
+
+private:
+	struct Node
+	{
+		bound3 bounds;
+		union
+		{
+			uint32_t primsOffset;    //leaf
+			uint32_t secondChildIdx; //interior
+		};
+		uint32_t numPrims : 30;      //leaf (0 for interior nodes)
+		uint32_t axis     : 2;       //interior
+	};
+
+	struct BuildPrim
+	{
+		uint32_t primIdx;
+		bound3 bounds;
+		vec3 centroid;
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_primIndices;
+
+	uint32_t build_recursive(std::vector<BuildPrim>& buildPrims, uint32_t start, uint32_t end, uint32_t depth,
+	                         uint32_t maxPrimsPerNode, float traversalCost, float isectCost);
+
+	static bool intersect_bounds(const bound3& bounds, const vec3& rayPos, const vec3& invRayDir, float tMax);
+	FR_TARGET_AVX2 static uint32_t intersect_bounds8(const bound3& bounds, const __m256* rayPos, const __m256* invRayDir, __m256 tMax);
+};
+
+//-------------------------------------------//
+
+#define FR_BVH_MAX_DEPTH 64
+
+template<typename F>
+void BVH::intersect(const Ray& ray, float& tMax, F&& intersectPrim) const
+{
+	if(m_nodes.size() == 0)
+		return;
+
+	vec3 rayPos = ray.origin();
+	vec3 invRayDir = 1.0f / ray.direction();
+	bool dirIsNeg[3] = { invRayDir.x < 0.0f, invRayDir.y < 0.0f, invRayDir.z < 0.0f };
+
+	uint32_t nodesToVisit[FR_BVH_MAX_DEPTH + 1];
+	uint32_t toVisitPos = 0;
+
+	uint32_t nodeIdx = 0;
+	while(true)
+	{
+		const Node& node = m_nodes[nodeIdx];
+		if(intersect_bounds(node.bounds, rayPos, invRayDir, tMax))
+		{
+			if(node.numPrims == 0)
+			{
+				//visit the child closest to the ray origin first
+				if(dirIsNeg[node.axis])
+				{
+					nodesToVisit[toVisitPos++] = nodeIdx + 1;
+					nodeIdx = node.secondChildIdx;
+				}
+				else
+				{
+					nodesToVisit[toVisitPos++] = node.secondChildIdx;
+					nodeIdx = nodeIdx + 1;
+				}
+
+				continue;
+			}
+
+			for(uint32_t i = node.primsOffset; i < node.primsOffset + node.numPrims; i++)
+				intersectPrim(m_primIndices[i], tMax);
+		}
+
+		if(toVisitPos == 0)
+			break;
+
+		nodeIdx = nodesToVisit[--toVisitPos];
+	}
+}
+
+template<typename F>
+FR_TARGET_AVX2 void BVH::intersect8(const RayPacket8& rays, uint32_t rayMask, float* tMax, F&& intersectPrim) const
+{
+	if(m_nodes.size() == 0 || rayMask == 0)
+		return;
+
+	__m256 rayPos[3] = { rays.origin(0), rays.origin(1), rays.origin(2) };
+	__m256 invRayDir[3] = { rays.inv_direction(0), rays.inv_direction(1), rays.inv_direction(2) };
+
+	//rays may point in different directions, the child order is only chosen by the first one
+	vec3 firstRayDir = rays.get_ray(0).direction();
+	bool dirIsNeg[3] = { firstRayDir.x < 0.0f, firstRayDir.y < 0.0f, firstRayDir.z < 0.0f };
+
+	uint32_t nodesToVisit[FR_BVH_MAX_DEPTH + 1];
+	uint32_t toVisitPos = 0;
+
+	uint32_t nodeIdx = 0;
+	while(true)
+	{
+		const Node& node = m_nodes[nodeIdx];
+		uint32_t hitMask = intersect_bounds8(node.bounds, rayPos, invRayDir, _mm256_loadu_ps(tMax)) & rayMask;
+		if(hitMask != 0)
+		{
+			if(node.numPrims == 0)
+			{
+				if(dirIsNeg[node.axis])
+				{
+					nodesToVisit[toVisitPos++] = nodeIdx + 1;
+					nodeIdx = node.secondChildIdx;
+				}
+				else
+				{
+					nodesToVisit[toVisitPos++] = node.secondChildIdx;
+					nodeIdx = nodeIdx + 1;
+				}
+
+				continue;
+			}
+
+			for(uint32_t i = node.primsOffset; i < node.primsOffset + node.numPrims; i++)
+				intersectPrim(m_primIndices[i], hitMask, tMax);
+		}
+
+		if(toVisitPos == 0)
+			break;
+
+		nodeIdx = nodesToVisit[--toVisitPos];
+	}
+}
+
+template<typename F>
+bool BVH::occluded(const Ray& ray, float tMax, F&& occludedPrim) const
+{
+	if(m_nodes.size() == 0)
+		return false;
+
+	vec3 rayPos = ray.origin();
+	vec3 invRayDir = 1.0f / ray.direction();
+
+	uint32_t nodesToVisit[FR_BVH_MAX_DEPTH + 1];
+	uint32_t toVisitPos = 0;
+
+	uint32_t nodeIdx = 0;
+	while(true)
+	{
+		const Node& node = m_nodes[nodeIdx];
+		if(intersect_bounds(node.bounds, rayPos, invRayDir, tMax))
+		{
+			if(node.numPrims == 0)
+			{
+				nodesToVisit[toVisitPos++] = node.secondChildIdx;
+				nodeIdx = nodeIdx + 1;
+
+				continue;
+			}
+
+			for(uint32_t i = node.primsOffset; i < node.primsOffset + node.numPrims; i++)
+				if(occludedPrim(m_primIndices[i]))
+					return true;
+		}
+
+		if(toVisitPos == 0)
+			break;
+
+		nodeIdx = nodesToVisit[--toVisitPos];
+	}
+
+	return false;
+}
+
+inline bool BVH::intersect_bounds(const bound3& bounds, const vec3& rayPos, const vec3& invRayDir, float tMax)
+{
+	vec3 tMinBounds3 = (bounds.min - rayPos) * invRayDir;
+	vec3 tMaxBounds3 = (bounds.max - rayPos) * invRayDir;
+
+	vec3 t1 = min(tMinBounds3, tMaxBounds3);
+	vec3 t2 = max(tMinBounds3, tMaxBounds3);
+
+	//tFar is padded slightly to stay conservative in the face of rounding error
+	float tNear = std::max(std::max(t1.x, t1.y), std::max(t1.z, 0.0f));
+	float tFar = std::min(std::min(t2.x, t2.y), t2.z) * (1.0f + 2.0f * FR_EPSILON);
+
+	return tNear <= std::min(tFar, tMax);
+}
+
+FR_TARGET_AVX2 inline uint32_t BVH::intersect_bounds8(const bound3& bounds, const __m256* rayPos, const __m256* invRayDir, __m256 tMax)
+{
+	__m256 tNear = _mm256_setzero_ps();
+	__m256 tFar = _mm256_set1_ps(INFINITY);
+
+	for(uint32_t axis = 0; axis < 3; axis++)
+	{
+		__m256 tMinBounds = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(bounds.min[axis]), rayPos[axis]), invRayDir[axis]);
+		__m256 tMaxBounds = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(bounds.max[axis]), rayPos[axis]), invRayDir[axis]);
+
+		tNear = _mm256_max_ps(tNear, _mm256_min_ps(tMinBounds, tMaxBounds));
+		tFar = _mm256_min_ps(tFar, _mm256_max_ps(tMinBounds, tMaxBounds));
+	}
+
+	tFar = _mm256_mul_ps(tFar, _mm256_set1_ps(1.0f + 2.0f * FR_EPSILON));
+
+	return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tNear, _mm256_min_ps(tFar, tMax), _CMP_LE_OQ));
+}
+
+}; //namespace fr
+
+#endif //#ifndef FR_BVH_H
@@ -0,0 +1,84 @@
+/* fr_film.hpp
+ *
+ * contains the definition of the film class, which accumulates the
+ * samples of a render and can be checkpointed to disk to resume it
+ */
+
+#ifndef FR_FILM_H
+#define FR_FILM_H
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+#include "quickmath.hpp"
+using namespace qm;
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//running mean and variance of a pixel's samples, updated with welford's algorithm so no sample needs to be kept around
+struct PixelEstimate
+{
+	vec3 mean = vec3(0.0f);
+	vec3 m2 = vec3(0.0f); //sum of squared differences from the mean
+	uint32_t numSamples = 0;
+
+	void add_sample(const vec3& sample);
+	//standard error of the mean, relative to the mean. the per channel standard errors are weighted like luminance, which
+	//overestimates the standard error of the luminance unless the channels' errors are perfectly correlated
+	float relative_error() const;
+};
+
+//the float estimate of every pixel, plus the number of sampling rounds each tile has finished. tiles seed their samplers from
+//that count, so a render resumed from a checkpoint continues with fresh samples instead of repeating the ones it already has
+class Film
+{
+public:
+	Film(uint32_t width, uint32_t height, uint32_t numTiles);
+
+	inline uint32_t get_width() const { return m_width; }
+	inline uint32_t get_height() const { return m_height; }
+	inline uint32_t get_num_tiles() const { return (uint32_t)m_tileRounds.size(); }
+
+	inline PixelEstimate& get_pixel(uint32_t x, uint32_t y) { return m_pixels[x + m_width * y]; }
+	inline const PixelEstimate& get_pixel(uint32_t x, uint32_t y) const { return m_pixels[x + m_width * y]; }
+	inline uint32_t& get_tile_rounds(uint32_t tile) { return m_tileRounds[tile]; }
+	inline uint32_t get_tile_rounds(uint32_t tile) const { return m_tileRounds[tile]; }
+
+	uint64_t get_total_samples() const;
+
+	//writes to a temporary file first, so being killed mid write leaves the previous checkpoint intact. key identifies what was 
+	//rendered (the scene, camera and sampling settings), load() only accepts checkpoints saved with the same key
+	bool save(const std::string& path, uint64_t key) const;
+	//returns false, leaving the film untouched, if there is no checkpoint at path, it was taken with a different resolution, tiling 
+	//or key, or any of its pixels are not finite
+	bool load(const std::string& path, uint64_t key);
+
+private:
+	uint32_t m_width;
+	uint32_t m_height;
+
+	std::vector<PixelEstimate> m_pixels;
+	std::vector<uint32_t> m_tileRounds;
+
+	//on-disk checkpoint, a header followed by the tile rounds and pixels
+	struct CheckpointHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+
+		uint32_t width;
+		uint32_t height;
+		uint32_t numTiles;
+		uint32_t pixelSize;
+
+		uint64_t key;
+	};
+};
+
+}; //namespace fr
+
+#endif //#ifndef FR_FILM_H
\ No newline at end of file
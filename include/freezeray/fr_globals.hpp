@@ -7,6 +7,8 @@
 #define FR_GLOBALS_H
 
 #include "quickmath.hpp"
+#include <new>
+#include <stddef.h>
 using namespace qm;
 
 //-------------------------------------------//
@@ -24,6 +26,16 @@ using namespace qm;
 
 #define FR_SQRT_2 1.41421356237f
 
+#define FR_CACHE_LINE_SIZE 64
+
+//marks functions that use AVX2 intrinsics outside of the kernels, they must only be called if get_simd_level() >= SIMD_LEVEL_AVX2.
+//msvc allows the intrinsics anywhere, gcc and clang only in functions compiled for the instruction set
+#if defined(_MSC_VER) && !defined(__clang__)
+	#define FR_TARGET_AVX2
+#else
+	#define FR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 //canonical up direction for local space calculations
 #define FR_UP_DIR vec3(0.0f, 1.0f, 0.0f)
 #define FR_DOWN_DIR vec3(0.0f, -1.0f, 0.0f)
@@ -42,6 +54,28 @@ struct bound3
 	vec3 max;
 };
 
+//allocator for std containers whose storage must start on an Alignment byte boundary (e.g. FR_CACHE_LINE_SIZE)
+template<typename T, size_t Alignment>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() = default;
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>& other) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+	void deallocate(T* ptr, size_t) { ::operator delete(ptr, std::align_val_t(Alignment)); }
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>& other) const { return true; }
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>& other) const { return false; }
+};
+
 //TRIG FUNCTIONS FOR RAYS IN LOCAL SPACE:
 //-------------------------------------------//
 
@@ -0,0 +1,97 @@
+/* fr_kernels.hpp
+ *
+ * contains the definitions of the SIMD intersection kernels, which are
+ * compiled once per instruction set and selected at runtime based on the cpu
+ */
+
+#ifndef FR_KERNELS_H
+#define FR_KERNELS_H
+
+#include <stdint.h>
+
+//NOTE: this header is included by translation units compiled for different instruction sets, so it must not
+//define any inline functions. the linker could otherwise pick a copy that uses instructions the cpu doesnt have
+
+//-------------------------------------------//
+
+//same as FR_EPSILON, fr_globals.hpp cant be included by the kernels
+#define FR_KERNEL_EPSILON 0.0001f
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//instruction sets that kernels are compiled for, in increasing order of width
+enum SIMDlevel : uint32_t
+{
+	SIMD_LEVEL_SSE4,
+	SIMD_LEVEL_AVX2,
+	SIMD_LEVEL_AVX512
+};
+
+//8 triangles in SoA layout, with the edges precomputed. unused lanes have triIdx == UINT32_MAX and 0 edges, so they never hit
+struct alignas(32) TriangleBlockSIMD
+{
+	float v0x[8], v0y[8], v0z[8];
+	float e1x[8], e1y[8], e1z[8];
+	float e2x[8], e2y[8], e2z[8];
+
+	uint32_t triIdx[8];
+};
+
+//results of testing a ray against a single TriangleBlockSIMD. t, u, and v are only written if mask is nonzero
+struct TriangleBlockHits
+{
+	uint32_t mask;
+
+	float t[8];
+	float u[8];
+	float v[8];
+};
+
+//tests a ray against numBlocks consecutive triangle blocks, counting only hits with t < tMax.
+//writes one entry to hits per block, returns whether any triangle was hit
+typedef bool (*IntersectTriBlocksKernel)(const float rayOrig[3], const float rayDir[3], const TriangleBlockSIMD* blocks, uint32_t numBlocks,
+                                         float tMax, TriangleBlockHits* hits);
+
+//tests a ray against W boxes in SoA layout (minX[W], minY[W], minZ[W], maxX[W], maxY[W], maxZ[W]), 16-byte aligned.
+//writes the entry distance of each box to tNear, returns a mask of the boxes entered before tMax
+typedef uint32_t (*IntersectBoxesKernel)(const float* bounds, const float rayOrig[3], const float invRayDir[3], const bool dirIsNeg[3],
+                                         float tMax, float* tNear);
+
+struct IntersectionKernels
+{
+	SIMDlevel level;
+	uint32_t trisPerTest; //triangles intersectTriBlocks tests in one go, testing fewer costs the same
+
+	IntersectTriBlocksKernel intersectTriBlocks;
+	IntersectBoxesKernel intersectBoxes4;
+	IntersectBoxesKernel intersectBoxes8;
+};
+
+//returns the widest instruction set supported by both the cpu and the os, detected on the first call.
+//can be lowered with the FR_SIMD_LEVEL environment variable ("sse4", "avx2", or "avx512")
+SIMDlevel get_simd_level();
+
+//returns the cpu's brand string (e.g. for keying measurements to the machine), or "unknown" if it has none
+const char* get_cpu_name();
+
+//returns the kernels for get_simd_level()
+const IntersectionKernels& get_intersection_kernels();
+
+//-------------------------------------------//
+
+//per instruction set variants, each is defined in its own translation unit under src/freezeray/kernels/
+
+bool intersect_tri_blocks_sse4  (const float rayOrig[3], const float rayDir[3], const TriangleBlockSIMD* blocks, uint32_t numBlocks, float tMax, TriangleBlockHits* hits);
+bool intersect_tri_blocks_avx2  (const float rayOrig[3], const float rayDir[3], const TriangleBlockSIMD* blocks, uint32_t numBlocks, float tMax, TriangleBlockHits* hits);
+bool intersect_tri_blocks_avx512(const float rayOrig[3], const float rayDir[3], const TriangleBlockSIMD* blocks, uint32_t numBlocks, float tMax, TriangleBlockHits* hits);
+
+uint32_t intersect_boxes4_sse4(const float* bounds, const float rayOrig[3], const float invRayDir[3], const bool dirIsNeg[3], float tMax, float* tNear);
+uint32_t intersect_boxes8_sse4(const float* bounds, const float rayOrig[3], const float invRayDir[3], const bool dirIsNeg[3], float tMax, float* tNear);
+uint32_t intersect_boxes8_avx2(const float* bounds, const float rayOrig[3], const float invRayDir[3], const bool dirIsNeg[3], float tMax, float* tNear);
+
+}; //namespace fr
+
+#endif //#ifndef FR_KERNELS_H
\ No newline at end of file
@@ -34,6 +34,7 @@ public:
 	virtual void pdf_le(const Ray& ray, const vec3& normal, float& pdfPos, float& pdfDir) const = 0;
 
 	virtual std::shared_ptr<const Mesh> get_mesh(mat4& transform) const { return nullptr; }
+	virtual std::shared_ptr<const Shape> get_shape(mat4& transform) const { return nullptr; }
 
 	bool is_delta() const { return m_delta; }
 	bool is_infinite() const { return m_infinite; }
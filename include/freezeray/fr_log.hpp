@@ -0,0 +1,38 @@
+/* fr_log.hpp
+ *
+ * contains helpers for printing build and render statistics
+ */
+
+#ifndef FR_LOG_H
+#define FR_LOG_H
+
+#include <string>
+#include <sstream>
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//statistics (build times, sample counts, ...) are only printed when verbose, warnings and errors always are. off by default
+void set_verbose(bool verbose);
+bool is_verbose();
+
+//writes the line and a newline at once, so lines printed by different threads never interleave
+void log_line(const std::string& line);
+
+//formats the arguments into a single line and prints it, if verbose
+template<typename... Args>
+void log_verbose(const Args&... args)
+{
+	if(!is_verbose())
+		return;
+
+	std::ostringstream line;
+	(line << ... << args);
+	log_line(line.str());
+}
+
+}; //namespace fr
+
+#endif //#ifndef FR_LOG_H
\ No newline at end of file
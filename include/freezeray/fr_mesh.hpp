@@ -10,12 +10,16 @@
 #include <stdint.h>
 #include <memory>
 #include <vector>
+#include <deque>
 #include <unordered_map>
+#include <mutex>
+#include <span>
 #include <immintrin.h>
 #include "fr_ray.hpp"
 #include "fr_globals.hpp"
 #include "fr_raycast_info.hpp"
 #include "fr_texture.hpp"
+#include "fr_kernels.hpp"
 
 //-------------------------------------------//
 
@@ -30,15 +34,46 @@ enum VertexAttributes : uint32_t
 	VERTEX_ATTRIB_NORMAL   = (1 << 2)
 };
 
+//acceleration structure used to intersect a mesh's triangles
+enum MeshAccelerator : uint32_t
+{
+	MESH_ACCELERATOR_KD_TREE,
+	MESH_ACCELERATOR_BVH4,
+	MESH_ACCELERATOR_BVH8
+};
+
+//how vertex attributes are stored for shading, intersection always uses the full precision positions in the triangle blocks
+enum VertexFormat : uint32_t
+{
+	VERTEX_FORMAT_FLOAT,
+	VERTEX_FORMAT_COMPACT //positions quantized to 16 bits within the mesh's vertex bounds, octahedral normals, half float uvs
+};
+
+class Mesh;
+
+//a mesh placed in an object with its own material. groups of an obj file that only differ by a translation share one mesh,
+//whose vertices are at offset from the mesh's (so rays must be moved by -offset before intersecting it)
+struct MeshInstance
+{
+	std::shared_ptr<const Mesh> mesh;
+	std::string material;
+	vec3 offset;
+};
+
+//if an alpha mask is given on construction, each triangle is classified against it up front. fully transparent triangles are
+//left out of the acceleration structure and fully opaque ones skip the texture lookup, so the mesh must only be intersected
+//with that mask (or none)
 class Mesh
 {
 public:
 	Mesh(uint32_t vertexAttribs, uint32_t numFaces, std::unique_ptr<uint32_t[]> faceIndices, std::unique_ptr<uint32_t[]> vertIndices, 
 		 std::unique_ptr<float[]> verts, std::string material = "", uint32_t vertStride = UINT32_MAX, uint32_t vertPosOffset = UINT32_MAX, 
-		 uint32_t vertUvOffset = UINT32_MAX, uint32_t vertNormalOffset = UINT32_MAX);
+		 uint32_t vertUvOffset = UINT32_MAX, uint32_t vertNormalOffset = UINT32_MAX, MeshAccelerator accelerator = MESH_ACCELERATOR_KD_TREE,
+		 std::shared_ptr<const Texture<float>> alphaMask = nullptr, VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT);
 	Mesh(uint32_t vertexAttribs, uint32_t numTris, std::unique_ptr<uint32_t[]> indices, std::unique_ptr<float[]> verts, 
 		 std::string material = "", uint32_t vertStride = UINT32_MAX, uint32_t vertPosOffset = UINT32_MAX, 
-		 uint32_t vertUvOffset = UINT32_MAX, uint32_t vertNormalOffset = UINT32_MAX);
+		 uint32_t vertUvOffset = UINT32_MAX, uint32_t vertNormalOffset = UINT32_MAX, MeshAccelerator accelerator = MESH_ACCELERATOR_KD_TREE,
+		 std::shared_ptr<const Texture<float>> alphaMask = nullptr, VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT);
 
 	const std::string& get_material() const;
 	void set_material(const std::string& material);
@@ -47,6 +82,7 @@ public:
 	uint32_t get_num_tris() const;
 	bound3 get_bounds() const;
 
+	//these wait for a lazily built mesh to be built, since building replaces the vertex and index arrays
 	void get_tri_indices(uint32_t triIdx, uint32_t& idx0, uint32_t& idx1, uint32_t& idx2) const;
 	vec3 get_vert_pos_at(uint32_t idx) const;
 	vec2 get_vert_uv_at(uint32_t idx) const;
@@ -54,15 +90,60 @@ public:
 
 	bool intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alphaMash, 
 	               float& t, vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs) const;
+	//only hits closer than tMax are found, so a closer hit on another mesh can cut the traversal short
+	bool intersect(const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask, float tMax,
+	               float& t, uint32_t& triIdx, vec2& barycentrics) const;
+	//intersects the rays in rayMask, each only up to its tMax. returns a mask of the rays that found a closer hit, for which 
+	//tMax, triIdx and barycentrics are updated. the kd tree is traversed once for the whole packet if the rays are coherent.
+	//requires get_simd_level() >= SIMD_LEVEL_AVX2
+	FR_TARGET_AVX2 uint32_t intersect8(const RayPacket8& rays, uint32_t rayMask, const std::shared_ptr<const Texture<float>>& alphaMask,
+	                                   float* tMax, uint32_t* triIdx, vec2* barycentrics) const;
+	void get_hit_attribs(const Ray& ray, float t, uint32_t triIdx, const vec2& barycentrics, 
+	                     vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs) const;
+	bool occluded(const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask, float tMax) const;
+
+	~Mesh();
 
 	//-------------------------------------------//
 
-	static std::vector<std::shared_ptr<const Mesh>> from_obj(std::string path);
+	//when set, meshes created afterwards only compute their bounds on construction. the acceleration structure is built by the 
+	//first ray that reaches them (other threads intersecting the mesh wait for it), so meshes no ray reaches are never built
+	static void set_lazy_build(bool lazy);
+
+	//sets the directory that built kd trees are cached in, keyed by a hash of the mesh data and build parameters.
+	//meshes created afterwards load their tree from the cache if possible. empty (the default) disables caching
+	static void set_kdtree_cache_dir(const std::string& dir);
+
+	//cost model of the kd tree's surface area heuristic, relative to visiting a node. leaves are costed per 
+	//intersection test, which covers maxTrisPerLeaf triangles at once
+	struct KDtreeCosts
+	{
+		float traversal;
+		float isect;
+		float emptyBonus;         //fraction of the intersection cost saved by splits with an empty child
+		uint32_t maxTrisPerLeaf;  //nodes this small are never split
+	};
+
+	//sets the costs used by meshes built afterwards, the defaults are rough guesses for the kernels get_simd_level() picks
+	static void set_kdtree_costs(const KDtreeCosts& costs);
+	static KDtreeCosts get_kdtree_costs();
+	//micro-benchmarks node visits against leaf intersection tests on this cpu and uses the ratio for later builds. the
+	//result is stored in the kd tree cache dir (if set) and reused by later runs at the same SIMD level, unless force is set
+	static KDtreeCosts calibrate_kdtree_costs(bool force = false);
+
+	//alphaMasks maps material names to the alpha mask used with the meshes of that material. returns one mesh per material, except for
+	//groups ("o"/"g") that repeat an earlier group's indices, uvs, normals and alpha mask with positions that match up to a translation.
+	//those are built once and returned as instances of the same mesh
+	static std::vector<MeshInstance> from_obj(std::string path, MeshAccelerator accelerator = MESH_ACCELERATOR_KD_TREE,
+	                                          const std::unordered_map<std::string, std::shared_ptr<const Texture<float>>>& alphaMasks = {},
+	                                          VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT);
 	static std::shared_ptr<const Mesh> from_unit_sphere(uint32_t numSubdivisions = 2, bool smoothNormals = true);
 	static std::shared_ptr<const Mesh> from_unit_cube();
 	static std::shared_ptr<const Mesh> from_unit_square();
 
 private:
+	Mesh() = default; //empty, only used to calibrate the kd tree costs
+
 	//-------------------------------------------//
 	//MESH DATA:
 
@@ -75,78 +156,268 @@ private:
 	uint32_t m_vertNormalOffset;
 
 	uint32_t m_numTris;
+	uint32_t m_numVerts; //vertices past the last referenced one are ignored
 	std::unique_ptr<uint32_t[]> m_indices;
 	std::unique_ptr<float[]> m_verts;
 
 	void vert_attribs_setup();
 
 	//-------------------------------------------//
-	//INTERSECTION ROUTINES:
+	//COMPACT VERTEX DATA:
 
-	struct IntersectTriangleResultSIMD
+	//16 bytes, vs 32 for a float vertex with every attribute
+	struct CompactVertex
 	{
-		__m256i hit;
-
-		__m256 t;
-		__m256 u;
-		__m256 v;
+		uint16_t pos[3]; //fraction of the way across the vertex bounds
+		uint16_t uv[2];  //half floats
+		uint32_t normal; //octahedral, 16-bit snorm per component
 	};
 
+	VertexFormat m_vertFormat;
+	std::vector<CompactVertex> m_compactVerts;
+	vec3 m_vertPosMin;
+	vec3 m_vertPosScale;
+
+	//block * 8 + lane of the first copy of each triangle in m_triBlocks, UINT32_MAX if it is in none. only filled for compact
+	//meshes, so shading can use the full-precision positions there instead of the quantized ones
+	std::vector<uint32_t> m_triBlockLanes;
+
+	void compress_verts(); //replaces m_verts and switches m_vertFormat, called by build() once the acceleration structure is built
+	void get_tri_positions(uint32_t triIdx, vec3& v0, vec3& v1, vec3& v2) const;
+
+	//-------------------------------------------//
+	//INTERSECTION ROUTINES:
+
 	static bool intersect_triangle(const Ray& ray, const vec3& v0, const vec3& v1, const vec3& v2, float& t, float& u, float& v);
-	static IntersectTriangleResultSIMD intersect_triangles_simd(const Ray& ray, const vec3 (&v0)[8], const vec3 (&v1)[8], const vec3 (&v2)[8]);
 	static void intersect_triangle_no_bounds_check(const Ray& ray, const vec3& v0, const vec3& v1, const vec3& v2, float& t, float& u, float& v);
 
-	bool test_alpha_mask(std::shared_ptr<const Texture<float>> alphaMask, uint32_t idx0, uint32_t idx1, uint32_t idx2, float b0, float b1) const;
+	bool test_alpha_mask(const std::shared_ptr<const Texture<float>>& alphaMask, uint32_t triIdx, float b0, float b1) const;
+
+	//-------------------------------------------//
+	//OPACITY DATA:
+
+	enum TriOpacity : uint8_t
+	{
+		TRI_OPACITY_OPAQUE,
+		TRI_OPACITY_TRANSPARENT,
+		TRI_OPACITY_MIXED
+	};
+
+	std::shared_ptr<const Texture<float>> m_alphaMask;
+	std::vector<uint8_t> m_triOpacity; //one TriOpacity per triangle, empty if there is no alpha mask
+
+	void classify_opacity();
+	std::vector<uint32_t> get_build_tris() const; //all triangles that arent fully transparent
+
+	//-------------------------------------------//
+	//BUILD STATE:
+
+	static bool m_lazyBuild;
+	bool m_buildThreaded = true; //false when built lazily on a render thread, which must not spawn more threads
+
+	VertexFormat m_builtVertFormat; //format to compress to once built
+	mutable std::once_flag m_built;
+
+	void build();
+	void build_or_defer(); //called by the constructors
+	//every public function that reads the geometry must call this first, anything build() calls must not
+	inline void ensure_built() const { std::call_once(m_built, [this]() { const_cast<Mesh*>(this)->build(); }); }
+
+	//same as the public accessors, without waiting for the build
+	void tri_indices_at(uint32_t triIdx, uint32_t& idx0, uint32_t& idx1, uint32_t& idx2) const;
+	vec3 vert_pos_at(uint32_t idx) const;
+	vec2 vert_uv_at(uint32_t idx) const;
+	vec3 vert_normal_at(uint32_t idx) const;
+
+	//-------------------------------------------//
+	//TRIANGLE DATA (shared by all accelerators):
+
+	MeshAccelerator m_accelerator;
+	bound3 m_bounds;     //returned by get_bounds(), never changes once constructed. includes every triangle for lazily built meshes
+	bound3 m_treeBounds; //of the triangles in the acceleration structure, written by build()
+	std::vector<TriangleBlockSIMD> m_triBlocks;
+
+	std::vector<bound3> compute_tri_bounds() const;
+	//bounds of the part of a triangle inside box, false if it doesnt touch the box
+	bool clip_tri_bounds(uint32_t triIdx, const bound3& box, bound3& clippedBounds) const;
+	uint32_t pack_tri_blocks(uint32_t numTris, const uint32_t* tris);
+
+	bool intersect_tri_blocks(uint32_t blocksOffset, uint32_t numTris, const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask,
+	                          float& tMin, uint32_t& minTriIdx, float& minB0, float& minB1) const;
+	bool occluded_tri_blocks(uint32_t blocksOffset, uint32_t numTris, const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask, 
+	                         float tMax) const;
 
 	//-------------------------------------------//
 	//KD TREE DATA:
 
+	//the children of an interior node are always stored next to each other, below first
 	struct KDtreeNode
 	{
 		union 
 		{
 			float split;               //interior
-			uint32_t triIndicesOffset; //leaf
+			uint32_t triBlocksOffset;  //leaf
 		};
 		union 
 		{
 			uint32_t flags;            //both
 			uint32_t numTris;          //leaf
-			uint32_t aboveChildIdx;    //interior
+			uint32_t childrenIdx;      //interior
 		};
 
-		void init_interior(uint32_t axis, uint32_t aboveChildIdx, float splitPos);
-		void init_leaf(uint32_t numTris, uint32_t* tris, std::vector<uint32_t>& triIndicies);
+		void init_interior(uint32_t axis, uint32_t childrenIdx, float splitPos);
+		void init_leaf(uint32_t numTris, uint32_t triBlocksOffset);
 
 		inline float get_split_pos()             const { return split; }
 		inline uint32_t get_num_tris()           const { return numTris >> 2; }
 		inline uint32_t get_split_axis()         const { return flags & 3; }
 		inline bool is_leaf()                    const { return (flags & 3) == 3; }
-		inline uint32_t get_above_child_idx()    const { return aboveChildIdx >> 2; }
-		inline uint32_t get_tri_indices_offset() const { return triIndicesOffset; }
+		inline uint32_t get_below_child_idx()    const { return childrenIdx >> 2; }
+		inline uint32_t get_above_child_idx()    const { return (childrenIdx >> 2) + 1; }
+		inline uint32_t get_tri_blocks_offset()  const { return triBlocksOffset; }
 	};
 
 	struct KDtreeBoundEdge
 	{
-		uint32_t tri;
+		uint32_t ref;
 		float pos;
 		bool start;
+
+		//by position, then ends before starts, then by reference. since this is a strict total order, 
+		//filtering a sorted list in order keeps it sorted
+		inline bool operator<(const KDtreeBoundEdge& other) const
+		{
+			if(pos != other.pos)
+				return pos < other.pos;
+			if(start != other.start)
+				return (int)start < (int)other.start;
+
+			return ref < other.ref;
+		}
+	};
+
+	//the tree is built over references to triangles, each confined to a box. the early split pre-pass gives 
+	//badly fitting triangles several references with smaller boxes, otherwise each triangle has exactly one
+	struct KDtreeBuildRefs
+	{
+		std::vector<uint32_t> tris;
+		std::vector<bound3> bounds;
+	};
+
+	//intermediate tree used during construction, subtrees built on separate threads each allocate from their own arena
+	struct KDtreeBuildNode
+	{
+		bool leaf;
+		uint32_t axis;
+		float split;
+
+		std::vector<uint32_t> tris;     //leaf
+		KDtreeBuildNode* children[2];   //interior
+	};
+
+	struct KDtreeBuildArena
+	{
+		std::deque<KDtreeBuildNode> nodes;
+		std::vector<std::unique_ptr<KDtreeBuildArena>> children;
 	};
 
 	void kdtree_build();
-	void kdtree_build_recursive(uint32_t idx, uint32_t* treeSize, uint32_t* treeNextFree, 
-	                            const bound3& bounds, const std::vector<bound3>& triBounds, 
-	                            uint32_t numTris, uint32_t* tris, uint32_t depth, 
-								const std::unique_ptr<KDtreeBoundEdge[]> boundEdges[3],
-								uint32_t* trisBelow, uint32_t* trisAbove);
-
-	bool kdtree_intersect_leaf_node(const KDtreeNode* node, const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask,
-	                                float& tMin, uint32_t& minIdx0, uint32_t& minIdx1, uint32_t& minIdx2,
-	                                vec3& minV0, vec3& minV1, vec3& minV2, float& minB0, float& minB1) const;
-
-	bound3 m_kdTreeBounds;
-	std::unique_ptr<KDtreeNode[]> m_kdTree;
-	std::vector<uint32_t> m_kdTreeTriIndices;
+	KDtreeBuildRefs kdtree_early_split(const std::vector<uint32_t>& tris, const std::vector<bound3>& triBounds) const;
+	//nodeRefs and boundEdges are consumed. edges of references straddling a split are clipped to each child's box
+	KDtreeBuildNode* kdtree_build_recursive(KDtreeBuildArena& arena, const bound3& bounds, const KDtreeBuildRefs& refs, 
+	                                        std::vector<uint32_t>& nodeRefs, std::vector<KDtreeBoundEdge> boundEdges[3], 
+	                                        uint32_t depth, uint32_t spawnDepth, std::vector<uint8_t>& refSides) const;
+	void kdtree_flatten(const KDtreeBuildNode* root);
+
+	//intersectLeaf(blocksOffset, numTris, tMax) is called for each leaf in order, returns true to stop traversal
+	template<typename F>
+	bool kdtree_traverse(const Ray& ray, float& tMax, F&& intersectLeaf) const;
+	//packet version, all rays in rayMask must point the same way along each axis (given by dirIsNeg).
+	//intersectLeaf(blocksOffset, numTris, leafRayMask, tMax) is called for each leaf with the rays that reach it
+	template<typename F>
+	FR_TARGET_AVX2 void kdtree_traverse8(const RayPacket8& rays, uint32_t rayMask, const bool dirIsNeg[3], float* tMax, F&& intersectLeaf) const;
+
+	std::vector<KDtreeNode, AlignedAllocator<KDtreeNode, FR_CACHE_LINE_SIZE>> m_kdTree;
+
+	//on-disk cache of built trees, a header followed by the nodes and triangle blocks
+	struct KDtreeCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+
+		uint32_t numTris;
+		uint32_t numNodes;
+		uint32_t numTriBlocks;
+		bound3 bounds;
+
+		uint64_t checksum; //over the nodes and triangle blocks
+	};
+
+	static std::string m_kdTreeCacheDir;
+	static KDtreeCosts& kdtree_costs(); //set to the defaults on first use, selecting the kernels isnt safe during static init
+	static KDtreeCosts kdtree_default_costs();
+	static std::string kdtree_costs_file_name(); //one file per cpu model, so a shared cache dir works across machines
+	static bool kdtree_costs_load(KDtreeCosts& costs);
+	static void kdtree_costs_save(const KDtreeCosts& costs);
+
+	uint64_t kdtree_cache_key() const;
+	bool kdtree_cache_load(uint64_t key);
+	void kdtree_cache_save(uint64_t key) const;
+	static uint64_t kdtree_cache_checksum(const std::vector<KDtreeNode, AlignedAllocator<KDtreeNode, FR_CACHE_LINE_SIZE>>& nodes, 
+	                                      const std::vector<TriangleBlockSIMD>& triBlocks);
+
+	//-------------------------------------------//
+	//WIDE BVH DATA:
+
+	//W children per node, with their bounds in SoA layout so they can all be tested at once.
+	//empty slots have inverted bounds, so they are never hit
+	template<uint32_t W>
+	struct alignas(32) BVHwideNode
+	{
+		float minX[W], minY[W], minZ[W];
+		float maxX[W], maxY[W], maxZ[W];
+
+		uint32_t children[W]; //interior: node index, leaf: tri blocks offset
+		uint32_t numTris[W];  //leaf (0 for interior children)
+	};
+
+	struct BVHbuildNode
+	{
+		bound3 bounds;
+		std::vector<uint32_t> tris;  //leaf
+		BVHbuildNode* children[2];   //interior (nullptr for leaves)
+	};
+
+	void bvh_build();
+	BVHbuildNode* bvh_build_recursive(std::deque<BVHbuildNode>& arena, const std::vector<bound3>& triBounds, 
+	                                  uint32_t* tris, uint32_t numTris, uint32_t depth) const;
+	template<uint32_t W>
+	uint32_t bvh_flatten(const BVHbuildNode* node, std::vector<BVHwideNode<W>>& nodes);
+
+	//same as kdtree_traverse, leaves are visited roughly front to back
+	template<uint32_t W, typename F>
+	bool bvh_traverse(std::span<const BVHwideNode<W>> nodes, const Ray& ray, float& tMax, F&& intersectLeaf) const;
+
+	std::vector<BVHwideNode<4>> m_bvh4;
+	std::vector<BVHwideNode<8>> m_bvh8;
+
+	//-------------------------------------------//
+	//GEOMETRY VIEWS:
+
+	//intersection and shading only read through these. they point into the arrays above until build() copies everything 
+	//into a single GeometryArena allocation and frees the arrays, so the data a ray touches shares as few pages as possible
+	std::span<const uint32_t> m_indexView;
+	std::span<const float> m_vertView;
+	std::span<const CompactVertex> m_compactVertView;
+	std::span<const TriangleBlockSIMD> m_triBlockView;
+	std::span<const uint32_t> m_triBlockLaneView;
+	std::span<const KDtreeNode> m_kdTreeView;
+	std::span<const BVHwideNode<4>> m_bvh4View;
+	std::span<const BVHwideNode<8>> m_bvh8View;
+	void* m_arenaData = nullptr;
+
+	void move_to_arena();
 
 	//-------------------------------------------//
 	//MESH GENERATION:
@@ -8,6 +8,8 @@
 #define FR_OBJECT_H
 
 #include "fr_mesh.hpp"
+#include "fr_shape.hpp"
+#include "fr_bvh.hpp"
 #include "fr_material.hpp"
 
 //-------------------------------------------//
@@ -15,10 +17,13 @@
 namespace fr
 {
 
+//exactly one of mesh and shape must be set. alpha masks only apply to meshes. offset places an instanced mesh (see MeshInstance)
 struct ObjectComponent
 {
 	std::shared_ptr<const Mesh> mesh;
 	std::shared_ptr<const Material> material;
+	std::shared_ptr<const Shape> shape;
+	vec3 offset = vec3(0.0f);
 };
 
 class Object
@@ -26,16 +31,32 @@ class Object
 public:
 	Object(const std::vector<std::shared_ptr<const Mesh>>& meshes, const std::vector<std::shared_ptr<const Material>>& materials);
 	Object(const std::shared_ptr<const Mesh>& mesh, const std::shared_ptr<const Material>& material);
+	Object(const std::shared_ptr<const Shape>& shape, const std::shared_ptr<const Material>& material);
 	Object(const std::vector<ObjectComponent>& components);
 
-	bool intersect(const Ray& ray, float& t, vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs, std::shared_ptr<const Material>& material) const;
+	//triIdx and barycentrics are 0 for shapes
+	bool intersect(const Ray& ray, float tMax, float& t, uint32_t& componentIdx, uint32_t& triIdx, vec2& barycentrics) const;
+	//intersects the rays in rayMask, each only up to its tMax. returns a mask of the rays that found a closer hit,
+	//for which tMax, componentIdx, triIdx and barycentrics are updated. requires get_simd_level() >= SIMD_LEVEL_AVX2
+	FR_TARGET_AVX2 uint32_t intersect8(const RayPacket8& rays, uint32_t rayMask, float* tMax, uint32_t* componentIdx, uint32_t* triIdx, vec2* barycentrics) const;
+	bool occluded(const Ray& ray, float tMax) const;
 
+	const ObjectComponent& get_component(uint32_t idx) const;
+	//moves object space rays into the space of the component's mesh or shape, hits are found at the same t
+	const Transform3x4& get_component_transform(uint32_t idx) const;
 	bound3 get_bounds() const;
 
-	static std::shared_ptr<const Object> from_obj(const std::string& objPath, const std::string& mtlPath, bool opacityIsMask = true);
+	static std::shared_ptr<const Object> from_obj(const std::string& objPath, const std::string& mtlPath, bool opacityIsMask = true,
+	                                              MeshAccelerator accelerator = MESH_ACCELERATOR_KD_TREE, VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT);
 
 private:
 	std::vector<ObjectComponent> m_components;
+	std::vector<Transform3x4> m_componentTransforms;
+	BVH m_bvh;
+
+	void bvh_build();
+
+	static std::shared_ptr<const Material> find_material(const std::string& name, const std::vector<std::shared_ptr<const Material>>& materials);
 };
 
 }; //namespace fr
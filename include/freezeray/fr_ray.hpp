@@ -7,7 +7,11 @@
 #ifndef FR_RAY_H
 #define FR_RAY_H
 
+#include <stdint.h>
+#include <immintrin.h>
 #include "quickmath.hpp"
+#include "fr_transform.hpp"
+#include "fr_globals.hpp"
 using namespace qm; //TODO: do we want to have this?
 
 //-------------------------------------------//
@@ -29,16 +33,20 @@ public:
 
 	inline vec3 at(float t) const { return m_orig + t * m_dir; }
 
-	inline Ray transformed(mat4 transform, mat4 transformNoTranslate) const 
+	//the direction is not renormalized, so distances along the ray are the same before and after
+	inline Ray transformed(const Transform3x4& transform) const 
 	{
+		if(transform.type() == TRANSFORM_TYPE_IDENTITY)
+			return *this;
+
 		if(m_hasDifferentials)
 		{
-			return Ray(transformed(m_orig, m_dir, transform, transformNoTranslate),
-			           transformed(m_diffOrigX, m_diffDirX, transform, transformNoTranslate),
-			           transformed(m_diffOrigY, m_diffDirY, transform, transformNoTranslate));
+			return Ray(transformed(m_orig, m_dir, transform),
+			           transformed(m_diffOrigX, m_diffDirX, transform),
+			           transformed(m_diffOrigY, m_diffDirY, transform));
 		}
 		else
-			return transformed(m_orig, m_dir, transform, transformNoTranslate);
+			return transformed(m_orig, m_dir, transform);
 	};
 
 	inline bool has_differentials() const { return m_hasDifferentials; }
@@ -55,10 +63,105 @@ private:
 	vec3 m_diffDirX;
 	vec3 m_diffDirY;
 
-	static inline Ray transformed(vec3 orig, vec3 dir, mat4 transform, mat4 transformNoTranslate) 
+	static inline Ray transformed(const vec3& orig, const vec3& dir, const Transform3x4& transform) 
 	{ 
-		return Ray((transform * vec4(orig, 1.0)).xyz(), (transformNoTranslate * vec4(dir, 1.0)).xyz()); 
+		return Ray(transform.apply_point(orig), transform.apply_vector(dir)); 
+	};
+};
+
+//-------------------------------------------//
+
+//up to 8 rays in SoA layout, so they can be traversed through an acceleration structure together.
+//differentials are not stored, packets are only used to find hits. the SIMD accessors need AVX2, see FR_TARGET_AVX2
+class RayPacket8
+{
+public:
+	RayPacket8() : m_numRays(0) {};
+	RayPacket8(const Ray* rays, uint32_t numRays) : m_numRays(numRays)
+	{
+		//unused lanes duplicate the first ray, so they never break the packet's coherence
+		for(uint32_t i = 0; i < 8; i++)
+		{
+			const Ray& ray = rays[i < numRays ? i : 0];
+			set_lane(i, ray.origin(), ray.direction());
+		}
 	};
+
+	inline uint32_t num_rays() const { return m_numRays; }
+	inline uint32_t active_mask() const { return (1u << m_numRays) - 1; }
+
+	inline Ray get_ray(uint32_t idx) const 
+	{ 
+		return Ray(vec3(m_orig[0][idx], m_orig[1][idx], m_orig[2][idx]), vec3(m_dir[0][idx], m_dir[1][idx], m_dir[2][idx])); 
+	}
+
+	FR_TARGET_AVX2 inline __m256 origin(uint32_t axis) const { return _mm256_load_ps(m_orig[axis]); }
+	FR_TARGET_AVX2 inline __m256 inv_direction(uint32_t axis) const { return _mm256_load_ps(m_invDir[axis]); }
+
+	//returns whether the rays in mask all point the same way along every axis, writing the shared signs to dirIsNeg
+	FR_TARGET_AVX2 inline bool coherent(uint32_t mask, bool dirIsNeg[3]) const
+	{
+		for(uint32_t axis = 0; axis < 3; axis++)
+		{
+			uint32_t negMask = (uint32_t)_mm256_movemask_ps(inv_direction(axis)) & mask;
+			if(negMask != 0 && negMask != mask)
+				return false;
+
+			dirIsNeg[axis] = negMask != 0;
+		}
+
+		return true;
+	}
+
+	//transforms each ray exactly like Ray::transformed(), so packet and single ray hits match
+	FR_TARGET_AVX2 inline RayPacket8 transformed(const Transform3x4& transform) const
+	{
+		if(transform.type() == TRANSFORM_TYPE_IDENTITY)
+			return *this;
+
+		RayPacket8 result;
+		result.m_numRays = m_numRays;
+
+		//translations leave the directions untouched:
+		//---------------
+		if(transform.type() == TRANSFORM_TYPE_TRANSLATION)
+		{
+			vec3 translation = transform.translation();
+			for(uint32_t axis = 0; axis < 3; axis++)
+			{
+				_mm256_store_ps(result.m_orig[axis], _mm256_add_ps(origin(axis), _mm256_set1_ps(translation[axis])));
+				_mm256_store_ps(result.m_dir[axis], _mm256_load_ps(m_dir[axis]));
+				_mm256_store_ps(result.m_invDir[axis], inv_direction(axis));
+			}
+
+			return result;
+		}
+
+		for(uint32_t i = 0; i < 8; i++)
+		{
+			Ray ray = get_ray(i).transformed(transform);
+			result.set_lane(i, ray.origin(), ray.direction());
+		}
+
+		return result;
+	}
+
+private:
+	alignas(32) float m_orig[3][8];
+	alignas(32) float m_dir[3][8];
+	alignas(32) float m_invDir[3][8];
+
+	uint32_t m_numRays;
+
+	inline void set_lane(uint32_t idx, const vec3& orig, const vec3& dir)
+	{
+		for(uint32_t axis = 0; axis < 3; axis++)
+		{
+			m_orig[axis][idx] = orig[axis];
+			m_dir[axis][idx] = dir[axis];
+			m_invDir[axis][idx] = 1.0f / dir[axis];
+		}
+	}
 };
 
 }; //namespace fr
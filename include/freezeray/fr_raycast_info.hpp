@@ -18,6 +18,7 @@ namespace fr
 class BSDF;
 class Light;
 class Camera;
+class Material;
 
 struct IntersectionInfo
 {
@@ -40,6 +41,27 @@ struct IntersectionInfo
 	} derivatives;
 };
 
+//compact, purely geometric record of an intersection. shading info is only computed when needed, with Scene::shade()
+struct HitRecord
+{
+	float t;
+
+	uint32_t objectIdx;
+	uint32_t componentIdx;
+	uint32_t triIdx;
+	vec2 barycentrics;
+
+	const Material* material;
+	const Light* light;
+};
+
+//closest hits for each ray in a RayPacket8
+struct HitPacket8
+{
+	HitRecord hits[8];
+	uint32_t hitMask; //bit i is set if ray i hit something
+};
+
 struct VisibilityTestInfo
 {
 	vec3 startPos;
@@ -9,9 +9,11 @@
 
 #include <stdint.h>
 #include <functional>
+#include <string>
 #include "fr_camera.hpp"
 #include "fr_scene.hpp"
 #include "fr_prng.hpp"
+#include "fr_film.hpp"
 
 #include "quickmath.hpp"
 using namespace qm;
@@ -24,17 +26,37 @@ namespace fr
 class Renderer
 {
 public:
-	Renderer(const std::shared_ptr<const Camera>& cam, uint32_t imageW, uint32_t imageH);
+	Renderer(const std::shared_ptr<const Camera>& cam, uint32_t imageW, uint32_t imageH, uint32_t samplesPerPixel);
 	~Renderer();
 
 	//renders the entire scene into the given image buffer, calling display occasionally to allow
-	//the current result to be displayed
+	//the current result to be displayed. writePixel and display are only called from the calling thread
 	virtual void render(const std::shared_ptr<const Scene>& scene,
 	                    std::function<void(uint32_t x, uint32_t y, vec3 color)> writePixel, 
 	                    std::function<void(float progress)> display, uint32_t displayFrequency = 1);
 
+	//number of worker threads used by every renderer, 0 (the default) uses one per hardware thread
+	static void set_num_threads(uint32_t numThreads);
+	static uint32_t get_num_threads();
+
+	//pixels take minSamples samples, then more in rounds of samplesPerRound until their relative error falls below maxRelativeError
+	//or they've taken the full samples per pixel. tiles drop out of the schedule once all of their pixels are done.
+	//a maxRelativeError of 0 (the default) disables adaptive sampling
+	void set_adaptive_sampling(float maxRelativeError, uint32_t minSamples = 32, uint32_t samplesPerRound = 16);
+
+	//saves the film to path every interval seconds and once the render is done. with resume, a checkpoint already at path is
+	//loaded first and sampling continues until every pixel has the full samples per pixel (or has converged). checkpoints of a
+	//different scene or camera, or taken with different sampling settings, are ignored. an empty path disables it
+	void set_checkpoint(const std::string& path, uint32_t interval = 300, bool resume = false);
+
 protected:
-	virtual vec3 li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray) const = 0;
+	//adds numSamples samples of the radiance along ray to estimate
+	virtual void li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, uint32_t numSamples, PixelEstimate& estimate) const = 0;
+	//same as li, but with the camera ray's closest hit already found. only called if use_primary_packets() returns true
+	virtual void li_primary(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, bool hit, const HitRecord& hitRecord,
+	                        uint32_t numSamples, PixelEstimate& estimate) const;
+	//whether camera rays should be traced in packets of 8 before calling li_primary() for each pixel
+	virtual bool use_primary_packets() const;
 
 	vec3 sample_one_light(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const IntersectionInfo& hitInfo, const vec3& wo) const;
 	vec3 sample_one_light_mis(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const IntersectionInfo& hitInfo, const vec3& wo) const;
@@ -50,8 +72,22 @@ protected:
 	uint32_t m_imageW;
 	uint32_t m_imageH;
 
+	uint32_t m_samplesPerPixel;
+	float m_maxRelativeError = 0.0f;
+	uint32_t m_minSamples = 32;
+	uint32_t m_samplesPerRound = 16;
+
+	std::string m_checkpointPath;
+	uint32_t m_checkpointInterval = 300;
+	bool m_resume = false;
+
+	static uint32_t m_numThreads;
+
 	Ray get_camera_ray(uint32_t x, uint32_t y) const;
 	Ray get_camera_ray(vec2 uv) const;
+
+	//identifies a render for checkpointing, a checkpoint is only resumed if it was saved with the same key
+	uint64_t checkpoint_key(const std::shared_ptr<const Scene>& scene) const;
 };
 
 }; //namespace fr
@@ -8,6 +8,7 @@
 #define FR_SCENE_H
 
 #include "fr_ray.hpp"
+#include "fr_bvh.hpp"
 #include "fr_object.hpp"
 #include "fr_light.hpp"
 #include "fr_raycast_info.hpp"
@@ -32,12 +33,24 @@ public:
 	Scene(const std::vector<ObjectReference>& objects, std::vector<std::unique_ptr<Light>>& lights);
 
 	bool intersect(const Ray& ray, IntersectionInfo& info) const;
+	//only finds the closest hit, shade() must be called to get the full IntersectionInfo
+	bool intersect(const Ray& ray, HitRecord& hit) const;
+	//finds the closest hit for each ray in the packet, traversing the acceleration structures once for all of them where possible.
+	//requires get_simd_level() >= SIMD_LEVEL_AVX2
+	FR_TARGET_AVX2 void intersect8(const RayPacket8& rays, HitPacket8& hits) const;
+	//if buildBsdf is false, info.bsdf is left null (for when only emission is needed)
+	void shade(const Ray& ray, const HitRecord& hit, IntersectionInfo& info, bool buildBsdf = true) const;
+	void shade_miss(const Ray& ray, IntersectionInfo& info) const;
+	//returns whether anything is hit along the ray before tMax, does not compute any shading info
+	bool occluded(const Ray& ray, float tMax) const;
 
 	const std::vector<std::shared_ptr<const Light>>& get_lights() const;
 	const std::vector<std::shared_ptr<const Light>>& get_infinite_lights() const;
 
 	bound3 get_world_bounds() const;
 	float get_world_radius() const;
+	//hash of the object placements and light powers, enough to tell scenes apart (e.g. for checkpoints) without hashing all geometry
+	uint64_t get_hash() const;
 
 private:
 	struct ObjectReferenceFull
@@ -45,12 +58,14 @@ private:
 		std::shared_ptr<const Object> object;
 		std::shared_ptr<const Light> light;
 
-		mat4 transform;
-		mat4 transformNoTranslate;
-		mat4 invTransform;
-		mat4 invTransformNoTranslate;
+		//identity and translation-only transforms are detected, so untransformed objects cost nothing extra
+		Transform3x4 transform;
+		Transform3x4 invTransform;
+
+		bound3 bounds; //world space
 	};
 	std::vector<ObjectReferenceFull> m_objects;
+	BVH m_bvh;
 
 	std::vector<std::shared_ptr<const Light>> m_lights;
 	std::vector<std::shared_ptr<const Light>> m_infiniteLights;
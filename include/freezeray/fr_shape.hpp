@@ -0,0 +1,46 @@
+/* fr_shape.hpp
+ *
+ * contains the definition of the shape class, which represents an analytic
+ * surface that can be used in place of a triangle mesh
+ */
+
+#ifndef FR_SHAPE_H
+#define FR_SHAPE_H
+
+#include "fr_ray.hpp"
+#include "fr_globals.hpp"
+#include "fr_raycast_info.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//shapes are defined in their own object space, use an ObjectReference transform to position + scale them.
+//intersections are exact, so there is no tessellation and no acceleration structure to traverse
+class Shape
+{
+public:
+	virtual bound3 get_bounds() const = 0;
+	virtual float get_area() const = 0;
+
+	//the ray does not need to be normalized, t is in units of its direction (same as Mesh::intersect)
+	virtual bool intersect(const Ray& ray, float tMax, float& t) const = 0;
+	virtual bool occluded(const Ray& ray, float tMax) const;
+
+	//computes the surface attributes at ray.at(t), the normal is not normalized (same as Mesh::get_hit_attribs)
+	void get_hit_attribs(const Ray& ray, float t, vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs) const;
+
+	//samples a point uniformly by area, pdf is 1 / get_area()
+	virtual vec3 sample_area(const vec2& u, vec3& normal) const = 0;
+
+protected:
+	//returns the uv and outward normal at a point on (or very near) the surface
+	virtual void get_surface_attribs(const vec3& pos, vec2& uv, vec3& normal) const = 0;
+	//whether u wraps around from 1 to 0 (e.g. longitude on a sphere)
+	virtual bool periodic_u() const { return false; }
+};
+
+}; //namespace fr
+
+#endif //#ifndef FR_SHAPE_H
\ No newline at end of file
@@ -25,6 +25,10 @@ class Texture
 {
 public:
 	virtual T evaluate(const IntersectionInfo& hitInfo) const = 0;
+
+	//computes conservative bounds (minVal, maxVal) on the values evaluate() can return without filtering (0 derivatives) anywhere
+	//inside the triangle spanned by uv0, uv1, and uv2. returns false if the texture cant compute them, which the default does
+	virtual bool get_range(const vec2& /*uv0*/, const vec2& /*uv1*/, const vec2& /*uv2*/, T& /*minVal*/, T& /*maxVal*/) const { return false; }
 };
 
 }; //namespace fr
@@ -0,0 +1,93 @@
+/* fr_transform.hpp
+ *
+ * contains the definition of the affine transform class used to move
+ * rays and hit points between world and object space
+ */
+
+#ifndef FR_TRANSFORM_H
+#define FR_TRANSFORM_H
+
+#include <stdint.h>
+#include "quickmath.hpp"
+using namespace qm;
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//cheapest way a transform can be applied, determined once on construction
+enum TransformType : uint32_t
+{
+	TRANSFORM_TYPE_IDENTITY,
+	TRANSFORM_TYPE_TRANSLATION,
+	TRANSFORM_TYPE_AFFINE
+};
+
+//the upper 3 rows of a 4x4 matrix, the projective row is ignored (as mat4 * vec4(p, 1.0f)).xyz() would).
+//the products are summed in the same order as quickmath, so results match transforming with the full matrix
+class Transform3x4
+{
+public:
+	Transform3x4() : m_type(TRANSFORM_TYPE_IDENTITY), m_rows{ {1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f} } {};
+	Transform3x4(const mat4& mat)
+	{
+		bool linearIsIdentity = true;
+		for(uint32_t row = 0; row < 3; row++)
+		for(uint32_t col = 0; col < 4; col++)
+		{
+			m_rows[row][col] = mat.m[col][row];
+			if(col < 3)
+				linearIsIdentity = linearIsIdentity && m_rows[row][col] == (row == col ? 1.0f : 0.0f);
+		}
+
+		bool hasTranslation = m_rows[0][3] != 0.0f || m_rows[1][3] != 0.0f || m_rows[2][3] != 0.0f;
+		if(!linearIsIdentity)
+			m_type = TRANSFORM_TYPE_AFFINE;
+		else if(hasTranslation)
+			m_type = TRANSFORM_TYPE_TRANSLATION;
+		else
+			m_type = TRANSFORM_TYPE_IDENTITY;
+	};
+
+	inline TransformType type() const { return m_type; }
+	inline vec3 translation() const { return vec3(m_rows[0][3], m_rows[1][3], m_rows[2][3]); }
+
+	inline vec3 apply_point(const vec3& p) const
+	{
+		switch(m_type)
+		{
+		case TRANSFORM_TYPE_IDENTITY:
+			return p;
+		case TRANSFORM_TYPE_TRANSLATION:
+			return p + translation();
+		default:
+			return vec3(
+				m_rows[0][0] * p.x + m_rows[0][1] * p.y + m_rows[0][2] * p.z + m_rows[0][3],
+				m_rows[1][0] * p.x + m_rows[1][1] * p.y + m_rows[1][2] * p.z + m_rows[1][3],
+				m_rows[2][0] * p.x + m_rows[2][1] * p.y + m_rows[2][2] * p.z + m_rows[2][3]
+			);
+		}
+	}
+
+	//ignores the translation
+	inline vec3 apply_vector(const vec3& v) const
+	{
+		if(m_type != TRANSFORM_TYPE_AFFINE)
+			return v;
+
+		return vec3(
+			m_rows[0][0] * v.x + m_rows[0][1] * v.y + m_rows[0][2] * v.z,
+			m_rows[1][0] * v.x + m_rows[1][1] * v.y + m_rows[1][2] * v.z,
+			m_rows[2][0] * v.x + m_rows[2][1] * v.y + m_rows[2][2] * v.z
+		);
+	}
+
+private:
+	TransformType m_type;
+	float m_rows[3][4];
+};
+
+}; //namespace fr
+
+#endif //#ifndef FR_TRANSFORM_H
\ No newline at end of file
@@ -22,6 +22,8 @@ class LightArea : public Light
 {
 public:
 	LightArea(const std::shared_ptr<const Mesh>& mesh, const mat4& transform, const vec3& intensity);
+	//the transform may only rotate, translate, and uniformly scale the shape, so it can be sampled uniformly by area
+	LightArea(const std::shared_ptr<const Shape>& shape, const mat4& transform, const vec3& intensity);
 
 	virtual vec3 sample_li(const IntersectionInfo& hitInfo, const vec3& u, vec3& wiWorld, VisibilityTestInfo& vis, float& pdf) const override;
 	virtual float pdf_li(const IntersectionInfo& hitInfo, const vec3& w) const override;
@@ -32,18 +34,20 @@ public:
 	virtual void pdf_le(const Ray& ray, const vec3& normal, float& pdfPos, float& pdfDir) const override;
 
 	virtual std::shared_ptr<const Mesh> get_mesh(mat4& transform) const override;
+	virtual std::shared_ptr<const Shape> get_shape(mat4& transform) const override;
 
 private:
 	std::shared_ptr<const Mesh> m_mesh;
+	std::shared_ptr<const Shape> m_shape;
 	mat4 m_transform;
-	mat4 m_invTransform;
-	mat4 m_invTransformNoTranslate;
+	Transform3x4 m_invTransform;
 	vec3 m_intensity;
 
 	float m_area;
 	std::unique_ptr<DistributionDiscrete<uint32_t>> m_triDistribution;
 
 	vec3 sample_mesh_area(const vec3& u, float& pdf, vec3& normal) const;
+	vec3 sample_shape_area(const vec3& u, float& pdf, vec3& normal) const;
 };
 
 }; //namespace fr
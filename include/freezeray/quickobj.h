@@ -48,6 +48,7 @@
  * 			array of indices (uint32_t*)
  * 
  * 			material name (char*)
+ * 			group (uint32_t) (index of the "o"/"g" statement the faces follow, faces are only merged within a group)
  * 
  * ENUMS:
  * ------------------------------------------------------------------------
@@ -135,6 +136,7 @@ typedef struct QOBJmesh
 	uint32_t* indices;
 
 	char* material;
+	uint32_t group; //0 for faces before the first "o"/"g", each later "o"/"g" starts a new group
 } QOBJmesh;
 
 //an error value, returned by all functions which can have errors
@@ -630,6 +632,7 @@ QOBJerror qobj_load_obj(const char* path, uint32_t* numMeshes, QOBJmesh** meshes
 
 	char curMaterial[QOBJ_MAX_TOKEN_LEN] = {}; //no material specified (yet)
 	uint32_t curMesh = UINT32_MAX;             //no working mesh (yet)
+	uint32_t curGroup = 0;
 
 	while(1)
 	{
@@ -641,9 +644,16 @@ QOBJerror qobj_load_obj(const char* path, uint32_t* numMeshes, QOBJmesh** meshes
 		if(curToken[0] == '\0')
 			continue;
 
-		if(curToken[0] == '#'         || strcmp(curToken, "o") == 0 || 
-		   strcmp(curToken, "g") == 0 || strcmp(curToken, "s") == 0 || //comments / ignored commands
-		   strcmp(curToken, "mtllib") == 0)
+		if(strcmp(curToken, "o") == 0 || strcmp(curToken, "g") == 0)
+		{
+			if(isspace(curTokenEnd))
+				qobj_fgets(fptr, curToken, &curTokenEnd);
+
+			curGroup++;
+			curMesh = UINT32_MAX;
+		}
+		else if(curToken[0] == '#' || strcmp(curToken, "s") == 0 || //comments / ignored commands
+		        strcmp(curToken, "mtllib") == 0)
 		{
 			if(isspace(curTokenEnd))
 				qobj_fgets(fptr, curToken, &curTokenEnd);
@@ -748,14 +758,15 @@ QOBJerror qobj_load_obj(const char* path, uint32_t* numMeshes, QOBJmesh** meshes
 				break;
 			}
 
-			//if no mesh is active yet, try to find an existing mesh with the same material:
+			//if no mesh is active yet, try to find an existing mesh with the same material and group:
+			//(meshes are created in group order, so only the last ones can be in the current group)
 			//---------------
 			if(curMesh == UINT32_MAX)
-				for(uint32_t i = 0; i < *numMeshes; i++)
+				for(uint32_t i = *numMeshes; i > 0 && (*meshes)[i - 1].group == curGroup; i--)
 				{
-					if(strcmp(curMaterial, (*meshes)[i].material) == 0)
+					if(strcmp(curMaterial, (*meshes)[i - 1].material) == 0)
 					{
-						curMesh = i;
+						curMesh = i - 1;
 						break;
 					}
 				}
@@ -804,6 +815,7 @@ QOBJerror qobj_load_obj(const char* path, uint32_t* numMeshes, QOBJmesh** meshes
 				}
 
 				//increment num meshes:
+				(*meshes)[curMesh].group = curGroup;
 				(*numMeshes)++;
 			}
 
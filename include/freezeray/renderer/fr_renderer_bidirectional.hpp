@@ -57,7 +57,6 @@ protected:
 	};
 
 	uint32_t m_maxDepth;
-	uint32_t m_samplesPerPixel;
 	bool m_importanceSampling;
 	bool m_mis;
 
@@ -73,7 +72,7 @@ protected:
 	std::vector<PathVertex> trace_light_subpath(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, uint32_t depth) const;
 
 private:
-	vec3 li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray) const override;
+	void li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, uint32_t numSamples, PixelEstimate& estimate) const override;
 
 	void trace_walk(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, TransportMode mode, vec3 mult, float pdf, std::vector<PathVertex>& vertices, uint32_t depth) const;
 };
@@ -23,11 +23,13 @@ public:
 
 private:
 	uint32_t m_maxDepth;
-	uint32_t m_samplesPerPixel;
 	bool m_importanceSampling;
 	bool m_mis;
 
-	vec3 li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray) const override;
+	void li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, uint32_t numSamples, PixelEstimate& estimate) const override;
+	void li_primary(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, bool hit, const HitRecord& hitRecord,
+	                uint32_t numSamples, PixelEstimate& estimate) const override;
+	bool use_primary_packets() const override;
 	vec3 trace_path(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, bool initialHit, const IntersectionInfo& initialHitInfo) const;
 };
 
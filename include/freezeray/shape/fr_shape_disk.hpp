@@ -0,0 +1,37 @@
+/* fr_shape_disk.hpp
+ *
+ * contains a definition for an analytic disk
+ */
+
+#ifndef FR_SHAPE_DISK_H
+#define FR_SHAPE_DISK_H
+
+#include "../fr_shape.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//disk centered at the origin in the xz plane, facing +y. uvs are mapped from its bounding square
+class ShapeDisk : public Shape
+{
+public:
+	ShapeDisk(float radius = 1.0f);
+
+	bound3 get_bounds() const override;
+	float get_area() const override;
+
+	bool intersect(const Ray& ray, float tMax, float& t) const override;
+	vec3 sample_area(const vec2& u, vec3& normal) const override;
+
+protected:
+	void get_surface_attribs(const vec3& pos, vec2& uv, vec3& normal) const override;
+
+private:
+	float m_radius;
+};
+
+}; //namespace fr
+
+#endif //#ifndef FR_SHAPE_DISK_H
\ No newline at end of file
@@ -0,0 +1,38 @@
+/* fr_shape_rectangle.hpp
+ *
+ * contains a definition for an analytic rectangle
+ */
+
+#ifndef FR_SHAPE_RECTANGLE_H
+#define FR_SHAPE_RECTANGLE_H
+
+#include "../fr_shape.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//rectangle centered at the origin in the xz plane, facing +y. size is its extent along x and z,
+//the default matches Mesh::from_unit_square() (including the uvs)
+class ShapeRectangle : public Shape
+{
+public:
+	ShapeRectangle(const vec2& size = vec2(1.0f));
+
+	bound3 get_bounds() const override;
+	float get_area() const override;
+
+	bool intersect(const Ray& ray, float tMax, float& t) const override;
+	vec3 sample_area(const vec2& u, vec3& normal) const override;
+
+protected:
+	void get_surface_attribs(const vec3& pos, vec2& uv, vec3& normal) const override;
+
+private:
+	vec2 m_size;
+};
+
+}; //namespace fr
+
+#endif //#ifndef FR_SHAPE_RECTANGLE_H
\ No newline at end of file
@@ -0,0 +1,38 @@
+/* fr_shape_sphere.hpp
+ *
+ * contains a definition for an analytic sphere
+ */
+
+#ifndef FR_SHAPE_SPHERE_H
+#define FR_SHAPE_SPHERE_H
+
+#include "../fr_shape.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//sphere centered at the origin. u is the longitude around the y axis, v goes from the top (+y) to the bottom
+class ShapeSphere : public Shape
+{
+public:
+	ShapeSphere(float radius = 1.0f);
+
+	bound3 get_bounds() const override;
+	float get_area() const override;
+
+	bool intersect(const Ray& ray, float tMax, float& t) const override;
+	vec3 sample_area(const vec2& u, vec3& normal) const override;
+
+protected:
+	void get_surface_attribs(const vec3& pos, vec2& uv, vec3& normal) const override;
+	bool periodic_u() const override { return true; }
+
+private:
+	float m_radius;
+};
+
+}; //namespace fr
+
+#endif //#ifndef FR_SHAPE_SPHERE_H
\ No newline at end of file
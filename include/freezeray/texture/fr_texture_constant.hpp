@@ -20,6 +20,7 @@ public:
 	TextureConstant(const T& value) : m_value(value) {}
 
 	T evaluate(const IntersectionInfo& hitInfo) const override { return m_value; }
+	bool get_range(const vec2& /*uv0*/, const vec2& /*uv1*/, const vec2& /*uv2*/, T& minVal, T& maxVal) const override { minVal = maxVal = m_value; return true; }
 
 private:
 	T m_value;
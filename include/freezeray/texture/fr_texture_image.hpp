@@ -22,6 +22,8 @@ public:
 	TextureImage(const std::vector<Image<Tmemory>>& mipPyramid, TextureRepeatMode repeatMode, T multiplier = 1.0);
 
 	T evaluate(const IntersectionInfo& hitInfo) const override;
+	//only supported for single-channel textures
+	bool get_range(const vec2& uv0, const vec2& uv1, const vec2& uv2, T& minVal, T& maxVal) const override;
 
 	static std::shared_ptr<TextureImage<T, Tmemory, Tprocessing>> from_file(const std::string& path, bool hdr, TextureRepeatMode repeatMode, T multiplier = 1.0);
 
@@ -3,6 +3,12 @@
 #include "stb_image.h"
 #include "../fr_globals.hpp"
 #include <math.h>
+#include <type_traits>
+
+//-------------------------------------------//
+
+//get_range() gives up on triangles covering more texels than this, scanning them would cost more than it saves
+#define FR_TEXTURE_IMAGE_MAX_RANGE_TEXELS (1 << 22)
 
 //-------------------------------------------//
 
@@ -106,6 +112,83 @@ T TextureImage<T, Tmemory, Tprocessing>::evaluate(const IntersectionInfo& hitInf
 	return sampled * m_multiplier;
 }
 
+template<typename T, typename Tmemory, typename Tprocessing>
+bool TextureImage<T, Tmemory, Tprocessing>::get_range(const vec2& uv0, const vec2& uv1, const vec2& uv2, T& minVal, T& maxVal) const
+{
+	if constexpr(!std::is_same_v<T, float>)
+		return false;
+	else
+	{
+		//transform into level 0 texel space, where bilinear() blends the texels at floor(p) and floor(p) + 1:
+		//---------------
+		float width  = (float)m_mipPyramid[0].get_width();
+		float height = (float)m_mipPyramid[0].get_height();
+
+		vec2 p[3] = {
+			vec2(uv0.x * width - 0.5f, uv0.y * height - 0.5f),
+			vec2(uv1.x * width - 0.5f, uv1.y * height - 0.5f),
+			vec2(uv2.x * width - 0.5f, uv2.y * height - 0.5f)
+		};
+
+		float minX = std::min(std::min(p[0].x, p[1].x), p[2].x);
+		float minY = std::min(std::min(p[0].y, p[1].y), p[2].y);
+		float maxX = std::max(std::max(p[0].x, p[1].x), p[2].x);
+		float maxY = std::max(std::max(p[0].y, p[1].y), p[2].y);
+
+		//also rejects NaNs
+		if(!((maxX - minX + 2.0f) * (maxY - minY + 2.0f) <= (float)FR_TEXTURE_IMAGE_MAX_RANGE_TEXELS))
+			return false;
+
+		//texel (x, y) contributes to a sample at p iff p lies in the square [x - 1, x + 1) x [y - 1, y + 1),
+		//so gather every texel whose square overlaps the triangle (separating axis test against each edge):
+		//---------------
+		float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+		float orientation = area > 0.0f ? 1.0f : -1.0f;
+		bool degenerate = std::abs(area) < FR_EPSILON; //only the bounding box is used for these
+
+		minVal = INFINITY;
+		maxVal = -INFINITY;
+
+		int32_t startX = (int32_t)std::floor(minX);
+		int32_t startY = (int32_t)std::floor(minY);
+		int32_t endX = (int32_t)std::floor(maxX) + 1;
+		int32_t endY = (int32_t)std::floor(maxY) + 1;
+		for(int32_t y = startY; y <= endY; y++)
+		for(int32_t x = startX; x <= endX; x++)
+		{
+			bool overlaps = true;
+			for(uint32_t i = 0; i < 3 && overlaps && !degenerate; i++)
+			{
+				const vec2& a = p[i];
+				const vec2& b = p[(i + 1) % 3];
+
+				float edgeX = b.x - a.x;
+				float edgeY = b.y - a.y;
+				float extent = std::abs(edgeX) + std::abs(edgeY);
+
+				float dist = orientation * (edgeX * ((float)y - a.y) - edgeY * ((float)x - a.x));
+				overlaps = dist + extent * (1.0f + FR_EPSILON) >= 0.0f;
+			}
+
+			if(!overlaps)
+				continue;
+
+			float texel = get_texel(0, x, y);
+			minVal = std::min(minVal, texel);
+			maxVal = std::max(maxVal, texel);
+		}
+
+		//bilinear() is a convex combination of the gathered texels:
+		//---------------
+		minVal *= m_multiplier;
+		maxVal *= m_multiplier;
+		if(minVal > maxVal)
+			std::swap(minVal, maxVal);
+
+		return true;
+	}
+}
+
 template<typename T, typename Tmemory, typename Tprocessing>
 std::shared_ptr<TextureImage<T, Tmemory, Tprocessing>> TextureImage<T, Tmemory, Tprocessing>::from_file(const std::string& path, bool hdr, TextureRepeatMode repeatMode, T multiplier)
 {
@@ -19,7 +19,7 @@ ExampleScene example_cornell_box()
 	std::shared_ptr<const fr::Mesh> squareMesh = fr::Mesh::from_unit_square();
 	std::shared_ptr<const fr::Mesh> cubeMesh = fr::Mesh::from_unit_cube();
 	std::shared_ptr<const fr::Mesh> sphereMesh = fr::Mesh::from_unit_sphere();
-	std::shared_ptr<const fr::Mesh> lampMesh = fr::Mesh::from_obj("assets/models/lamp.obj")[0];	
+	std::shared_ptr<const fr::Mesh> lampMesh = fr::Mesh::from_obj("assets/models/lamp.obj")[0].mesh;	
 
 	std::shared_ptr<fr::Texture<vec3>> whiteColorTex = std::make_shared<fr::TextureConstant<vec3>>(vec3(0.73f, 0.73f, 0.73f));
 	std::shared_ptr<fr::Texture<vec3>> redColorTex = std::make_shared<fr::TextureConstant<vec3>>(vec3(0.65f, 0.05f, 0.05f));
@@ -63,7 +63,7 @@ ExampleScene example_cornell_box()
 	vec2 lampPos = vec2(0.4f, -0.4f);
 	mat4 lightTransform = translate(vec3(lampPos.x, 0.2f, lampPos.y)) * scale(vec3(0.0125f));						 
 
-	fr::ObjectComponent lampComp = { lampMesh, whiteMat };
+	fr::ObjectComponent lampComp = { lampMesh, whiteMat, nullptr };
 	std::vector<fr::ObjectComponent> test = {lampComp};
 	std::shared_ptr<const fr::Object> lampObj = std::make_shared<fr::Object>(test);
 	mat4 lampTransform = translate(vec3(lampPos.x, -0.5f, lampPos.y)) * scale(vec3(0.4f));
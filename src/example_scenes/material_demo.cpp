@@ -14,6 +14,8 @@
 #include "freezeray/material/fr_material_mirror.hpp"
 #include "freezeray/material/fr_material_plastic.hpp"
 #include "freezeray/light/fr_light_environment.hpp"
+#include "freezeray/shape/fr_shape_sphere.hpp"
+#include "freezeray/shape/fr_shape_rectangle.hpp"
 
 //-------------------------------------------//
 
@@ -26,8 +28,8 @@ ExampleScene example_material_demo(const std::string& envMap)
 {
 	//create objects:
 	//---------------
-	std::shared_ptr<const fr::Mesh> planeMesh = fr::Mesh::from_unit_square();
-	std::shared_ptr<const fr::Mesh> sphereMesh = fr::Mesh::from_unit_sphere(2, true);
+	std::shared_ptr<const fr::Shape> planeShape = std::make_shared<fr::ShapeRectangle>();
+	std::shared_ptr<const fr::Shape> sphereShape = std::make_shared<fr::ShapeSphere>();
 
 	std::shared_ptr<fr::Texture<vec3>> whiteColorTex = std::make_shared<fr::TextureConstant<vec3>>(vec3(1.0f));
 	std::shared_ptr<fr::Texture<vec3>> redColorTex = std::make_shared<fr::TextureConstant<vec3>>(vec3(1.0f, 0.0f, 0.0f));
@@ -42,19 +44,19 @@ ExampleScene example_material_demo(const std::string& envMap)
 	std::shared_ptr<const fr::Material> mirrorMat = std::make_shared<fr::MaterialMirror>("", whiteColorTex);
 	std::shared_ptr<const fr::Material> plasticMat = std::make_shared<fr::MaterialPlastic>("", redColorTex, yellowColorTex, plasticSphereRoughnessTex);
 
-	std::shared_ptr<const fr::Object> planeObj = std::make_shared<fr::Object>(planeMesh, planeMat);
+	std::shared_ptr<const fr::Object> planeObj = std::make_shared<fr::Object>(planeShape, planeMat);
 	mat4 planeTransform = translate(vec3(0.0f, -1.0f, 0.0f)) * scale(vec3(20.0f, 1.0f, 7.5f));
 
-	std::shared_ptr<const fr::Object> goldSphereObj = std::make_shared<fr::Object>(sphereMesh, goldMat);
+	std::shared_ptr<const fr::Object> goldSphereObj = std::make_shared<fr::Object>(sphereShape, goldMat);
 	mat4 goldSphereTransform = translate(vec3(-0.65f, -0.5f, 0.0f)) * scale(vec3(0.5f, 0.5f, 0.5f));
 
-	std::shared_ptr<const fr::Object> glassSphereObj = std::make_shared<fr::Object>(sphereMesh, glassMat);
+	std::shared_ptr<const fr::Object> glassSphereObj = std::make_shared<fr::Object>(sphereShape, glassMat);
 	mat4 glassSphereTransform = translate(vec3(0.65f, -0.5f, 0.0f)) * scale(vec3(0.5f, 0.5f, 0.5f));
 
-	std::shared_ptr<const fr::Object> mirrorSphereObj = std::make_shared<fr::Object>(sphereMesh, mirrorMat);
+	std::shared_ptr<const fr::Object> mirrorSphereObj = std::make_shared<fr::Object>(sphereShape, mirrorMat);
 	mat4 mirrorSphereTransform = translate(vec3(-1.95f, -0.5f, 0.0f)) * scale(vec3(0.5f, 0.5f, 0.5f));
 
-	std::shared_ptr<const fr::Object> plasticSphereObj = std::make_shared<fr::Object>(sphereMesh, plasticMat);
+	std::shared_ptr<const fr::Object> plasticSphereObj = std::make_shared<fr::Object>(sphereShape, plasticMat);
 	mat4 plasticSphereTransform = translate(vec3(1.95f, -0.5f, 0.0f)) * scale(vec3(0.5f, 0.5f, 0.5f));
 
 	std::vector<fr::ObjectReference> objects = {
@@ -18,7 +18,8 @@ ExampleScene example_san_miguel()
 	//---------------
 	std::shared_ptr<const fr::Object> sanMiguelObj = fr::Object::from_obj(
 		"assets/models/san-miguel/san-miguel-low-poly.obj",
-		"assets/models/san-miguel/san-miguel-low-poly.mtl"
+		"assets/models/san-miguel/san-miguel-low-poly.mtl",
+		true, fr::MESH_ACCELERATOR_KD_TREE, fr::VERTEX_FORMAT_COMPACT
 	);
 	mat4 sanMiguelTransform = mat4_identity();
 
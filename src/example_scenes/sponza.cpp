@@ -40,7 +40,7 @@ ExampleScene example_sponza()
 
 	const vec3 bunnyColors[3] = {vec3(1.0f, 0.1f, 0.1f), vec3(0.1f, 1.0f, 0.1f), vec3(0.1f, 0.1f, 1.0f)};
 	const float bunnyPositions[3] = {0.0f, -40.0f, -80.0f};
-	std::shared_ptr<const fr::Mesh> bunnyMesh = fr::Mesh::from_obj("assets/models/bunny.obj")[0];
+	std::shared_ptr<const fr::Mesh> bunnyMesh = fr::Mesh::from_obj("assets/models/bunny.obj")[0].mesh;
 
 	mat4 bunnyTransformBase = rotate(vec3(0.0f, 1.0f, 0.0f), 90.0f) * scale(vec3(10.0f));
 
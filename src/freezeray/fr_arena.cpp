@@ -0,0 +1,179 @@
+#include "freezeray/fr_arena.hpp"
+
+#include "freezeray/fr_globals.hpp"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include <new>
+#include <iostream>
+
+#if defined(_WIN32)
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+#endif
+
+//-------------------------------------------//
+
+#define FR_ARENA_HUGE_PAGE_SIZE (2ull << 20)
+#define FR_ARENA_REGION_SIZE (64ull << 20) //larger allocations get a region of their own
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+struct GeometryArenaRegion
+{
+	uint8_t* base;
+	size_t size;
+	size_t used;
+	uint32_t numAllocs;
+};
+
+struct GeometryArenaState
+{
+	std::mutex mutex;
+	std::vector<GeometryArenaRegion> regions; //the last one is allocated from
+	bool hugePages = true;
+};
+
+//function local so meshes built during static initialization (e.g. the unit meshes) can already allocate. never destroyed,
+//since static meshes constructed before it would otherwise be freed into a destroyed arena at exit
+static GeometryArenaState& get_state()
+{
+	static GeometryArenaState* state = new GeometryArenaState();
+	return *state;
+}
+
+static size_t round_up(size_t size, size_t multiple)
+{
+	return (size + multiple - 1) / multiple * multiple;
+}
+
+static void* map_region(size_t size, bool hugePages)
+{
+#if defined(_WIN32)
+	//large pages need the "lock pages in memory" privilege, fall back to regular pages without it:
+	//---------------
+	size_t largePageSize = GetLargePageMinimum();
+	if(hugePages && largePageSize > 0 && size % largePageSize == 0)
+	{
+		void* base = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if(base != nullptr)
+			return base;
+	}
+
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	//over-map so the region can be trimmed to a huge page boundary:
+	//---------------
+	size_t mappedSize = size + FR_ARENA_HUGE_PAGE_SIZE;
+	uint8_t* mapped = (uint8_t*)mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mapped == MAP_FAILED)
+		return nullptr;
+
+	uint8_t* base = (uint8_t*)round_up((size_t)mapped, FR_ARENA_HUGE_PAGE_SIZE);
+	size_t head = base - mapped;
+	if(head > 0)
+		munmap(mapped, head);
+	if(FR_ARENA_HUGE_PAGE_SIZE - head > 0)
+		munmap(base + size, FR_ARENA_HUGE_PAGE_SIZE - head);
+
+	//only a hint, the kernel backs the region with regular pages if transparent huge pages are disabled:
+	//---------------
+#if defined(MADV_HUGEPAGE)
+	if(hugePages)
+		madvise(base, size, MADV_HUGEPAGE);
+#endif
+
+	return base;
+#endif
+}
+
+static void unmap_region(void* base, size_t size)
+{
+#if defined(_WIN32)
+	VirtualFree(base, 0, MEM_RELEASE);
+#else
+	munmap(base, size);
+#endif
+}
+
+//-------------------------------------------//
+
+void* GeometryArena::allocate(size_t size)
+{
+	GeometryArenaState& state = get_state();
+	std::unique_lock<std::mutex> lock(state.mutex);
+
+	size = round_up(std::max(size, (size_t)1), FR_CACHE_LINE_SIZE);
+
+	//map a new region if the current one is full:
+	//---------------
+	if(state.regions.empty() || state.regions.back().used + size > state.regions.back().size)
+	{
+		size_t regionSize = round_up(std::max(size, (size_t)FR_ARENA_REGION_SIZE), FR_ARENA_HUGE_PAGE_SIZE);
+		uint8_t* base = (uint8_t*)map_region(regionSize, state.hugePages);
+		if(base == nullptr)
+			throw std::bad_alloc();
+
+		state.regions.push_back({base, regionSize, 0, 0});
+	}
+
+	GeometryArenaRegion& region = state.regions.back();
+	void* ptr = region.base + region.used;
+	region.used += size;
+	region.numAllocs++;
+
+	return ptr;
+}
+
+void GeometryArena::free(void* ptr)
+{
+	if(ptr == nullptr)
+		return;
+
+	GeometryArenaState& state = get_state();
+	std::unique_lock<std::mutex> lock(state.mutex);
+
+	for(uint32_t i = 0; i < state.regions.size(); i++)
+	{
+		GeometryArenaRegion& region = state.regions[i];
+		if((uint8_t*)ptr < region.base || (uint8_t*)ptr >= region.base + region.size)
+			continue;
+
+		if(--region.numAllocs == 0)
+		{
+			unmap_region(region.base, region.size);
+			state.regions.erase(state.regions.begin() + i);
+		}
+
+		return;
+	}
+
+	std::cout << "ERROR: freed pointer was not allocated from the geometry arena" << std::endl;
+}
+
+void GeometryArena::set_huge_pages(bool enable)
+{
+	GeometryArenaState& state = get_state();
+	std::unique_lock<std::mutex> lock(state.mutex);
+
+	state.hugePages = enable;
+}
+
+size_t GeometryArena::get_reserved_size()
+{
+	GeometryArenaState& state = get_state();
+	std::unique_lock<std::mutex> lock(state.mutex);
+
+	size_t size = 0;
+	for(const GeometryArenaRegion& region : state.regions)
+		size += region.size;
+
+	return size;
+}
+
+}; //namespace fr
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "freezeray/fr_bvh.hpp"
+#include <algorithm>
+
+//-------------------------------------------//
+
+#define FR_BVH_NUM_BUCKETS 12
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+static float surface_area(const bound3& b)
+{
+	vec3 d = b.max - b.min;
+	return 2.0f * (d.x * d.y + d.x * d.z + d.y * d.z);
+}
+
+//-------------------------------------------//
+
+BVH::BVH(const std::vector<bound3>& primBounds, uint32_t maxPrimsPerNode, float traversalCost, float isectCost)
+{
+	//compute centroid of each primitive:
+	//---------------
+	std::vector<BuildPrim> buildPrims(primBounds.size());
+	for(uint32_t i = 0; i < primBounds.size(); i++)
+		buildPrims[i] = { i, primBounds[i], 0.5f * (primBounds[i].min + primBounds[i].max) };
+
+	//build:
+	//---------------
+	m_primIndices.reserve(primBounds.size());
+
+	if(buildPrims.size() > 0)
+		build_recursive(buildPrims, 0, (uint32_t)buildPrims.size(), 0, maxPrimsPerNode, traversalCost, isectCost);
+}
+
+bound3 BVH::get_bounds() const
+{
+	if(m_nodes.size() == 0)
+		return { vec3(INFINITY), vec3(-INFINITY) };
+
+	return m_nodes[0].bounds;
+}
+
+uint32_t BVH::build_recursive(std::vector<BuildPrim>& buildPrims, uint32_t start, uint32_t end, uint32_t depth,
+                              uint32_t maxPrimsPerNode, float traversalCost, float isectCost)
+{
+	uint32_t idx = (uint32_t)m_nodes.size();
+	m_nodes.push_back({});
+
+	//compute bounds of primitives + their centroids:
+	//---------------
+	bound3 bounds = { vec3(INFINITY), vec3(-INFINITY) };
+	bound3 centroidBounds = { vec3(INFINITY), vec3(-INFINITY) };
+
+	for(uint32_t i = start; i < end; i++)
+	{
+		bounds.min = min(bounds.min, buildPrims[i].bounds.min);
+		bounds.max = max(bounds.max, buildPrims[i].bounds.max);
+
+		centroidBounds.min = min(centroidBounds.min, buildPrims[i].centroid);
+		centroidBounds.max = max(centroidBounds.max, buildPrims[i].centroid);
+	}
+
+	m_nodes[idx].bounds = bounds;
+
+	//find split axis + bucket with SAH:
+	//---------------
+	uint32_t numPrims = end - start;
+
+	int32_t bestAxis = -1;
+	uint32_t bestBucket = 0;
+	float minCost = INFINITY;
+
+	vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+	float invTotalSA = 1.0f / surface_area(bounds);
+
+	auto get_bucket = [&](const BuildPrim& prim, uint32_t axis) -> uint32_t {
+		float offset = (prim.centroid[axis] - centroidBounds.min[axis]) / centroidExtent[axis];
+		return std::min((uint32_t)(offset * FR_BVH_NUM_BUCKETS), (uint32_t)FR_BVH_NUM_BUCKETS - 1);
+	};
+
+	for(uint32_t axis = 0; axis < 3 && numPrims > 1 && depth < FR_BVH_MAX_DEPTH; axis++)
+	{
+		if(centroidExtent[axis] <= 0.0f)
+			continue;
+
+		//sort primitives into buckets
+		struct Bucket
+		{
+			uint32_t count = 0;
+			bound3 bounds = { vec3(INFINITY), vec3(-INFINITY) };
+		} buckets[FR_BVH_NUM_BUCKETS];
+
+		for(uint32_t i = start; i < end; i++)
+		{
+			uint32_t b = get_bucket(buildPrims[i], axis);
+
+			buckets[b].count++;
+			buckets[b].bounds.min = min(buckets[b].bounds.min, buildPrims[i].bounds.min);
+			buckets[b].bounds.max = max(buckets[b].bounds.max, buildPrims[i].bounds.max);
+		}
+
+		//compute cost of splitting after each bucket, find the best
+		for(uint32_t i = 0; i < FR_BVH_NUM_BUCKETS - 1; i++)
+		{
+			bound3 belowBounds = { vec3(INFINITY), vec3(-INFINITY) };
+			bound3 aboveBounds = { vec3(INFINITY), vec3(-INFINITY) };
+			uint32_t numBelow = 0;
+			uint32_t numAbove = 0;
+
+			for(uint32_t j = 0; j <= i; j++)
+			{
+				belowBounds.min = min(belowBounds.min, buckets[j].bounds.min);
+				belowBounds.max = max(belowBounds.max, buckets[j].bounds.max);
+				numBelow += buckets[j].count;
+			}
+
+			for(uint32_t j = i + 1; j < FR_BVH_NUM_BUCKETS; j++)
+			{
+				aboveBounds.min = min(aboveBounds.min, buckets[j].bounds.min);
+				aboveBounds.max = max(aboveBounds.max, buckets[j].bounds.max);
+				numAbove += buckets[j].count;
+			}
+
+			if(numBelow == 0 || numAbove == 0)
+				continue;
+
+			float cost = traversalCost + isectCost *
+				(numBelow * surface_area(belowBounds) + numAbove * surface_area(aboveBounds)) * invTotalSA;
+			if(cost < minCost)
+			{
+				minCost = cost;
+				bestAxis = axis;
+				bestBucket = i;
+			}
+		}
+	}
+
+	//create leaf if no split was found, or if splitting isnt worth it:
+	//---------------
+	float leafCost = isectCost * (float)numPrims;
+
+	if(bestAxis == -1 || (numPrims <= maxPrimsPerNode && minCost >= leafCost))
+	{
+		m_nodes[idx].primsOffset = (uint32_t)m_primIndices.size();
+		m_nodes[idx].numPrims = numPrims;
+
+		for(uint32_t i = start; i < end; i++)
+			m_primIndices.push_back(buildPrims[i].primIdx);
+
+		return idx;
+	}
+
+	//partition primitives, recursively build:
+	//---------------
+	BuildPrim* mid = std::partition(buildPrims.data() + start, buildPrims.data() + end,
+		[&](const BuildPrim& prim) { return get_bucket(prim, bestAxis) <= bestBucket; }
+	);
+	uint32_t midIdx = (uint32_t)(mid - buildPrims.data());
+
+	build_recursive(buildPrims, start, midIdx, depth + 1, maxPrimsPerNode, traversalCost, isectCost);
+	uint32_t secondChildIdx = build_recursive(buildPrims, midIdx, end, depth + 1, maxPrimsPerNode, traversalCost, isectCost);
+
+	m_nodes[idx].secondChildIdx = secondChildIdx;
+	m_nodes[idx].numPrims = 0;
+	m_nodes[idx].axis = (uint32_t)bestAxis;
+
+	return idx;
+}
+
+}; //namespace fr
@@ -0,0 +1,164 @@
+#include "freezeray/fr_film.hpp"
+
+#include "freezeray/fr_globals.hpp"
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+
+//-------------------------------------------//
+
+#define FR_FILM_CHECKPOINT_MAGIC 0x4D465246 //"FRFM"
+#define FR_FILM_CHECKPOINT_VERSION 2        //increment whenever the layout or the renderer's sampling changes
+
+//darker pixels are held to this luminance's absolute error instead, otherwise near black pixels would never converge
+#define FR_ADAPTIVE_MIN_LUMINANCE 0.01f
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+void PixelEstimate::add_sample(const vec3& sample)
+{
+	numSamples++;
+
+	vec3 delta = sample - mean;
+	mean = mean + delta / (float)numSamples;
+	m2 = m2 + delta * (sample - mean);
+}
+
+float PixelEstimate::relative_error() const
+{
+	if(numSamples < 2)
+		return INFINITY;
+
+	vec3 variance = m2 / (float)(numSamples - 1);
+	vec3 stdError = vec3(
+		std::sqrtf(variance.r / numSamples),
+		std::sqrtf(variance.g / numSamples),
+		std::sqrtf(variance.b / numSamples)
+	);
+
+	return luminance(stdError) / std::max(luminance(mean), FR_ADAPTIVE_MIN_LUMINANCE);
+}
+
+//-------------------------------------------//
+
+Film::Film(uint32_t width, uint32_t height, uint32_t numTiles) :
+	m_width(width),
+	m_height(height),
+	m_pixels((size_t)width * height),
+	m_tileRounds(numTiles, 0)
+{
+
+}
+
+uint64_t Film::get_total_samples() const
+{
+	uint64_t total = 0;
+	for(const PixelEstimate& pixel : m_pixels)
+		total += pixel.numSamples;
+
+	return total;
+}
+
+bool Film::save(const std::string& path, uint64_t key) const
+{
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+
+	CheckpointHeader header;
+	header.magic = FR_FILM_CHECKPOINT_MAGIC;
+	header.version = FR_FILM_CHECKPOINT_VERSION;
+	header.width = m_width;
+	header.height = m_height;
+	header.numTiles = get_num_tiles();
+	header.pixelSize = (uint32_t)sizeof(PixelEstimate);
+	header.key = key;
+
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+		if(!file.is_open())
+		{
+			std::cout << "WARNING: failed to write checkpoint file \"" << tempPath.string() << "\"" << std::endl;
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(CheckpointHeader));
+		file.write(reinterpret_cast<const char*>(m_tileRounds.data()), m_tileRounds.size() * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(m_pixels.data()), m_pixels.size() * sizeof(PixelEstimate));
+
+		if(!file)
+		{
+			std::cout << "WARNING: failed to write checkpoint file \"" << tempPath.string() << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if(error)
+	{
+		std::cout << "WARNING: failed to replace checkpoint file \"" << path << "\"" << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	return true;
+}
+
+bool Film::load(const std::string& path, uint64_t key)
+{
+	std::ifstream file(path, std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	//validate header:
+	//---------------
+	CheckpointHeader header;
+	if(!file.read(reinterpret_cast<char*>(&header), sizeof(CheckpointHeader)))
+		return false;
+
+	if(header.magic != FR_FILM_CHECKPOINT_MAGIC || header.version != FR_FILM_CHECKPOINT_VERSION || header.pixelSize != sizeof(PixelEstimate))
+		return false;
+
+	if(header.width != m_width || header.height != m_height || header.numTiles != get_num_tiles())
+	{
+		std::cout << "WARNING: checkpoint \"" << path << "\" was taken at " << header.width << "x" << header.height << ", ignoring" << std::endl;
+		return false;
+	}
+
+	if(header.key != key)
+	{
+		std::cout << "WARNING: checkpoint \"" << path << "\" was taken with a different scene, camera or sampling settings, ignoring" << std::endl;
+		return false;
+	}
+
+	//read data, only replacing ours once everything was read:
+	//---------------
+	std::vector<uint32_t> tileRounds(header.numTiles);
+	std::vector<PixelEstimate> pixels((size_t)header.width * header.height);
+
+	if(!file.read(reinterpret_cast<char*>(tileRounds.data()), tileRounds.size() * sizeof(uint32_t)) ||
+	   !file.read(reinterpret_cast<char*>(pixels.data()), pixels.size() * sizeof(PixelEstimate)))
+		return false;
+
+	for(const PixelEstimate& pixel : pixels)
+	{
+		if(!std::isfinite(pixel.mean.r) || !std::isfinite(pixel.mean.g) || !std::isfinite(pixel.mean.b) ||
+		   !std::isfinite(pixel.m2.r) || !std::isfinite(pixel.m2.g) || !std::isfinite(pixel.m2.b))
+		{
+			std::cout << "WARNING: checkpoint \"" << path << "\" contains non-finite pixels, ignoring" << std::endl;
+			return false;
+		}
+	}
+
+	m_tileRounds = std::move(tileRounds);
+	m_pixels = std::move(pixels);
+
+	return true;
+}
+
+}; //namespace fr
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "freezeray/fr_kernels.hpp"
+
+#include "freezeray/fr_log.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif
+
+//-------------------------------------------//
+
+#define FR_CPUID_1_ECX_SSE42   (1 << 20)
+#define FR_CPUID_1_ECX_OSXSAVE (1 << 27)
+#define FR_CPUID_1_ECX_AVX     (1 << 28)
+
+#define FR_CPUID_7_EBX_AVX2    (1 << 5)
+#define FR_CPUID_7_EBX_AVX512F (1 << 16)
+
+#define FR_XCR0_YMM_STATE 0x06 //SSE + AVX state
+#define FR_XCR0_ZMM_STATE 0xE6 //SSE + AVX + opmask + upper ZMM state
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t xgetbv()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static SIMDlevel detect_simd_level()
+{
+	//query cpu features:
+	//---------------
+	uint32_t regs[4];
+	cpuid(0, 0, regs);
+	uint32_t maxLeaf = regs[0];
+
+	cpuid(1, 0, regs);
+	bool sse42 = (regs[2] & FR_CPUID_1_ECX_SSE42) != 0;
+	bool avx = (regs[2] & FR_CPUID_1_ECX_AVX) != 0;
+	bool osxsave = (regs[2] & FR_CPUID_1_ECX_OSXSAVE) != 0;
+
+	bool avx2 = false;
+	bool avx512 = false;
+	if(maxLeaf >= 7)
+	{
+		cpuid(7, 0, regs);
+		avx2 = (regs[1] & FR_CPUID_7_EBX_AVX2) != 0;
+		avx512 = (regs[1] & FR_CPUID_7_EBX_AVX512F) != 0;
+	}
+
+	//the sse4 kernels are the fallback, there is nothing to run below them:
+	//---------------
+	if(!sse42)
+		throw std::runtime_error("freezeray requires a cpu with SSE4.2 support");
+
+	//the os must also save the wider registers on context switches:
+	//---------------
+	uint64_t xcr0 = osxsave ? xgetbv() : 0;
+	bool osYmm = (xcr0 & FR_XCR0_YMM_STATE) == FR_XCR0_YMM_STATE;
+	bool osZmm = (xcr0 & FR_XCR0_ZMM_STATE) == FR_XCR0_ZMM_STATE;
+
+	if(!avx || !avx2 || !osYmm)
+		return SIMD_LEVEL_SSE4;
+
+	if(!avx512 || !osZmm)
+		return SIMD_LEVEL_AVX2;
+
+	return SIMD_LEVEL_AVX512;
+}
+
+static std::string detect_cpu_name()
+{
+	//the brand string is spread over 3 extended leaves, 16 bytes each:
+	//---------------
+	uint32_t regs[4];
+	cpuid(0x80000000, 0, regs);
+	if(regs[0] < 0x80000004)
+		return "unknown";
+
+	char brand[49] = {};
+	for(uint32_t i = 0; i < 3; i++)
+	{
+		cpuid(0x80000002 + i, 0, regs);
+		memcpy(brand + i * 16, regs, 16);
+	}
+
+	//trim padding:
+	//---------------
+	std::string name = brand;
+	name.erase(0, name.find_first_not_of(' '));
+	name.erase(name.find_last_not_of(' ') + 1);
+
+	return name.empty() ? "unknown" : name;
+}
+
+//-------------------------------------------//
+
+SIMDlevel get_simd_level()
+{
+	static const SIMDlevel level = []() {
+		SIMDlevel detected = detect_simd_level();
+
+		//allow lowering the level for testing, never raise it above what the cpu supports
+		const char* requested = getenv("FR_SIMD_LEVEL");
+		if(requested == nullptr)
+			return detected;
+
+		if(strcmp(requested, "sse4") == 0)
+			return SIMD_LEVEL_SSE4;
+		else if(strcmp(requested, "avx2") == 0)
+			return std::min(detected, SIMD_LEVEL_AVX2);
+		else if(strcmp(requested, "avx512") == 0)
+			return std::min(detected, SIMD_LEVEL_AVX512);
+
+		std::cout << "WARNING: unknown FR_SIMD_LEVEL \"" << requested << "\", ignoring" << std::endl;
+		return detected;
+	}();
+
+	return level;
+}
+
+const char* get_cpu_name()
+{
+	static const std::string name = detect_cpu_name();
+	return name.c_str();
+}
+
+const IntersectionKernels& get_intersection_kernels()
+{
+	static const IntersectionKernels kernels = []() {
+		IntersectionKernels result;
+		result.level = get_simd_level();
+
+		switch(result.level)
+		{
+		case SIMD_LEVEL_AVX512:
+			result.intersectTriBlocks = intersect_tri_blocks_avx512;
+			result.trisPerTest = 16;
+			result.intersectBoxes4 = intersect_boxes4_sse4;
+			result.intersectBoxes8 = intersect_boxes8_avx2;
+			log_verbose("using AVX-512 intersection kernels");
+			break;
+		case SIMD_LEVEL_AVX2:
+			result.intersectTriBlocks = intersect_tri_blocks_avx2;
+			result.trisPerTest = 8;
+			result.intersectBoxes4 = intersect_boxes4_sse4;
+			result.intersectBoxes8 = intersect_boxes8_avx2;
+			log_verbose("using AVX2 intersection kernels");
+			break;
+		default:
+			result.intersectTriBlocks = intersect_tri_blocks_sse4;
+			result.trisPerTest = 8;
+			result.intersectBoxes4 = intersect_boxes4_sse4;
+			result.intersectBoxes8 = intersect_boxes8_sse4;
+			log_verbose("using SSE4 intersection kernels");
+			break;
+		}
+
+		return result;
+	}();
+
+	return kernels;
+}
+
+}; //namespace fr
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "freezeray/fr_log.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <iostream>
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+struct LogState
+{
+	std::atomic<bool> verbose = false;
+	std::mutex mutex;
+};
+
+//function local so meshes built during static initialization (e.g. the unit meshes) can already log
+static LogState& get_state()
+{
+	static LogState state;
+	return state;
+}
+
+//-------------------------------------------//
+
+void set_verbose(bool verbose)
+{
+	get_state().verbose.store(verbose, std::memory_order_relaxed);
+}
+
+bool is_verbose()
+{
+	return get_state().verbose.load(std::memory_order_relaxed);
+}
+
+void log_line(const std::string& line)
+{
+	LogState& state = get_state();
+	std::unique_lock<std::mutex> lock(state.mutex);
+
+	std::cout << line << std::endl;
+}
+
+}; //namespace fr
\ No newline at end of file
@@ -3,36 +3,369 @@
 #define QOBJ_IMPLEMENTATION
 #include "freezeray/quickobj.h"
 #include "freezeray/fr_globals.hpp"
+#include "freezeray/fr_arena.hpp"
+#include "freezeray/fr_log.hpp"
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <random>
 
 //-------------------------------------------//
 
-#define FR_MESH_KDTREE_MAX_TRIS_PER_NODE 16
-#define FR_MESH_KDTREE_TRAVERSAL_COST 1
-#define FR_MESH_KDTREE_ISECT_COST 2
+//default costs, see calibrate_kdtree_costs()
+#define FR_MESH_KDTREE_TRAVERSAL_COST 1.0f
+#define FR_MESH_KDTREE_ISECT_COST 2.0f
 #define FR_MESH_KDTREE_EMPTY_BONUS 0.5f
 
+#define FR_MESH_KDTREE_CALIBRATION_DEPTH 16 //levels of the synthetic tree, 2^depth leaves
+#define FR_MESH_KDTREE_CALIBRATION_BLOCKS 4096
+#define FR_MESH_KDTREE_CALIBRATION_RAYS (1 << 16)
+#define FR_MESH_KDTREE_CALIBRATION_RUNS 5 //the fastest run is used
+#define FR_MESH_KDTREE_COSTS_FILE_PREFIX "costs_"
+
+#define FR_MESH_KDTREE_PARALLEL_MIN_TRIS 4096
+
+#define FR_MESH_KDTREE_PAIRS_PER_LINE (FR_CACHE_LINE_SIZE / (2 * sizeof(KDtreeNode)))
+
+#define FR_MESH_KDTREE_SIDE_BELOW 1
+#define FR_MESH_KDTREE_SIDE_ABOVE 2
+#define FR_MESH_KDTREE_SIDE_CLIPPED 4
+
+#define FR_MESH_KDTREE_CLIP_EPSILON 1e-5f //relative to the coordinates' magnitude, keeps clipping conservative
+
+#define FR_MESH_KDTREE_EARLY_SPLIT_RATIO 16.0f //max box surface area per unit of (two-sided) triangle area
+#define FR_MESH_KDTREE_EARLY_SPLIT_MAX_DEPTH 0 //each triangle is split into at most 2^depth references, 0 disables
+
+#define FR_MESH_KDTREE_CACHE_MAGIC 0x444B5246 //"FRKD"
+#define FR_MESH_KDTREE_CACHE_VERSION 4        //increment whenever the build or node layout changes
+
+#define FR_MESH_KERNEL_CHUNK_BLOCKS 8
+
+#define FR_MESH_DEDUP_TOLERANCE 1e-6f   //max position error of a translated duplicate, relative to the mesh's extent or coordinates
+#define FR_MESH_DEDUP_MAX_CANDIDATES 16 //meshes with the same hash that a group is compared against
+
+#define FR_MESH_BVH_MAX_TRIS_PER_LEAF 8
+#define FR_MESH_BVH_MAX_DEPTH 64
+#define FR_MESH_BVH_NUM_BUCKETS 16
+#define FR_MESH_BVH_TRAVERSAL_COST 1.0f
+#define FR_MESH_BVH_ISECT_COST 0.5f
+
 //-------------------------------------------//
 
 namespace fr
 {
 
+std::string Mesh::m_kdTreeCacheDir = "";
 std::unordered_map<std::pair<uint32_t, bool>, std::shared_ptr<const Mesh>, Mesh::HashPair> Mesh::m_unitSpheres = {};
 std::shared_ptr<const Mesh> Mesh::m_unitCube = Mesh::gen_unit_cube();
 std::shared_ptr<const Mesh> Mesh::m_unitSquare = Mesh::gen_unit_square();
+bool Mesh::m_lazyBuild = false;
+
+//-------------------------------------------//
+
+//round to nearest even, values too large for a half become infinity
+static uint16_t float_to_half(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(float));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exp = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if(exp >= 31)
+		return (uint16_t)(sign | 0x7C00);
+
+	//denormal, the implicit 1 is shifted into the mantissa:
+	//---------------
+	if(exp <= 0)
+	{
+		if(exp < -10)
+			return (uint16_t)sign;
+
+		mantissa |= 0x800000;
+		uint32_t shift = (uint32_t)(14 - exp);
+		uint32_t half = mantissa >> shift;
+		uint32_t rem = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if(rem > halfway || (rem == halfway && (half & 1) != 0))
+			half++;
+
+		return (uint16_t)(sign | half);
+	}
+
+	//normal, a carry out of the mantissa correctly bumps the exponent:
+	//---------------
+	uint32_t half = sign | ((uint32_t)exp << 10) | (mantissa >> 13);
+	uint32_t rem = mantissa & 0x1FFF;
+	if(rem > 0x1000 || (rem == 0x1000 && (half & 1) != 0))
+		half++;
+
+	return (uint16_t)half;
+}
+
+static float half_to_float(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+
+	if(exp == 0)
+	{
+		float denormal = (float)mantissa * (1.0f / 16777216.0f); //mantissa * 2^-24
+		return sign != 0 ? -denormal : denormal;
+	}
+
+	uint32_t bits;
+	if(exp == 0x1F)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else
+		bits = sign | ((exp + 127 - 15) << 23) | (mantissa << 13);
+
+	float f;
+	memcpy(&f, &bits, sizeof(float));
+	return f;
+}
+
+//projects the direction onto an octahedron, then unfolds the lower half over the upper. a zero vector decodes to +z
+static uint32_t octahedral_encode(const vec3& n)
+{
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if(l1 == 0.0f)
+		return 0;
+
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if(n.z < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	int16_t qx = (int16_t)roundf(std::clamp(x, -1.0f, 1.0f) * 32767.0f);
+	int16_t qy = (int16_t)roundf(std::clamp(y, -1.0f, 1.0f) * 32767.0f);
+	return (uint32_t)(uint16_t)qx | ((uint32_t)(uint16_t)qy << 16);
+}
+
+static vec3 octahedral_decode(uint32_t encoded)
+{
+	float x = (float)(int16_t)(encoded & 0xFFFF) / 32767.0f;
+	float y = (float)(int16_t)(encoded >> 16) / 32767.0f;
+
+	vec3 n = vec3(x, y, 1.0f - fabsf(x) - fabsf(y));
+	if(n.z < 0.0f)
+	{
+		n.x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	return normalize(n);
+}
+
+//-------------------------------------------//
+
+//hashes everything about an obj group that a translation leaves unchanged, so translated copies land in the same bucket
+static uint64_t obj_mesh_hash(const QOBJmesh& mesh, const void* alphaMask)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	auto hash_word = [&](uint32_t word) {
+		hash ^= word;
+		hash *= 0x100000001B3ull;
+	};
+
+	uint64_t maskAddr = (uint64_t)(uintptr_t)alphaMask;
+	hash_word((uint32_t)maskAddr);
+	hash_word((uint32_t)(maskAddr >> 32));
+
+	hash_word(mesh.vertexAttribs);
+	hash_word(mesh.vertexStride);
+	hash_word(mesh.vertexPosOffset);
+	hash_word(mesh.numVertices);
+	hash_word(mesh.numIndices);
+	for(uint32_t i = 0; i < mesh.numIndices; i++)
+		hash_word(mesh.indices[i]);
+
+	//uvs + normals:
+	//---------------
+	for(uint32_t i = 0; i < mesh.numVertices; i++)
+	for(uint32_t j = 0; j < mesh.vertexStride; j++)
+	{
+		if(j >= mesh.vertexPosOffset && j < mesh.vertexPosOffset + 3)
+			continue;
+
+		uint32_t word;
+		memcpy(&word, &mesh.vertices[i * mesh.vertexStride + j], sizeof(float));
+		hash_word(word);
+	}
+
+	return hash;
+}
+
+static bound3 obj_mesh_bounds(const QOBJmesh& mesh)
+{
+	bound3 bounds = {vec3(INFINITY), vec3(-INFINITY)};
+	for(uint32_t i = 0; i < mesh.numVertices; i++)
+	{
+		const float* pos = &mesh.vertices[i * mesh.vertexStride + mesh.vertexPosOffset];
+		bounds.min = min(bounds.min, vec3(pos[0], pos[1], pos[2]));
+		bounds.max = max(bounds.max, vec3(pos[0], pos[1], pos[2]));
+	}
+
+	return bounds;
+}
+
+//positions can't be expected to match any closer than the rounding error of their coordinates
+static float obj_mesh_tolerance(const bound3& bounds)
+{
+	float scale = 0.0f;
+	for(uint32_t i = 0; i < 3; i++)
+	{
+		scale = std::max(scale, bounds.max[i] - bounds.min[i]);
+		scale = std::max(scale, std::max(fabsf(bounds.min[i]), fabsf(bounds.max[i])));
+	}
+
+	return scale * FR_MESH_DEDUP_TOLERANCE;
+}
+
+//whether b is a translated by offset, with every other attribute identical
+static bool obj_mesh_matches(const QOBJmesh& a, const QOBJmesh& b, const vec3& offset, float tolerance)
+{
+	if(a.vertexAttribs != b.vertexAttribs || a.vertexStride != b.vertexStride || a.vertexPosOffset != b.vertexPosOffset ||
+	   a.vertexNormalOffset != b.vertexNormalOffset || a.vertexTexCoordOffset != b.vertexTexCoordOffset ||
+	   a.numVertices != b.numVertices || a.numIndices != b.numIndices)
+		return false;
+
+	if(memcmp(a.indices, b.indices, a.numIndices * sizeof(uint32_t)) != 0)
+		return false;
+
+	for(uint32_t i = 0; i < a.numVertices; i++)
+	for(uint32_t j = 0; j < a.vertexStride; j++)
+	{
+		const float& valA = a.vertices[i * a.vertexStride + j];
+		const float& valB = b.vertices[i * b.vertexStride + j];
+
+		if(j >= a.vertexPosOffset && j < a.vertexPosOffset + 3)
+		{
+			if(fabsf(valA + offset[j - a.vertexPosOffset] - valB) > tolerance)
+				return false;
+		}
+		else if(memcmp(&valA, &valB, sizeof(float)) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+//concatenates groups with the same material and vertex layout into a single mesh
+static std::shared_ptr<const Mesh> mesh_from_obj_groups(const QOBJmesh* meshes, const std::vector<uint32_t>& groups, MeshAccelerator accelerator,
+                                                        const std::shared_ptr<const Texture<float>>& alphaMask, VertexFormat vertexFormat)
+{
+	const QOBJmesh& first = meshes[groups[0]];
+
+	uint32_t numVertices = 0;
+	uint32_t numIndices = 0;
+	for(uint32_t i = 0; i < groups.size(); i++)
+	{
+		numVertices += meshes[groups[i]].numVertices;
+		numIndices += meshes[groups[i]].numIndices;
+	}
+
+	//unfortuntaely we need to copy the data returned by qobj since we need unique_ptrs - TODO: fix this!!
+	//(we cant use a custom deleter since we have 2 separate unique_ptrs)
+	std::unique_ptr<uint32_t[]> indices = std::unique_ptr<uint32_t[]>(new uint32_t[numIndices]);
+	std::unique_ptr<float[]> verts = std::unique_ptr<float[]>(new float[numVertices * first.vertexStride]);
+
+	//qobj only dedups vertices within a group, so vertices on the seams between groups are merged here:
+	//---------------
+	size_t vertexSize = first.vertexStride * sizeof(float);
+	std::unordered_multimap<uint64_t, uint32_t> vertexMap;
+	vertexMap.reserve(numVertices);
+
+	uint32_t vertexOffset = 0;
+	uint32_t indexOffset = 0;
+	std::vector<uint32_t> remap;
+	for(uint32_t i = 0; i < groups.size(); i++)
+	{
+		const QOBJmesh& mesh = meshes[groups[i]];
+
+		remap.resize(mesh.numVertices);
+		for(uint32_t j = 0; j < mesh.numVertices; j++)
+		{
+			const float* vertex = &mesh.vertices[j * first.vertexStride];
+
+			//64-bit FNV-1a over the vertex's bytes, only bitwise identical vertices are merged:
+			uint64_t hash = 0xCBF29CE484222325ull;
+			for(size_t k = 0; k < vertexSize; k++)
+			{
+				hash ^= ((const uint8_t*)vertex)[k];
+				hash *= 0x100000001B3ull;
+			}
+
+			uint32_t idx = UINT32_MAX;
+			auto range = vertexMap.equal_range(hash);
+			for(auto it = range.first; it != range.second; it++)
+			{
+				if(memcmp(&verts[it->second * first.vertexStride], vertex, vertexSize) == 0)
+				{
+					idx = it->second;
+					break;
+				}
+			}
+
+			if(idx == UINT32_MAX)
+			{
+				idx = vertexOffset++;
+				memcpy(&verts[idx * first.vertexStride], vertex, vertexSize);
+				vertexMap.insert({hash, idx});
+			}
+
+			remap[j] = idx;
+		}
+
+		for(uint32_t j = 0; j < mesh.numIndices; j++)
+			indices[indexOffset + j] = remap[mesh.indices[j]];
+
+		indexOffset += mesh.numIndices;
+	}
+
+	uint32_t attribs = 0;
+	if(first.vertexAttribs & QOBJ_VERTEX_ATTRIB_POSITION)
+		attribs |= VERTEX_ATTRIB_POSITION;
+	if(first.vertexAttribs & QOBJ_VERTEX_ATTRIB_TEX_COORDS)
+		attribs |= VERTEX_ATTRIB_UV;
+	if(first.vertexAttribs & QOBJ_VERTEX_ATTRIB_NORMAL)
+		attribs |= VERTEX_ATTRIB_NORMAL;
+
+	return std::make_shared<Mesh>(attribs, numIndices / 3, std::move(indices), std::move(verts), first.material, 
+	                              first.vertexStride, first.vertexPosOffset, first.vertexTexCoordOffset, first.vertexNormalOffset, 
+	                              accelerator, alphaMask, vertexFormat);
+}
 
 //-------------------------------------------//
 
 Mesh::Mesh(uint32_t vertexAttribs, uint32_t numFaces, std::unique_ptr<uint32_t[]> faceIndices, 
            std::unique_ptr<uint32_t[]> vertIndices, std::unique_ptr<float[]> verts, std::string material,
-           uint32_t vertStride, uint32_t vertPosOffset, uint32_t vertUvOffset, uint32_t vertNormalOffset) :
+           uint32_t vertStride, uint32_t vertPosOffset, uint32_t vertUvOffset, uint32_t vertNormalOffset, MeshAccelerator accelerator,
+           std::shared_ptr<const Texture<float>> alphaMask, VertexFormat vertexFormat) :
 	m_verts(std::move(verts)),
 	m_material(material),
 	m_vertAttribs(vertexAttribs),
 	m_vertStride(vertStride),
 	m_vertPosOffset(vertPosOffset),
 	m_vertUvOffset(vertUvOffset),
-	m_vertNormalOffset(vertNormalOffset)
+	m_vertNormalOffset(vertNormalOffset),
+	m_vertFormat(VERTEX_FORMAT_FLOAT),
+	m_alphaMask(alphaMask),
+	m_builtVertFormat(vertexFormat),
+	m_accelerator(accelerator)
 {
 	//triangulate faces:
 	//---------------
@@ -58,15 +391,16 @@ Mesh::Mesh(uint32_t vertexAttribs, uint32_t numFaces, std::unique_ptr<uint32_t[]
 		k += faceIndices[i];
 	}
 
-	//setup strides and offsets, build kd tree:
+	//setup strides and offsets, build acceleration structure:
 	//---------------
 	vert_attribs_setup();
-	kdtree_build();
+	build_or_defer();
 }
 
 Mesh::Mesh(uint32_t vertexAttribs, uint32_t numTris, std::unique_ptr<uint32_t[]> indices, 
            std::unique_ptr<float[]> verts, std::string material, uint32_t vertStride,
-           uint32_t vertPosOffset, uint32_t vertUvOffset, uint32_t vertNormalOffset) :
+           uint32_t vertPosOffset, uint32_t vertUvOffset, uint32_t vertNormalOffset, MeshAccelerator accelerator,
+           std::shared_ptr<const Texture<float>> alphaMask, VertexFormat vertexFormat) :
 	m_numTris(numTris),
 	m_indices(std::move(indices)),
 	m_verts(std::move(verts)),
@@ -75,10 +409,42 @@ Mesh::Mesh(uint32_t vertexAttribs, uint32_t numTris, std::unique_ptr<uint32_t[]>
 	m_vertStride(vertStride),
 	m_vertPosOffset(vertPosOffset),
 	m_vertUvOffset(vertUvOffset),
-	m_vertNormalOffset(vertNormalOffset)
+	m_vertNormalOffset(vertNormalOffset),
+	m_vertFormat(VERTEX_FORMAT_FLOAT),
+	m_alphaMask(alphaMask),
+	m_builtVertFormat(vertexFormat),
+	m_accelerator(accelerator)
 {
 	vert_attribs_setup();
-	kdtree_build();
+	build_or_defer();
+}
+
+Mesh::~Mesh()
+{
+	GeometryArena::free(m_arenaData);
+}
+
+void Mesh::set_lazy_build(bool lazy)
+{
+	m_lazyBuild = lazy;
+}
+
+void Mesh::set_kdtree_cache_dir(const std::string& dir)
+{
+	m_kdTreeCacheDir = dir;
+}
+
+void Mesh::set_kdtree_costs(const KDtreeCosts& costs)
+{
+	if(costs.maxTrisPerLeaf == 0)
+		throw std::invalid_argument("kd tree leaves must be allowed at least 1 triangle");
+
+	kdtree_costs() = costs;
+}
+
+Mesh::KDtreeCosts Mesh::get_kdtree_costs()
+{
+	return kdtree_costs();
 }
 
 const std::string& Mesh::get_material() const
@@ -103,40 +469,79 @@ uint32_t Mesh::get_num_tris() const
 
 bound3 Mesh::get_bounds() const
 {
-	return m_kdTreeBounds;
+	return m_bounds;
 }
 
 void Mesh::get_tri_indices(uint32_t triIdx, uint32_t& idx0, uint32_t& idx1, uint32_t& idx2) const
 {
-	triIdx *= 3;
-
-	idx0 = m_indices[triIdx + 0];
-	idx1 = m_indices[triIdx + 1];
-	idx2 = m_indices[triIdx + 2];
+	ensure_built();
+	tri_indices_at(triIdx, idx0, idx1, idx2);
 }
 
 vec3 Mesh::get_vert_pos_at(uint32_t idx) const
 {
-	return *reinterpret_cast<const vec3*>(&m_verts.get()[idx * m_vertStride + m_vertPosOffset]);
+	ensure_built();
+	return vert_pos_at(idx);
 }
 
 vec2 Mesh::get_vert_uv_at(uint32_t idx) const
+{
+	ensure_built();
+	return vert_uv_at(idx);
+}
+
+vec3 Mesh::get_vert_normal_at(uint32_t idx) const
+{
+	ensure_built();
+	return vert_normal_at(idx);
+}
+
+//-------------------------------------------//
+
+void Mesh::tri_indices_at(uint32_t triIdx, uint32_t& idx0, uint32_t& idx1, uint32_t& idx2) const
+{
+	triIdx *= 3;
+
+	idx0 = m_indexView[triIdx + 0];
+	idx1 = m_indexView[triIdx + 1];
+	idx2 = m_indexView[triIdx + 2];
+}
+
+vec3 Mesh::vert_pos_at(uint32_t idx) const
+{
+	if(m_vertFormat == VERTEX_FORMAT_COMPACT)
+	{
+		const uint16_t* pos = m_compactVertView[idx].pos;
+		return m_vertPosMin + m_vertPosScale * vec3((float)pos[0], (float)pos[1], (float)pos[2]);
+	}
+
+	return *reinterpret_cast<const vec3*>(&m_vertView[idx * m_vertStride + m_vertPosOffset]);
+}
+
+vec2 Mesh::vert_uv_at(uint32_t idx) const
 {
 	if((m_vertAttribs & VERTEX_ATTRIB_UV) == 0)
 		return vec2(0.0f);
+
+	if(m_vertFormat == VERTEX_FORMAT_COMPACT)
+		return vec2(half_to_float(m_compactVertView[idx].uv[0]), half_to_float(m_compactVertView[idx].uv[1]));
 	
-	return *reinterpret_cast<const vec2*>(&m_verts.get()[idx * m_vertStride + m_vertUvOffset]);
+	return *reinterpret_cast<const vec2*>(&m_vertView[idx * m_vertStride + m_vertUvOffset]);
 }
 
-vec3 Mesh::get_vert_normal_at(uint32_t idx) const
+vec3 Mesh::vert_normal_at(uint32_t idx) const
 {
 	if((m_vertAttribs & VERTEX_ATTRIB_NORMAL) == 0)
 		return vec3(0.0f);
+
+	if(m_vertFormat == VERTEX_FORMAT_COMPACT)
+		return octahedral_decode(m_compactVertView[idx].normal);
 	
-	return *reinterpret_cast<const vec3*>(&m_verts.get()[idx * m_vertStride + m_vertNormalOffset]);
+	return *reinterpret_cast<const vec3*>(&m_vertView[idx * m_vertStride + m_vertNormalOffset]);
 }
 
-bool Mesh::intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alphaMask, float& tMin, vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs) const
+template<typename F>
+bool Mesh::kdtree_traverse(const Ray& ray, float& tMax, F&& intersectLeaf) const
 {
 	//get ray info:
 	//---------------
@@ -146,8 +551,8 @@ bool Mesh::intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alpha
 
 	//compute intersection with bounding box:
 	//---------------
-	vec3 tMinKD3 = (m_kdTreeBounds.min - rayPos) * invRayDir;
-	vec3 tMaxKD3 = (m_kdTreeBounds.max - rayPos) * invRayDir;
+	vec3 tMinKD3 = (m_treeBounds.min - rayPos) * invRayDir;
+	vec3 tMaxKD3 = (m_treeBounds.max - rayPos) * invRayDir;
 
 	vec3 t1 = min(tMinKD3, tMaxKD3);
 	vec3 t2 = max(tMinKD3, tMaxKD3);
@@ -171,20 +576,9 @@ bool Mesh::intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alpha
 	float tMaxKD = std::min(std::min(t2.x, t2.y), t2.z);
 
 	//skip if bb wasnt hit
-	if(tMaxKD < tMinKD || tMaxKD <= 0.0f)
+	if(tMaxKD < tMinKD || tMaxKD <= 0.0f || tMinKD > tMax)
 		return false;
 
-	//declare attributes for hit triangle:
-	//---------------
-	float* verts = m_verts.get();
-	
-	bool hit = false;
-
-	tMin = INFINITY;
-	uint32_t minIdx0, minIdx1, minIdx2;
-	vec3 minV0, minV1, minV2;
-	float minB0, minB1;
-
 	//traverse kd tree in order:
 	//---------------
 	struct KDnodeToVisit
@@ -202,11 +596,11 @@ bool Mesh::intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alpha
 	while(true)
 	{
 		//early exit if intersection was already found
-		if(tMin < tMinKD)
+		if(tMax < tMinKD)
 			break;
 
 		//get node, process interior or leaf
-		const KDtreeNode* node = &m_kdTree[nodeIdx];
+		const KDtreeNode* node = &m_kdTreeView[nodeIdx];
 		if(!node->is_leaf())
 		{
 			uint32_t axis = node->get_split_axis();
@@ -218,13 +612,13 @@ bool Mesh::intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alpha
 				(rayPos[axis] == node->get_split_pos() && rayDir[axis] <= 0.0f);
 			if(belowFirst)
 			{
-				firstChild = nodeIdx + 1;
+				firstChild = node->get_below_child_idx();
 				secondChild = node->get_above_child_idx();
 			}
 			else
 			{
 				firstChild = node->get_above_child_idx();
-				secondChild = nodeIdx + 1;
+				secondChild = node->get_below_child_idx();
 			}
 
 			if(tPlane > tMaxKD || tPlane <= 0.0f)
@@ -244,12 +638,8 @@ bool Mesh::intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alpha
 		}
 		else
 		{
-			hit |= kdtree_intersect_leaf_node(
-				node, ray, alphaMask, tMin, 
-				minIdx0, minIdx1, minIdx2,
-				minV0, minV1, minV2,
-				minB0, minB1
-			);
+			if(intersectLeaf(node->get_tri_blocks_offset(), node->get_num_tris(), tMax))
+				return true;
 
 			if(toVisitPos > 0)
 			{
@@ -263,128 +653,521 @@ bool Mesh::intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alpha
 		}
 	}
 
-	//return early if not hit:
+	return false;
+}
+
+template<typename F>
+FR_TARGET_AVX2 void Mesh::kdtree_traverse8(const RayPacket8& rays, uint32_t rayMask, const bool dirIsNeg[3], float* tMax, F&& intersectLeaf) const
+{
+	//get ray info:
 	//---------------
-	if(!hit)
-		return false;
+	__m256 rayPos[3] = { rays.origin(0), rays.origin(1), rays.origin(2) };
+	__m256 invRayDir[3] = { rays.inv_direction(0), rays.inv_direction(1), rays.inv_direction(2) };
 
-	//get attributes:
+	//compute intersection with bounding box, segments are clamped to start at the ray origins:
 	//---------------
-	float b2 = 1.0f - minB0 - minB1;
+	__m256 tMinKD = _mm256_setzero_ps();
+	__m256 tMaxKD = _mm256_set1_ps(INFINITY);
 
-	const vec2 *uv0, *uv1, *uv2;
-	if((m_vertAttribs & VERTEX_ATTRIB_UV) != 0)
+	for(uint32_t axis = 0; axis < 3; axis++)
 	{
-		uv0 = reinterpret_cast<const vec2*>(&verts[minIdx0 + m_vertUvOffset]);
-		uv1 = reinterpret_cast<const vec2*>(&verts[minIdx1 + m_vertUvOffset]);
-		uv2 = reinterpret_cast<const vec2*>(&verts[minIdx2 + m_vertUvOffset]);
+		__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(m_treeBounds.min[axis]), rayPos[axis]), invRayDir[axis]);
+		__m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(m_treeBounds.max[axis]), rayPos[axis]), invRayDir[axis]);
 
-		uv = *uv0 * b2 + *uv1 * minB0 + *uv2 * minB1;
+		tMinKD = _mm256_max_ps(tMinKD, _mm256_min_ps(t1, t2));
+		tMaxKD = _mm256_min_ps(tMaxKD, _mm256_max_ps(t1, t2));
 	}
-	else
-		uv = vec2(0.0f);
 
-	vec3 geomNormal = cross(minV1 - minV0, minV2 - minV0); //geometric normal
-	if((m_vertAttribs & VERTEX_ATTRIB_NORMAL) != 0)
+	//traverse kd tree in order:
+	//---------------
+	struct KDnodeToVisit8
 	{
-		const vec3& normal0 = *reinterpret_cast<const vec3*>(&verts[minIdx0 + m_vertNormalOffset]);
-		const vec3& normal1 = *reinterpret_cast<const vec3*>(&verts[minIdx1 + m_vertNormalOffset]);
-		const vec3& normal2 = *reinterpret_cast<const vec3*>(&verts[minIdx2 + m_vertNormalOffset]);
-
-		//ensure that shaded normal is in "same hemisphere" as geom normal to avoid shading errors
-		vec3 shadingNormal = normal0 * b2 + normal1 * minB0 + normal2 * minB1;
-		if(dot(rayDir, geomNormal) * dot(rayDir, shadingNormal) <= 0.0f)
-			normal = geomNormal;
-		else
-			normal = shadingNormal;
-	}
-	else
-		normal = geomNormal;
+		uint32_t nodeIdx;
+		__m256 tMin;
+		__m256 tMax;
+	};
+	
+	const uint32_t MAX_KD_TRAVERSAL_DEPTH = 64;
+	KDnodeToVisit8 nodesToVisit[MAX_KD_TRAVERSAL_DEPTH];
+	uint32_t toVisitPos = 0;
 
-	//calculate derivatives:
-	//---------------
-	if(ray.has_differentials())
+	uint32_t nodeIdx = 0;
+	while(true)
 	{
-		vec3 p = ray.at(tMin);
+		//a ray is active in the node if its segment is nonempty and starts before its closest hit
+		__m256 activeTMax = _mm256_min_ps(tMaxKD, _mm256_loadu_ps(tMax));
+		__m256 active = _mm256_cmp_ps(tMinKD, activeTMax, _CMP_LE_OQ);
+		uint32_t activeMask = (uint32_t)_mm256_movemask_ps(active) & rayMask;
 
-		float tx;
-		float b0x, b1x;
-		intersect_triangle_no_bounds_check(ray.differential_x(), minV0, minV1, minV2, tx, b0x, b1x);
-		vec3 px = ray.differential_x().at(tx);
+		const KDtreeNode* node = &m_kdTreeView[nodeIdx];
+		if(activeMask != 0 && !node->is_leaf())
+		{
+			uint32_t axis = node->get_split_axis();
+			__m256 tPlane = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node->get_split_pos()), rayPos[axis]), invRayDir[axis]);
 
-		float ty;
-		float b0y, b1y;
-		intersect_triangle_no_bounds_check(ray.differential_y(), minV0, minV1, minV2, ty, b0y, b1y);
-		vec3 py = ray.differential_y().at(ty);
+			//all rays share a direction, so they also share the near and far child.
+			//NaN plane distances (ray starting on the plane, parallel to it) are sent to both
+			uint32_t nearChild = dirIsNeg[axis] ? node->get_above_child_idx() : node->get_below_child_idx();
+			uint32_t farChild  = dirIsNeg[axis] ? node->get_below_child_idx() : node->get_above_child_idx();
 
-		derivs.dpdx = px - p;
-		derivs.dpdy = py - p;
+			uint32_t nearMask = (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tPlane, tMinKD, _CMP_NLT_UQ)) & activeMask;
+			uint32_t farMask  = (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tPlane, tMaxKD, _CMP_NGT_UQ)) & activeMask;
 
-		if((m_vertAttribs & VERTEX_ATTRIB_UV) != 0)
-		{
-			float b2x = 1.0f - b0x - b1x;
-			derivs.duvdx = (*uv0 * b2x + *uv1 * b0x + *uv2 * b1x) - uv;
+			if(farMask == 0)
+			{
+				nodeIdx = nearChild;
+				tMaxKD = _mm256_min_ps(tPlane, tMaxKD);
+			}
+			else if(nearMask == 0)
+			{
+				nodeIdx = farChild;
+				tMinKD = _mm256_max_ps(tPlane, tMinKD);
+			}
+			else
+			{
+				nodesToVisit[toVisitPos].nodeIdx = farChild;
+				nodesToVisit[toVisitPos].tMin = _mm256_max_ps(tPlane, tMinKD);
+				nodesToVisit[toVisitPos].tMax = tMaxKD;
+				toVisitPos++;
 
-			float b2y = 1.0f - b0y - b1y;
-			derivs.duvdy = (*uv0 * b2y + *uv1 * b0y + *uv2 * b1y) - uv;
+				nodeIdx = nearChild;
+				tMaxKD = _mm256_min_ps(tPlane, tMaxKD);
+			}
+
+			continue;
 		}
-		else
+
+		if(activeMask != 0)
+			intersectLeaf(node->get_tri_blocks_offset(), node->get_num_tris(), activeMask, tMax);
+
+		if(toVisitPos > 0)
 		{
-			derivs.duvdx = vec2(0.0f);
-			derivs.duvdy = vec2(0.0f);
+			toVisitPos--;
+			nodeIdx = nodesToVisit[toVisitPos].nodeIdx;
+			tMinKD = nodesToVisit[toVisitPos].tMin;
+			tMaxKD = nodesToVisit[toVisitPos].tMax;
 		}
+		else
+			break;
 	}
-	else
-		derivs = {0};
-
-	return true;
 }
 
-//-------------------------------------------//
-
-std::vector<std::shared_ptr<const Mesh>> Mesh::from_obj(std::string path)
+template<uint32_t W, typename F>
+bool Mesh::bvh_traverse(std::span<const BVHwideNode<W>> nodes, const Ray& ray, float& tMax, F&& intersectLeaf) const
 {
-	std::vector<std::shared_ptr<const Mesh>> result = {};
+	if(nodes.size() == 0)
+		return false;
 
-	//load meshes with qobj:
+	//get ray info:
 	//---------------
-	uint32_t numMeshes;
-	QOBJmesh* meshes;
+	vec3 rayPos = ray.origin();
+	vec3 invRayDir = 1.0f / ray.direction();
+	bool dirIsNeg[3] = { invRayDir.x < 0.0f, invRayDir.y < 0.0f, invRayDir.z < 0.0f };
 
-	QOBJerror err = qobj_load_obj(path.c_str(), &numMeshes, &meshes);
-	if(err != QOBJ_SUCCESS)
-	{
-		std::cout << "ERROR: failed to load qobj failed to load obj file \"" << path << "\" with error " << err << std::endl;
-		return {};
-	}
+	static const IntersectionKernels& kernels = get_intersection_kernels();
 
-	//convert to Mesh object:
+	//traverse bvh, nearest children first:
 	//---------------
-	for(uint32_t i = 0; i < numMeshes; i++)
+	struct BVHnodeToVisit
 	{
-		std::unique_ptr<uint32_t[]> indices = std::unique_ptr<uint32_t[]>(new uint32_t[meshes[i].numIndices]);
-		std::unique_ptr<float[]> verts = std::unique_ptr<float[]>(new float[meshes[i].numVertices * meshes[i].vertexStride]);
+		uint32_t idx;
+		uint32_t numTris;
+		float tMin;
+	};
 
-		//unfortuntaely we need to copy the data returned by qobj since we need unique_ptrs - TODO: fix this!!
-		//(we cant use a custom deleter since we have 2 separate unique_ptrs)
+	BVHnodeToVisit nodesToVisit[(W - 1) * FR_MESH_BVH_MAX_DEPTH + 1];
+	uint32_t toVisitPos = 0;
 
-		memcpy(indices.get(), meshes[i].indices, meshes[i].numIndices * sizeof(uint32_t));
-		memcpy(verts.get(), meshes[i].vertices, meshes[i].numVertices * sizeof(float) * meshes[i].vertexStride);
+	nodesToVisit[toVisitPos++] = { 0, 0, 0.0f };
+	while(toVisitPos > 0)
+	{
+		BVHnodeToVisit cur = nodesToVisit[--toVisitPos];
+		if(cur.tMin > tMax)
+			continue;
 
-		uint32_t attribs = 0;
-		if(meshes[i].vertexAttribs & QOBJ_VERTEX_ATTRIB_POSITION)
-			attribs |= VERTEX_ATTRIB_POSITION;
-		if(meshes[i].vertexAttribs & QOBJ_VERTEX_ATTRIB_TEX_COORDS)
-			attribs |= VERTEX_ATTRIB_UV;
-		if(meshes[i].vertexAttribs & QOBJ_VERTEX_ATTRIB_NORMAL)
-			attribs |= VERTEX_ATTRIB_NORMAL;
+		if(cur.numTris > 0)
+		{
+			if(intersectLeaf(cur.idx, cur.numTris, tMax))
+				return true;
 
-		result.push_back(std::make_shared<Mesh>(attribs, meshes[i].numIndices / 3, std::move(indices), std::move(verts), meshes[i].material, 
-						 meshes[i].vertexStride, meshes[i].vertexPosOffset, meshes[i].vertexTexCoordOffset, meshes[i].vertexNormalOffset));
-	}
+			continue;
+		}
 
-	//cleanup + return:
-	//---------------
+		//test all children at once
+		const BVHwideNode<W>& node = nodes[cur.idx];
+
+		alignas(32) float tNear[W];
+		uint32_t hitMask;
+		if constexpr(W == 8)
+			hitMask = kernels.intersectBoxes8(node.minX, rayPos.v, invRayDir.v, dirIsNeg, tMax, tNear);
+		else
+			hitMask = kernels.intersectBoxes4(node.minX, rayPos.v, invRayDir.v, dirIsNeg, tMax, tNear);
+
+		//sort hit children by distance, push farthest first so the nearest is visited next
+		uint32_t hitChildren[W];
+		uint32_t numHit = 0;
+		for(uint32_t i = 0; i < W; i++)
+		{
+			if((hitMask & (1 << i)) == 0)
+				continue;
+
+			uint32_t j = numHit++;
+			while(j > 0 && tNear[hitChildren[j - 1]] < tNear[i])
+			{
+				hitChildren[j] = hitChildren[j - 1];
+				j--;
+			}
+
+			hitChildren[j] = i;
+		}
+
+		for(uint32_t i = 0; i < numHit; i++)
+		{
+			uint32_t child = hitChildren[i];
+			nodesToVisit[toVisitPos++] = { node.children[child], node.numTris[child], tNear[child] };
+		}
+	}
+
+	return false;
+}
+
+bool Mesh::intersect(const Ray& ray, std::shared_ptr<const Texture<float>> alphaMask, float& t, vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs) const
+{
+	uint32_t triIdx;
+	vec2 barycentrics;
+	if(!intersect(ray, alphaMask, INFINITY, t, triIdx, barycentrics))
+		return false;
+
+	get_hit_attribs(ray, t, triIdx, barycentrics, uv, normal, derivs);
+	return true;
+}
+
+bool Mesh::intersect(const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask, float tMax, 
+                     float& tMin, uint32_t& triIdx, vec2& barycentrics) const
+{
+	ensure_built();
+
+	bool hit = false;
+
+	tMin = tMax;
+	float minB0, minB1;
+
+	//traverse acceleration structure, keeping closest hit:
+	//---------------
+	auto intersectLeaf = [&](uint32_t blocksOffset, uint32_t numTris, float& tMax) -> bool {
+		hit |= intersect_tri_blocks(blocksOffset, numTris, ray, alphaMask, tMax, triIdx, minB0, minB1);
+		return false;
+	};
+
+	switch(m_accelerator)
+	{
+	case MESH_ACCELERATOR_KD_TREE:
+		kdtree_traverse(ray, tMin, intersectLeaf);
+		break;
+	case MESH_ACCELERATOR_BVH4:
+		bvh_traverse(m_bvh4View, ray, tMin, intersectLeaf);
+		break;
+	case MESH_ACCELERATOR_BVH8:
+		bvh_traverse(m_bvh8View, ray, tMin, intersectLeaf);
+		break;
+	}
+
+	barycentrics = vec2(minB0, minB1);
+	return hit;
+}
+
+FR_TARGET_AVX2 uint32_t Mesh::intersect8(const RayPacket8& rays, uint32_t rayMask, const std::shared_ptr<const Texture<float>>& alphaMask,
+                                          float* tMax, uint32_t* triIdx, vec2* barycentrics) const
+{
+	ensure_built();
+
+	uint32_t hitMask = 0;
+
+	Ray laneRays[8];
+	for(uint32_t i = 0; i < 8; i++)
+		laneRays[i] = rays.get_ray(i);
+
+	//traverse kd tree once for the whole packet if possible, triangles are still tested one ray at a time:
+	//---------------
+	bool dirIsNeg[3];
+	if(m_accelerator == MESH_ACCELERATOR_KD_TREE && rays.coherent(rayMask, dirIsNeg))
+	{
+		float minB0[8], minB1[8];
+		kdtree_traverse8(rays, rayMask, dirIsNeg, tMax, [&](uint32_t blocksOffset, uint32_t numTris, uint32_t leafRayMask, float* curTMax) {
+			for(uint32_t i = 0; i < 8; i++)
+			{
+				if((leafRayMask & (1 << i)) && 
+				   intersect_tri_blocks(blocksOffset, numTris, laneRays[i], alphaMask, curTMax[i], triIdx[i], minB0[i], minB1[i]))
+					hitMask |= 1 << i;
+			}
+		});
+
+		for(uint32_t i = 0; i < 8; i++)
+			if(hitMask & (1 << i))
+				barycentrics[i] = vec2(minB0[i], minB1[i]);
+
+		return hitMask;
+	}
+
+	//otherwise, the packet has diverged, trace each ray on its own:
+	//---------------
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		if(!(rayMask & (1 << i)))
+			continue;
+
+		float t;
+		uint32_t newTriIdx;
+		vec2 newBarycentrics;
+		if(intersect(laneRays[i], alphaMask, tMax[i], t, newTriIdx, newBarycentrics))
+		{
+			hitMask |= 1 << i;
+			tMax[i] = t;
+			triIdx[i] = newTriIdx;
+			barycentrics[i] = newBarycentrics;
+		}
+	}
+
+	return hitMask;
+}
+
+void Mesh::get_hit_attribs(const Ray& ray, float t, uint32_t triIdx, const vec2& barycentrics, vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs) const
+{
+	ensure_built();
+
+	//get triangle:
+	//---------------
+	//compact vertices are only decoded here, for the winning hit
+	vec3 rayDir = ray.direction();
+
+	uint32_t idx0, idx1, idx2;
+	tri_indices_at(triIdx, idx0, idx1, idx2);
+
+	vec3 v0, v1, v2;
+	get_tri_positions(triIdx, v0, v1, v2);
+
+	//get attributes:
+	//---------------
+	float b0 = barycentrics.x;
+	float b1 = barycentrics.y;
+	float b2 = 1.0f - b0 - b1;
+
+	vec2 uv0, uv1, uv2;
+	if((m_vertAttribs & VERTEX_ATTRIB_UV) != 0)
+	{
+		uv0 = vert_uv_at(idx0);
+		uv1 = vert_uv_at(idx1);
+		uv2 = vert_uv_at(idx2);
+
+		uv = uv0 * b2 + uv1 * b0 + uv2 * b1;
+	}
+	else
+		uv = vec2(0.0f);
+
+	vec3 geomNormal = cross(v1 - v0, v2 - v0); //geometric normal
+
+	//degenerate triangles have no normal or differentials, fall back to the shading normal, or facing the ray:
+	//---------------
+	if(geomNormal == vec3(0.0f))
+	{
+		normal = vec3(0.0f);
+		if((m_vertAttribs & VERTEX_ATTRIB_NORMAL) != 0)
+			normal = vert_normal_at(idx0) * b2 + vert_normal_at(idx1) * b0 + vert_normal_at(idx2) * b1;
+		if(normal == vec3(0.0f))
+			normal = -1.0f * rayDir;
+
+		derivs = {vec3(0.0f), vec3(0.0f), vec2(0.0f), vec2(0.0f)};
+		return;
+	}
+
+	if((m_vertAttribs & VERTEX_ATTRIB_NORMAL) != 0)
+	{
+		vec3 normal0 = vert_normal_at(idx0);
+		vec3 normal1 = vert_normal_at(idx1);
+		vec3 normal2 = vert_normal_at(idx2);
+
+		//ensure that shaded normal is in "same hemisphere" as geom normal to avoid shading errors
+		vec3 shadingNormal = normal0 * b2 + normal1 * b0 + normal2 * b1;
+		if(dot(rayDir, geomNormal) * dot(rayDir, shadingNormal) <= 0.0f)
+			normal = geomNormal;
+		else
+			normal = shadingNormal;
+	}
+	else
+		normal = geomNormal;
+
+	//calculate derivatives:
+	//---------------
+	if(ray.has_differentials())
+	{
+		vec3 p = ray.at(t);
+
+		float tx;
+		float b0x, b1x;
+		intersect_triangle_no_bounds_check(ray.differential_x(), v0, v1, v2, tx, b0x, b1x);
+		vec3 px = ray.differential_x().at(tx);
+
+		float ty;
+		float b0y, b1y;
+		intersect_triangle_no_bounds_check(ray.differential_y(), v0, v1, v2, ty, b0y, b1y);
+		vec3 py = ray.differential_y().at(ty);
+
+		derivs.dpdx = px - p;
+		derivs.dpdy = py - p;
+
+		if((m_vertAttribs & VERTEX_ATTRIB_UV) != 0)
+		{
+			float b2x = 1.0f - b0x - b1x;
+			derivs.duvdx = (uv0 * b2x + uv1 * b0x + uv2 * b1x) - uv;
+
+			float b2y = 1.0f - b0y - b1y;
+			derivs.duvdy = (uv0 * b2y + uv1 * b0y + uv2 * b1y) - uv;
+		}
+		else
+		{
+			derivs.duvdx = vec2(0.0f);
+			derivs.duvdy = vec2(0.0f);
+		}
+	}
+	else
+		derivs = {0};
+}
+
+bool Mesh::occluded(const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask, float tMax) const
+{
+	ensure_built();
+
+	//traverse acceleration structure, stop at the first hit:
+	//---------------
+	auto occludedLeaf = [&](uint32_t blocksOffset, uint32_t numTris, float& tMax) -> bool {
+		return occluded_tri_blocks(blocksOffset, numTris, ray, alphaMask, tMax);
+	};
+
+	switch(m_accelerator)
+	{
+	case MESH_ACCELERATOR_KD_TREE:
+		return kdtree_traverse(ray, tMax, occludedLeaf);
+	case MESH_ACCELERATOR_BVH4:
+		return bvh_traverse(m_bvh4View, ray, tMax, occludedLeaf);
+	case MESH_ACCELERATOR_BVH8:
+		return bvh_traverse(m_bvh8View, ray, tMax, occludedLeaf);
+	default:
+		return false;
+	}
+}
+
+//-------------------------------------------//
+
+std::vector<MeshInstance> Mesh::from_obj(std::string path, MeshAccelerator accelerator, 
+                                         const std::unordered_map<std::string, std::shared_ptr<const Texture<float>>>& alphaMasks,
+                                         VertexFormat vertexFormat)
+{
+	std::vector<MeshInstance> result = {};
+
+	//load meshes with qobj (one per group and material):
+	//---------------
+	uint32_t numMeshes;
+	QOBJmesh* meshes;
+
+	QOBJerror err = qobj_load_obj(path.c_str(), &numMeshes, &meshes);
+	if(err != QOBJ_SUCCESS)
+	{
+		std::cout << "ERROR: failed to load qobj failed to load obj file \"" << path << "\" with error " << err << std::endl;
+		return {};
+	}
+
+	std::vector<std::shared_ptr<const Texture<float>>> meshAlphaMasks(numMeshes, nullptr);
+	for(uint32_t i = 0; i < numMeshes; i++)
+	{
+		auto maskIt = alphaMasks.find(meshes[i].material);
+		if(maskIt != alphaMasks.end())
+			meshAlphaMasks[i] = maskIt->second;
+	}
+
+	//find groups whose geometry matches an earlier group's up to a translation:
+	//---------------
+	std::unordered_map<uint64_t, std::vector<uint32_t>> dedupBuckets; //hash -> groups that are not duplicates
+	std::vector<bound3> meshBounds(numMeshes);
+	std::vector<uint32_t> duplicateOf(numMeshes);
+	std::vector<vec3> offsets(numMeshes, vec3(0.0f));
+	std::vector<uint32_t> numDuplicates(numMeshes, 0);
+
+	for(uint32_t i = 0; i < numMeshes; i++)
+	{
+		duplicateOf[i] = i;
+		if(meshes[i].vertexPosOffset == UINT32_MAX)
+			continue;
+
+		meshBounds[i] = obj_mesh_bounds(meshes[i]);
+		std::vector<uint32_t>& bucket = dedupBuckets[obj_mesh_hash(meshes[i], meshAlphaMasks[i].get())];
+
+		for(uint32_t j = 0; j < bucket.size() && j < FR_MESH_DEDUP_MAX_CANDIDATES; j++)
+		{
+			uint32_t candidate = bucket[j];
+			vec3 offset = meshBounds[i].min - meshBounds[candidate].min;
+			if(obj_mesh_matches(meshes[candidate], meshes[i], offset, obj_mesh_tolerance(meshBounds[i])))
+			{
+				duplicateOf[i] = candidate;
+				offsets[i] = offset;
+				numDuplicates[candidate]++;
+				break;
+			}
+		}
+
+		if(duplicateOf[i] == i)
+			bucket.push_back(i);
+	}
+
+	//convert to Mesh objects, groups without duplicates are merged per material as if they were never split:
+	//---------------
+	std::vector<std::shared_ptr<const Mesh>> groupMeshes(numMeshes, nullptr);
+	std::vector<std::vector<uint32_t>> merged;
+	uint32_t numInstanced = 0;
+
+	for(uint32_t i = 0; i < numMeshes; i++)
+	{
+		if(duplicateOf[i] != i)
+		{
+			result.push_back({groupMeshes[duplicateOf[i]], meshes[i].material, offsets[i]});
+			numInstanced++;
+		}
+		else if(numDuplicates[i] > 0)
+		{
+			groupMeshes[i] = mesh_from_obj_groups(meshes, {i}, accelerator, meshAlphaMasks[i], vertexFormat);
+			result.push_back({groupMeshes[i], meshes[i].material, vec3(0.0f)});
+		}
+		else
+		{
+			bool found = false;
+			for(uint32_t j = 0; j < merged.size(); j++)
+			{
+				const QOBJmesh& other = meshes[merged[j][0]];
+				if(strcmp(other.material, meshes[i].material) == 0 && other.vertexStride == meshes[i].vertexStride &&
+				   other.vertexPosOffset == meshes[i].vertexPosOffset && other.vertexTexCoordOffset == meshes[i].vertexTexCoordOffset &&
+				   other.vertexNormalOffset == meshes[i].vertexNormalOffset && other.vertexAttribs == meshes[i].vertexAttribs)
+				{
+					merged[j].push_back(i);
+					found = true;
+					break;
+				}
+			}
+
+			if(!found)
+				merged.push_back({i});
+		}
+	}
+
+	for(uint32_t i = 0; i < merged.size(); i++)
+	{
+		const QOBJmesh& first = meshes[merged[i][0]];
+		result.push_back({mesh_from_obj_groups(meshes, merged[i], accelerator, meshAlphaMasks[merged[i][0]], vertexFormat), first.material, vec3(0.0f)});
+	}
+
+	if(numInstanced > 0)
+		log_verbose("instanced ", numInstanced, " of ", numMeshes, " groups in \"", path, "\"");
+
+	//cleanup + return:
+	//---------------
 	qobj_free_obj(numMeshes, meshes);
 
 	return result;
@@ -442,87 +1225,7 @@ bool Mesh::intersect_triangle(const Ray& ray, const vec3& v0, const vec3& v1, co
 	return t > FR_EPSILON;
 }
 
-Mesh::IntersectTriangleResultSIMD Mesh::intersect_triangles_simd(const Ray& ray, const vec3 (&v0)[8], const vec3 (&v1)[8], const vec3 (&v2)[8])
-{
-	//load into SIMD registers:
-	//---------------	
-	__m256 roX = _mm256_set1_ps(ray.origin().x);
-	__m256 roY = _mm256_set1_ps(ray.origin().y);
-	__m256 roZ = _mm256_set1_ps(ray.origin().z);
-
-	__m256 rdX = _mm256_set1_ps(ray.direction().x);
-	__m256 rdY = _mm256_set1_ps(ray.direction().y);
-	__m256 rdZ = _mm256_set1_ps(ray.direction().z);
-
-	__m256 v0x = _mm256_setr_ps(v0[0].x, v0[1].x, v0[2].x, v0[3].x, v0[4].x, v0[5].x, v0[6].x, v0[7].x);
-	__m256 v0y = _mm256_setr_ps(v0[0].y, v0[1].y, v0[2].y, v0[3].y, v0[4].y, v0[5].y, v0[6].y, v0[7].y);
-	__m256 v0z = _mm256_setr_ps(v0[0].z, v0[1].z, v0[2].z, v0[3].z, v0[4].z, v0[5].z, v0[6].z, v0[7].z);
-	__m256 v1x = _mm256_setr_ps(v1[0].x, v1[1].x, v1[2].x, v1[3].x, v1[4].x, v1[5].x, v1[6].x, v1[7].x);
-	__m256 v1y = _mm256_setr_ps(v1[0].y, v1[1].y, v1[2].y, v1[3].y, v1[4].y, v1[5].y, v1[6].y, v1[7].y);
-	__m256 v1z = _mm256_setr_ps(v1[0].z, v1[1].z, v1[2].z, v1[3].z, v1[4].z, v1[5].z, v1[6].z, v1[7].z);
-	__m256 v2x = _mm256_setr_ps(v2[0].x, v2[1].x, v2[2].x, v2[3].x, v2[4].x, v2[5].x, v2[6].x, v2[7].x);
-	__m256 v2y = _mm256_setr_ps(v2[0].y, v2[1].y, v2[2].y, v2[3].y, v2[4].y, v2[5].y, v2[6].y, v2[7].y);
-	__m256 v2z = _mm256_setr_ps(v2[0].z, v2[1].z, v2[2].z, v2[3].z, v2[4].z, v2[5].z, v2[6].z, v2[7].z);
-
-	//compute intersections:
-	//---------------
-	__m256 v0v1x = _mm256_sub_ps(v1x, v0x);
-	__m256 v0v1y = _mm256_sub_ps(v1y, v0y);
-	__m256 v0v1z = _mm256_sub_ps(v1z, v0z);
-
-	__m256 v0v2x = _mm256_sub_ps(v2x, v0x);
-	__m256 v0v2y = _mm256_sub_ps(v2y, v0y);
-	__m256 v0v2z = _mm256_sub_ps(v2z, v0z);
-
-	__m256 pvecX = _mm256_sub_ps(_mm256_mul_ps(rdY, v0v2z), _mm256_mul_ps(rdZ, v0v2y));
-	__m256 pvecY = _mm256_sub_ps(_mm256_mul_ps(rdZ, v0v2x), _mm256_mul_ps(rdX, v0v2z));
-	__m256 pvecZ = _mm256_sub_ps(_mm256_mul_ps(rdX, v0v2y), _mm256_mul_ps(rdY, v0v2x));
-
-	__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0v1x, pvecX), _mm256_mul_ps(v0v1y, pvecY)), _mm256_mul_ps(v0v1z, pvecZ));
-	__m256 absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
-	__m256 detMask = _mm256_cmp_ps(absDet, _mm256_set1_ps(std::numeric_limits<float>::epsilon()), _CMP_LT_OS);
-	__m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
-
-	__m256 tvecX = _mm256_sub_ps(roX, v0x);
-	__m256 tvecY = _mm256_sub_ps(roY, v0y);
-	__m256 tvecZ = _mm256_sub_ps(roZ, v0z);
-
-	__m256 u = _mm256_mul_ps(
-		_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tvecX, pvecX), _mm256_mul_ps(tvecY, pvecY)), _mm256_mul_ps(tvecZ, pvecZ)),
-		invDet
-	);
-	__m256 uMask = _mm256_or_ps(_mm256_cmp_ps(u, _mm256_setzero_ps(), _CMP_LT_OS), _mm256_cmp_ps(u, _mm256_set1_ps(1.0f), _CMP_GT_OS));
-
-	__m256 qvecX = _mm256_sub_ps(_mm256_mul_ps(tvecY, v0v1z), _mm256_mul_ps(tvecZ, v0v1y));
-	__m256 qvecY = _mm256_sub_ps(_mm256_mul_ps(tvecZ, v0v1x), _mm256_mul_ps(tvecX, v0v1z));
-	__m256 qvecZ = _mm256_sub_ps(_mm256_mul_ps(tvecX, v0v1y), _mm256_mul_ps(tvecY, v0v1x));	
-
-	__m256 v = _mm256_mul_ps(
-		_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rdX, qvecX), _mm256_mul_ps(rdY, qvecY)), _mm256_mul_ps(rdZ, qvecZ)),
-		invDet
-	);
-	__m256 vMask = _mm256_or_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LT_OS), _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_GT_OS));
-
-	__m256 t = _mm256_mul_ps(
-		_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0v2x, qvecX), _mm256_mul_ps(v0v2y, qvecY)), _mm256_mul_ps(v0v2z, qvecZ)),
-		invDet
-	);
-	__m256 tMask = _mm256_cmp_ps(t, _mm256_set1_ps(FR_EPSILON), _CMP_LE_OS);
-
-	__m256 hitMask = _mm256_or_ps(_mm256_or_ps(_mm256_or_ps(detMask, uMask), vMask), tMask);
-
-	//return:
-	//---------------
-	IntersectTriangleResultSIMD result;
-	result.hit = _mm256_castps_si256(_mm256_xor_ps(hitMask, _mm256_set1_ps(-0.0f)));
-	result.t = t;
-	result.u = u;
-	result.v = v;
-	
-	return result;
-}
-
-bool Mesh::test_alpha_mask(std::shared_ptr<const Texture<float>> alphaMask, uint32_t idx0, uint32_t idx1, uint32_t idx2, float b0, float b1) const
+bool Mesh::test_alpha_mask(const std::shared_ptr<const Texture<float>>& alphaMask, uint32_t triIdx, float b0, float b1) const
 {
 	if(alphaMask == nullptr)
 		return true;
@@ -530,15 +1233,22 @@ bool Mesh::test_alpha_mask(std::shared_ptr<const Texture<float>> alphaMask, uint
 	if((m_vertAttribs & VERTEX_ATTRIB_UV) == 0)
 		return true;
 
+	//use the precomputed classification if possible:
+	//---------------
+	if(alphaMask == m_alphaMask && m_triOpacity[triIdx] != TRI_OPACITY_MIXED)
+		return m_triOpacity[triIdx] == TRI_OPACITY_OPAQUE;
+
 	//get uv:
 	//---------------
-	float* verts = m_verts.get();
-	const vec2* uv0 = reinterpret_cast<const vec2*>(&verts[idx0 + m_vertUvOffset]);
-	const vec2* uv1 = reinterpret_cast<const vec2*>(&verts[idx1 + m_vertUvOffset]);
-	const vec2* uv2 = reinterpret_cast<const vec2*>(&verts[idx2 + m_vertUvOffset]);
+	uint32_t idx0, idx1, idx2;
+	tri_indices_at(triIdx, idx0, idx1, idx2);
+
+	vec2 uv0 = vert_uv_at(idx0);
+	vec2 uv1 = vert_uv_at(idx1);
+	vec2 uv2 = vert_uv_at(idx2);
 	
 	float b2 = 1.0f - b0 - b1;
-	vec2 uv = *uv0 * b2 + *uv1 * b0 + *uv2 * b1;
+	vec2 uv = uv0 * b2 + uv1 * b0 + uv2 * b1;
 
 	//evaluate texture (just want the texel, no mipmapping):
 	//---------------
@@ -552,6 +1262,57 @@ bool Mesh::test_alpha_mask(std::shared_ptr<const Texture<float>> alphaMask, uint
 	return alphaMask->evaluate(evalInfo) > 0.0f;
 }
 
+void Mesh::classify_opacity()
+{
+	if(m_alphaMask == nullptr)
+		return;
+
+	//without uvs the mask is never evaluated:
+	//---------------
+	m_triOpacity.assign(m_numTris, TRI_OPACITY_OPAQUE);
+	if((m_vertAttribs & VERTEX_ATTRIB_UV) == 0)
+		return;
+
+	//classify using the range of the mask over each triangle's uv footprint:
+	//---------------
+	uint32_t numOpaque = 0;
+	uint32_t numTransparent = 0;
+	for(uint32_t i = 0; i < m_numTris; i++)
+	{
+		vec2 uv0 = vert_uv_at(m_indexView[i * 3 + 0]);
+		vec2 uv1 = vert_uv_at(m_indexView[i * 3 + 1]);
+		vec2 uv2 = vert_uv_at(m_indexView[i * 3 + 2]);
+
+		float minAlpha, maxAlpha;
+		if(!m_alphaMask->get_range(uv0, uv1, uv2, minAlpha, maxAlpha))
+			m_triOpacity[i] = TRI_OPACITY_MIXED;
+		else if(minAlpha > 0.0f)
+			m_triOpacity[i] = TRI_OPACITY_OPAQUE;
+		else if(maxAlpha <= 0.0f)
+			m_triOpacity[i] = TRI_OPACITY_TRANSPARENT;
+		else
+			m_triOpacity[i] = TRI_OPACITY_MIXED;
+
+		numOpaque += m_triOpacity[i] == TRI_OPACITY_OPAQUE;
+		numTransparent += m_triOpacity[i] == TRI_OPACITY_TRANSPARENT;
+	}
+
+	log_verbose("classified alpha mask for mesh \"", m_material, "\" (", numOpaque, " opaque, ", numTransparent, " transparent, ", 
+	            m_numTris - numOpaque - numTransparent, " mixed tris)");
+}
+
+std::vector<uint32_t> Mesh::get_build_tris() const
+{
+	std::vector<uint32_t> tris;
+	tris.reserve(m_numTris);
+
+	for(uint32_t i = 0; i < m_numTris; i++)
+		if(m_triOpacity.empty() || m_triOpacity[i] != TRI_OPACITY_TRANSPARENT)
+			tris.push_back(i);
+
+	return tris;
+}
+
 void Mesh::intersect_triangle_no_bounds_check(const Ray& ray, const vec3& v0, const vec3& v1, const vec3& v2, float& t, float& u, float& v)
 {
 	vec3 v0v1 = v1 - v0;
@@ -559,429 +1320,1641 @@ void Mesh::intersect_triangle_no_bounds_check(const Ray& ray, const vec3& v0, co
 	vec3 pvec = cross(ray.direction(), v0v2);
 	float det = dot(v0v1, pvec);
 
-	float invDet = 1.0f / det;
+	float invDet = 1.0f / det;
+
+	vec3 tvec = ray.origin() - v0;
+	u = dot(tvec, pvec) * invDet;
+
+	vec3 qvec = cross(tvec, v0v1);
+	v = dot(ray.direction(), qvec) * invDet;
+
+	t = dot(v0v2, qvec) * invDet;
+}
+
+void Mesh::build()
+{
+	classify_opacity();
+	if(m_accelerator == MESH_ACCELERATOR_KD_TREE)
+		kdtree_build();
+	else
+		bvh_build();
+
+	if(m_builtVertFormat == VERTEX_FORMAT_COMPACT)
+		compress_verts();
+
+	move_to_arena();
+}
+
+void Mesh::build_or_defer()
+{
+	//read the constructor's arrays until build() moves them:
+	//---------------
+	m_numVerts = 0;
+	for(uint32_t i = 0; i < m_numTris * 3; i++)
+		m_numVerts = std::max(m_numVerts, m_indices[i] + 1);
+
+	m_indexView = std::span<const uint32_t>(m_indices.get(), m_numTris * 3);
+	m_vertView = std::span<const float>(m_verts.get(), m_numVerts * m_vertStride);
+
+	m_buildThreaded = !m_lazyBuild;
+	if(!m_lazyBuild)
+	{
+		ensure_built();
+		m_bounds = m_treeBounds;
+		return;
+	}
+
+	//only the bounds are needed until a ray reaches the mesh, they include transparent triangles so they stay conservative:
+	//---------------
+	bound3 bounds = {vec3(INFINITY), vec3(-INFINITY)};
+	for(uint32_t i = 0; i < m_numTris * 3; i++)
+	{
+		vec3 pos = vert_pos_at(m_indexView[i]);
+		bounds.min = min(bounds.min, pos);
+		bounds.max = max(bounds.max, pos);
+	}
+
+	m_bounds = bounds;
+}
+
+void Mesh::move_to_arena()
+{
+	//lay out every array in one allocation, each starting on a cache line:
+	//---------------
+	std::span<const std::byte> arrays[8] = {
+		std::as_bytes(std::span(m_kdTree)), std::as_bytes(std::span(m_bvh4)), std::as_bytes(std::span(m_bvh8)),
+		std::as_bytes(std::span(m_triBlocks)), std::as_bytes(m_indexView), std::as_bytes(m_vertView), std::as_bytes(std::span(m_compactVerts)),
+		std::as_bytes(std::span(m_triBlockLanes))
+	};
+
+	size_t offsets[8];
+	size_t size = 0;
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		offsets[i] = size;
+		size += (arrays[i].size() + FR_CACHE_LINE_SIZE - 1) / FR_CACHE_LINE_SIZE * FR_CACHE_LINE_SIZE;
+	}
+
+	uint8_t* data = (uint8_t*)GeometryArena::allocate(size);
+	for(uint32_t i = 0; i < 8; i++)
+		memcpy(data + offsets[i], arrays[i].data(), arrays[i].size());
+
+	//point the views at the copies, free the originals. this runs inside ensure_built(), and every reader of the views goes through
+	//it first, so no other thread can see the views until the copies are complete and the originals are gone:
+	//---------------
+	m_kdTreeView      = std::span<const KDtreeNode>((const KDtreeNode*)(data + offsets[0]), m_kdTree.size());
+	m_bvh4View        = std::span<const BVHwideNode<4>>((const BVHwideNode<4>*)(data + offsets[1]), m_bvh4.size());
+	m_bvh8View        = std::span<const BVHwideNode<8>>((const BVHwideNode<8>*)(data + offsets[2]), m_bvh8.size());
+	m_triBlockView    = std::span<const TriangleBlockSIMD>((const TriangleBlockSIMD*)(data + offsets[3]), m_triBlocks.size());
+	m_indexView       = std::span<const uint32_t>((const uint32_t*)(data + offsets[4]), m_indexView.size());
+	m_vertView        = std::span<const float>((const float*)(data + offsets[5]), m_vertView.size());
+	m_compactVertView = std::span<const CompactVertex>((const CompactVertex*)(data + offsets[6]), m_compactVerts.size());
+	m_triBlockLaneView = std::span<const uint32_t>((const uint32_t*)(data + offsets[7]), m_triBlockLanes.size());
+
+	m_kdTree = {};
+	m_bvh4 = {};
+	m_bvh8 = {};
+	m_triBlocks = {};
+	m_indices.reset();
+	m_verts.reset();
+	m_compactVerts = {};
+	m_triBlockLanes = {};
+
+	m_arenaData = data;
+}
+
+void Mesh::vert_attribs_setup()
+{
+	//vertices must have a position, or the mesh isnt renderable:
+	//---------------
+	if((m_vertAttribs & VERTEX_ATTRIB_POSITION) == 0)
+		throw std::runtime_error("vertices MUST contain the POSITION attribute" );
+
+	//calculate stride:
+	//---------------
+	if(m_vertStride == UINT32_MAX)
+	{
+		m_vertStride = 0;
+
+		if((m_vertAttribs & VERTEX_ATTRIB_POSITION) != 0)
+			m_vertStride += 3;
+		if((m_vertAttribs & VERTEX_ATTRIB_UV) != 0)
+			m_vertStride += 2;
+		if((m_vertAttribs & VERTEX_ATTRIB_NORMAL) != 0)
+			m_vertStride += 3;
+	}
+
+	//calculate position offset (assume it comes first):
+	//---------------
+	if(m_vertPosOffset == UINT32_MAX)
+		m_vertPosOffset = 0;
+
+	//calculate uv offset (assume it comes directly after position):
+	//---------------
+	if(m_vertUvOffset == UINT32_MAX)
+	{
+		m_vertUvOffset = 0;
+
+		if((m_vertAttribs & VERTEX_ATTRIB_POSITION) != 0)
+			m_vertUvOffset += 3;
+	}
+
+	//calculate normal offset (assume it comes after position and uv):
+	//---------------
+	if(m_vertNormalOffset == UINT32_MAX)
+	{
+		m_vertNormalOffset = 0;
+
+		if((m_vertAttribs & VERTEX_ATTRIB_POSITION) != 0)
+			m_vertNormalOffset += 3;
+		if((m_vertAttribs & VERTEX_ATTRIB_UV) != 0)
+			m_vertNormalOffset += 2;
+	}
+}
+
+void Mesh::compress_verts()
+{
+	//find vertex bounds:
+	//---------------
+	uint32_t numVerts = m_numVerts;
+
+	vec3 minPos = vec3(INFINITY);
+	vec3 maxPos = vec3(-INFINITY);
+	for(uint32_t i = 0; i < numVerts; i++)
+	{
+		minPos = min(minPos, vert_pos_at(i));
+		maxPos = max(maxPos, vert_pos_at(i));
+	}
+
+	if(numVerts == 0)
+		minPos = maxPos = vec3(0.0f);
+
+	//quantize attributes:
+	//---------------
+	vec3 extent = maxPos - minPos;
+	std::vector<CompactVertex> compactVerts(numVerts);
+	for(uint32_t i = 0; i < numVerts; i++)
+	{
+		CompactVertex& vert = compactVerts[i];
+
+		vec3 pos = vert_pos_at(i) - minPos;
+		for(uint32_t j = 0; j < 3; j++)
+			vert.pos[j] = extent[j] > 0.0f ? (uint16_t)roundf(std::clamp(pos[j] / extent[j], 0.0f, 1.0f) * (float)UINT16_MAX) : 0;
+
+		vec2 uv = vert_uv_at(i);
+		vert.uv[0] = float_to_half(uv.x);
+		vert.uv[1] = float_to_half(uv.y);
+
+		vert.normal = octahedral_encode(vert_normal_at(i));
+	}
+
+	//index the triangle blocks, they still hold the full-precision positions:
+	//---------------
+	std::vector<uint32_t> triBlockLanes(m_numTris, UINT32_MAX);
+	for(uint32_t i = 0; i < m_triBlocks.size(); i++)
+	for(uint32_t j = 0; j < 8; j++)
+	{
+		uint32_t triIdx = m_triBlocks[i].triIdx[j];
+		if(triIdx != UINT32_MAX && triBlockLanes[triIdx] == UINT32_MAX)
+			triBlockLanes[triIdx] = i * 8 + j;
+	}
+
+	m_triBlockLanes = std::move(triBlockLanes);
+	m_triBlockLaneView = m_triBlockLanes;
+
+	//switch over, the accessors read from the compact vertices from now on:
+	//---------------
+	m_vertPosMin = minPos;
+	m_vertPosScale = extent / (float)UINT16_MAX;
+	m_compactVerts = std::move(compactVerts);
+	m_compactVertView = m_compactVerts;
+	m_vertFormat = VERTEX_FORMAT_COMPACT;
+	m_verts.reset();
+	m_vertView = {};
+}
+
+void Mesh::get_tri_positions(uint32_t triIdx, vec3& v0, vec3& v1, vec3& v2) const
+{
+	//triangles that were never hit (e.g. fully transparent ones) are only in the quantized vertices:
+	//---------------
+	uint32_t lane = m_vertFormat == VERTEX_FORMAT_COMPACT ? m_triBlockLaneView[triIdx] : UINT32_MAX;
+	if(lane == UINT32_MAX)
+	{
+		uint32_t idx0, idx1, idx2;
+		tri_indices_at(triIdx, idx0, idx1, idx2);
+
+		v0 = vert_pos_at(idx0);
+		v1 = vert_pos_at(idx1);
+		v2 = vert_pos_at(idx2);
+		return;
+	}
+
+	const TriangleBlockSIMD& block = m_triBlockView[lane / 8];
+	uint32_t j = lane % 8;
+
+	v0 = vec3(block.v0x[j], block.v0y[j], block.v0z[j]);
+	v1 = v0 + vec3(block.e1x[j], block.e1y[j], block.e1z[j]);
+	v2 = v0 + vec3(block.e2x[j], block.e2y[j], block.e2z[j]);
+}
+
+//-------------------------------------------//
+
+std::vector<bound3> Mesh::compute_tri_bounds() const
+{
+	std::vector<bound3> triBounds(m_numTris);
+	for(uint32_t i = 0; i < m_numTris; i++)
+	{
+		uint32_t idx0, idx1, idx2;
+		tri_indices_at(i, idx0, idx1, idx2);
+
+		vec3 v0 = vert_pos_at(idx0);
+		vec3 v1 = vert_pos_at(idx1);
+		vec3 v2 = vert_pos_at(idx2);
+
+		triBounds[i] = { min(min(v0, v1), v2), max(max(v0, v1), v2) };
+	}
+
+	return triBounds;
+}
+
+bool Mesh::clip_tri_bounds(uint32_t triIdx, const bound3& box, bound3& clippedBounds) const
+{
+	//clip against each plane of a slightly enlarged box (sutherland-hodgman), so triangles that only touch it are kept:
+	//---------------
+	uint32_t idx0, idx1, idx2;
+	tri_indices_at(triIdx, idx0, idx1, idx2);
+
+	vec3 polys[2][9]; //each plane adds at most 1 vertex
+	polys[0][0] = vert_pos_at(idx0);
+	polys[0][1] = vert_pos_at(idx1);
+	polys[0][2] = vert_pos_at(idx2);
+	uint32_t numVerts = 3;
+	uint32_t cur = 0;
+
+	float magnitude = 0.0f;
+	for(uint32_t axis = 0; axis < 3; axis++)
+		magnitude = std::max({magnitude, fabsf(box.min[axis]), fabsf(box.max[axis]), box.max[axis] - box.min[axis]});
+
+	float pad = FR_MESH_KDTREE_CLIP_EPSILON * magnitude;
+
+	for(uint32_t axis = 0; axis < 3; axis++)
+	for(uint32_t side = 0; side < 2; side++)
+	{
+		const vec3* in = polys[cur];
+		vec3* out = polys[cur ^ 1];
+		uint32_t numOut = 0;
+
+		float plane = side == 0 ? box.min[axis] - pad : box.max[axis] + pad;
+		auto dist = [&](const vec3& p) { return side == 0 ? p[axis] - plane : plane - p[axis]; };
+
+		for(uint32_t i = 0; i < numVerts; i++)
+		{
+			const vec3& p0 = in[i];
+			const vec3& p1 = in[(i + 1) % numVerts];
+			float d0 = dist(p0);
+			float d1 = dist(p1);
+
+			if(d0 >= 0.0f)
+				out[numOut++] = p0;
+
+			if((d0 >= 0.0f) != (d1 >= 0.0f))
+			{
+				vec3 intersection = p0 + (p1 - p0) * (d0 / (d0 - d1));
+				intersection[axis] = plane;
+				out[numOut++] = intersection;
+			}
+		}
+
+		numVerts = numOut;
+		cur ^= 1;
+		if(numVerts == 0)
+			return false;
+	}
+
+	//bound the clipped polygon, within the unpadded box:
+	//---------------
+	vec3 polyMin = polys[cur][0];
+	vec3 polyMax = polys[cur][0];
+	for(uint32_t i = 1; i < numVerts; i++)
+	{
+		polyMin = min(polyMin, polys[cur][i]);
+		polyMax = max(polyMax, polys[cur][i]);
+	}
+
+	clippedBounds.min = min(max(polyMin, box.min), box.max);
+	clippedBounds.max = max(min(polyMax, box.max), clippedBounds.min);
+	return true;
+}
+
+uint32_t Mesh::pack_tri_blocks(uint32_t numTris, const uint32_t* tris)
+{
+	uint32_t offset = (uint32_t)m_triBlocks.size();
+	uint32_t numBlocks = (numTris + 7) / 8;
+
+	for(uint32_t i = 0; i < numBlocks; i++)
+	{
+		TriangleBlockSIMD block = {};
+		for(uint32_t j = 0; j < 8; j++)
+		{
+			uint32_t tri = i * 8 + j;
+			if(tri >= numTris)
+			{
+				block.triIdx[j] = UINT32_MAX;
+				continue;
+			}
+
+			uint32_t triIdx = tris[tri];
+			uint32_t idx0, idx1, idx2;
+			tri_indices_at(triIdx, idx0, idx1, idx2);
+
+			vec3 v0 = vert_pos_at(idx0);
+			vec3 v1 = vert_pos_at(idx1);
+			vec3 v2 = vert_pos_at(idx2);
+
+			vec3 e1 = v1 - v0;
+			vec3 e2 = v2 - v0;
+
+			block.v0x[j] = v0.x; block.v0y[j] = v0.y; block.v0z[j] = v0.z;
+			block.e1x[j] = e1.x; block.e1y[j] = e1.y; block.e1z[j] = e1.z;
+			block.e2x[j] = e2.x; block.e2y[j] = e2.y; block.e2z[j] = e2.z;
+
+			block.triIdx[j] = triIdx;
+		}
+
+		m_triBlocks.push_back(block);
+	}
+
+	return offset;
+}
+
+bool Mesh::intersect_tri_blocks(uint32_t blocksOffset, uint32_t numTris, const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask, 
+                                float& tMin, uint32_t& minTriIdx, float& minB0, float& minB1) const
+{
+	static const IntersectTriBlocksKernel kernel = get_intersection_kernels().intersectTriBlocks;
+
+	bool hit = false;
+
+	const TriangleBlockSIMD* blocks = &m_triBlockView[blocksOffset];
+	uint32_t numBlocks = (numTris + 7) / 8;
+
+	//process in chunks of blocks, with the widest kernel the cpu supports:
+	//---------------
+	TriangleBlockHits hits[FR_MESH_KERNEL_CHUNK_BLOCKS];
+	for(uint32_t chunk = 0; chunk < numBlocks; chunk += FR_MESH_KERNEL_CHUNK_BLOCKS) 
+	{
+		uint32_t numChunkBlocks = std::min(numBlocks - chunk, (uint32_t)FR_MESH_KERNEL_CHUNK_BLOCKS);
+		if(!kernel(ray.origin().v, ray.direction().v, blocks + chunk, numChunkBlocks, tMin, hits))
+			continue;
+
+		for(uint32_t block = 0; block < numChunkBlocks; block++)
+		for(uint32_t i = 0; i < 8; i++) 
+		{
+			uint32_t triIdx = blocks[chunk + block].triIdx[i];
+			if((hits[block].mask & (1 << i)) && hits[block].t[i] < tMin && 
+			   test_alpha_mask(alphaMask, triIdx, hits[block].u[i], hits[block].v[i])) 
+			{
+				hit = true;
+				tMin = hits[block].t[i];
+				minTriIdx = triIdx;
+				minB0 = hits[block].u[i];
+				minB1 = hits[block].v[i];
+			}
+		}
+	}
+
+	return hit;
+}
+
+bool Mesh::occluded_tri_blocks(uint32_t blocksOffset, uint32_t numTris, const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask, 
+                               float tMax) const
+{
+	static const IntersectTriBlocksKernel kernel = get_intersection_kernels().intersectTriBlocks;
+
+	const TriangleBlockSIMD* blocks = &m_triBlockView[blocksOffset];
+	uint32_t numBlocks = (numTris + 7) / 8;
+
+	//process in chunks of blocks, with the widest kernel the cpu supports:
+	//---------------
+	TriangleBlockHits hits[FR_MESH_KERNEL_CHUNK_BLOCKS];
+	for(uint32_t chunk = 0; chunk < numBlocks; chunk += FR_MESH_KERNEL_CHUNK_BLOCKS) 
+	{
+		uint32_t numChunkBlocks = std::min(numBlocks - chunk, (uint32_t)FR_MESH_KERNEL_CHUNK_BLOCKS);
+		if(!kernel(ray.origin().v, ray.direction().v, blocks + chunk, numChunkBlocks, tMax, hits))
+			continue;
+
+		if(alphaMask == nullptr)
+			return true;
+
+		for(uint32_t block = 0; block < numChunkBlocks; block++)
+		for(uint32_t i = 0; i < 8; i++) 
+		{
+			if((hits[block].mask & (1 << i)) && 
+			   test_alpha_mask(alphaMask, blocks[chunk + block].triIdx[i], hits[block].u[i], hits[block].v[i])) 
+				return true;
+		}
+	}
+
+	return false;
+}
+
+//-------------------------------------------//
+
+void Mesh::KDtreeNode::init_interior(uint32_t axis, uint32_t _childrenIdx, float splitPos)
+{
+	flags = axis;
+	split = splitPos;
+	childrenIdx |= (_childrenIdx << 2);
+}
+
+void Mesh::KDtreeNode::init_leaf(uint32_t _numTris, uint32_t _triBlocksOffset)
+{
+	flags = 3;
+	numTris |= (_numTris << 2);
+
+	triBlocksOffset = _triBlocksOffset;
+}
+
+void Mesh::kdtree_build()
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	//load from cache if possible:
+	//---------------
+	uint64_t cacheKey = 0;
+	if(!m_kdTreeCacheDir.empty())
+	{
+		cacheKey = kdtree_cache_key();
+		if(kdtree_cache_load(cacheKey))
+		{
+			float loadTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			log_verbose("loaded kd tree for mesh \"", m_material, "\" (", m_numTris, " tris, ", m_kdTree.size(), " nodes) from cache in ", 
+			            loadTime, "ms");
+			return;
+		}
+	}
+
+	//compute bounds for each triangle, fully transparent ones are left out of the tree:
+	//---------------
+	std::vector<bound3> triBounds = compute_tri_bounds();
+	std::vector<uint32_t> tris = get_build_tris();
+	uint32_t numTris = (uint32_t)tris.size();
+	bound3 bounds = {vec3(INFINITY), vec3(-INFINITY)};
+
+	for(uint32_t i = 0; i < numTris; i++)
+	{
+		bounds.min = min(bounds.min, triBounds[tris[i]].min);
+		bounds.max = max(bounds.max, triBounds[tris[i]].max);
+	}
+
+	//if every triangle is cut out, the tree is a single empty leaf. it keeps the bounds of all triangles (or a point if there
+	//are none), so the mesh's bounds stay valid for the object and scene bvhs:
+	//---------------
+	if(numTris == 0)
+	{
+		bounds = {vec3(INFINITY), vec3(-INFINITY)};
+		for(uint32_t i = 0; i < m_numTris; i++)
+		{
+			bounds.min = min(bounds.min, triBounds[i].min);
+			bounds.max = max(bounds.max, triBounds[i].max);
+		}
+
+		if(m_numTris == 0)
+			bounds = {vec3(0.0f), vec3(0.0f)};
+
+		m_treeBounds = bounds;
+
+		m_kdTree.clear();
+		m_triBlocks.clear();
+		m_kdTree.resize(1);
+		m_kdTree[0].init_leaf(0, 0);
+		return;
+	}
+
+	m_treeBounds = bounds;
+
+	//give triangles that fill their bounds poorly several tighter references:
+	//---------------
+	KDtreeBuildRefs refs = kdtree_early_split(tris, triBounds);
+	uint32_t numRefs = (uint32_t)refs.tris.size();
+
+	//sort bound edges along each axis, once:
+	//---------------
+	std::vector<KDtreeBoundEdge> boundEdges[3];
+	auto sort_edges = [&](uint32_t axis) {
+		boundEdges[axis].resize(2 * numRefs);
+		for(uint32_t i = 0; i < numRefs; i++)
+		{
+			boundEdges[axis][2 * i    ] = {i, refs.bounds[i].min[axis], true};
+			boundEdges[axis][2 * i + 1] = {i, refs.bounds[i].max[axis], false};
+		}
+
+		std::sort(boundEdges[axis].begin(), boundEdges[axis].end());
+	};
+
+	if(m_buildThreaded && numRefs >= FR_MESH_KDTREE_PARALLEL_MIN_TRIS)
+	{
+		std::thread sortThreads[3];
+		for(uint32_t axis = 0; axis < 3; axis++)
+			sortThreads[axis] = std::thread(sort_edges, axis);
+
+		for(uint32_t axis = 0; axis < 3; axis++)
+			sortThreads[axis].join();
+	}
+	else
+	{
+		for(uint32_t axis = 0; axis < 3; axis++)
+			sort_edges(axis);
+	}
+
+	//build, spawning a new thread for each subtree until every core has work (lazy builds stay on the calling thread):
+	//---------------
+	uint32_t maxDepth = (uint32_t)std::roundf(8.0f + 1.3f * std::log2f((float)std::max(numTris, 1u)));
+
+	std::vector<uint32_t> rootRefs(numRefs);
+	for(uint32_t i = 0; i < numRefs; i++)
+		rootRefs[i] = i;
+
+	std::vector<uint8_t> refSides(numRefs);
+	uint32_t spawnDepth = m_buildThreaded ? (uint32_t)std::ceil(std::log2((float)std::max(std::thread::hardware_concurrency(), 1u))) : 0;
+
+	KDtreeBuildArena arena;
+	KDtreeBuildNode* root = kdtree_build_recursive(arena, bounds, refs, rootRefs, boundEdges, maxDepth, spawnDepth, refSides);
+
+	//flatten into final layout:
+	//---------------
+	m_kdTree.clear();
+	m_triBlocks.clear();
+	kdtree_flatten(root);
+
+	float buildTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	size_t memory = m_kdTree.size() * sizeof(KDtreeNode) + m_triBlocks.size() * sizeof(TriangleBlockSIMD);
+	log_verbose("built kd tree for mesh \"", m_material, "\" (", m_numTris, " tris, ", m_kdTree.size(), " nodes, ", 
+	            memory / 1024, "KB) in ", buildTime, "ms");
+
+	if(!m_kdTreeCacheDir.empty())
+		kdtree_cache_save(cacheKey);
+}
+
+Mesh::KDtreeBuildRefs Mesh::kdtree_early_split(const std::vector<uint32_t>& tris, const std::vector<bound3>& triBounds) const
+{
+	KDtreeBuildRefs refs;
+	refs.tris.reserve(tris.size());
+	refs.bounds.reserve(tris.size());
+
+	//halve the boxes of triangles that fill them poorly along their longest axis, re-clipping the triangle to each half:
+	//---------------
+	auto surface_area = [](const bound3& box) -> float {
+		vec3 d = box.max - box.min;
+		return 2.0f * (d.x * d.y + d.x * d.z + d.y * d.z);
+	};
+
+	std::vector<std::pair<bound3, uint32_t>> stack;
+	for(uint32_t i = 0; i < tris.size(); i++)
+	{
+		uint32_t tri = tris[i];
+
+		uint32_t idx0, idx1, idx2;
+		tri_indices_at(tri, idx0, idx1, idx2);
+
+		vec3 v0 = vert_pos_at(idx0);
+		float maxArea = FR_MESH_KDTREE_EARLY_SPLIT_RATIO * length(cross(vert_pos_at(idx1) - v0, vert_pos_at(idx2) - v0));
+
+		stack.push_back({triBounds[tri], 0});
+		while(!stack.empty())
+		{
+			auto [box, depth] = stack.back();
+			stack.pop_back();
+
+			//degenerate triangles have no area, so they are never split
+			if(depth == FR_MESH_KDTREE_EARLY_SPLIT_MAX_DEPTH || surface_area(box) <= maxArea)
+			{
+				refs.tris.push_back(tri);
+				refs.bounds.push_back(box);
+				continue;
+			}
+
+			vec3 d = box.max - box.min;
+			uint32_t axis = (d.x > d.y && d.x > d.z) ? 0 : (d.y > d.z ? 1 : 2);
+			float mid = 0.5f * (box.min[axis] + box.max[axis]);
+
+			bound3 halves[2] = {box, box};
+			halves[0].max[axis] = halves[1].min[axis] = mid;
+
+			for(uint32_t j = 0; j < 2; j++)
+			{
+				bound3 clipped;
+				if(clip_tri_bounds(tri, halves[j], clipped))
+					stack.push_back({clipped, depth + 1});
+			}
+		}
+	}
+
+	return refs;
+}
+
+Mesh::KDtreeBuildNode* Mesh::kdtree_build_recursive(KDtreeBuildArena& arena, const bound3& bounds, const KDtreeBuildRefs& refs,
+                                                    std::vector<uint32_t>& nodeRefs, std::vector<KDtreeBoundEdge> boundEdges[3], 
+                                                    uint32_t depth, uint32_t spawnDepth, std::vector<uint8_t>& refSides) const
+{
+	KDtreeBuildNode* node = &arena.nodes.emplace_back();
+	uint32_t numTris = (uint32_t)nodeRefs.size();
+
+	auto make_leaf = [&]() {
+		node->leaf = true;
+		node->tris.resize(numTris);
+		for(uint32_t i = 0; i < numTris; i++)
+			node->tris[i] = refs.tris[nodeRefs[i]];
+
+		//several early split references to the same triangle can end up in one leaf
+		std::sort(node->tris.begin(), node->tris.end());
+		node->tris.erase(std::unique(node->tris.begin(), node->tris.end()), node->tris.end());
+
+		std::vector<uint32_t>().swap(nodeRefs);
+		return node;
+	};
+
+	//stop recursion if at max depth or max tris:
+	//---------------
+	const KDtreeCosts& costs = kdtree_costs();
+	if(numTris <= costs.maxTrisPerLeaf || depth == 0)
+		return make_leaf();
+
+	//find split axis + position, leaves cost one intersection test per maxTrisPerLeaf triangles:
+	//---------------
+	uint32_t testWidth = costs.maxTrisPerLeaf;
+	auto num_tests = [&](uint32_t n) -> float { return (float)((n + testWidth - 1) / testWidth); };
+
+	int32_t bestAxis = -1;
+	int32_t bestOffset = -1;
+	float minCost = INFINITY;
+
+	vec3 d = bounds.max - bounds.min;
+	float totalSA = 2.0f * (d.x * d.y + d.x * d.z + d.y * d.z);
+	float invTotalSA = 1.0f / totalSA;
+
+	uint32_t axes[3];
+	if(d.x > d.y)
+	{
+		if(d.x > d.z)
+		{
+			axes[0] = 0;
+			axes[1] = (d.y > d.z) ? 1 : 2;
+			axes[2] = (d.y > d.z) ? 2 : 1;
+		}
+		else
+		{
+			axes[0] = 2;
+			axes[1] = (d.x > d.y) ? 0 : 1;
+			axes[2] = (d.x > d.y) ? 1 : 0;
+		}
+	}
+	else
+	{
+		if(d.y > d.z)
+		{
+			axes[0] = 1;
+			axes[1] = (d.x > d.z) ? 0 : 2;
+			axes[2] = (d.x > d.z) ? 2 : 0;
+		}
+		else
+		{
+			axes[0] = 2;
+			axes[1] = (d.x > d.y) ? 0 : 1;
+			axes[2] = (d.x > d.y) ? 1 : 0;
+		}
+	}
+
+	for(uint32_t i = 0; i < 3; i++)
+	{
+		uint32_t axis = axes[i];
+
+		//compute cost at each potential split, find the best
+		uint32_t numTrisBelow = 0;
+		uint32_t numTrisAbove = numTris;
+
+		for(uint32_t j = 0; j < 2 * numTris; j++)
+		{
+			if(!boundEdges[axis][j].start)
+				numTrisAbove--;
+
+			float edgePos = boundEdges[axis][j].pos;
+			if(edgePos > bounds.min[axis] && edgePos < bounds.max[axis])
+			{
+				//get sa
+				uint32_t otherAxis1 = (axis + 1) % 3;
+				uint32_t otherAxis2 = (axis + 2) % 3;
+				float belowSA = 2 * (
+					d[otherAxis1] * d[otherAxis2] +
+				    (edgePos - bounds.min[axis]) * (d[otherAxis1] + d[otherAxis2])
+				);
+				float aboveSA = 2 * (
+					d[otherAxis1] * d[otherAxis2] +
+					(bounds.max[axis] - edgePos) * (d[otherAxis1] + d[otherAxis2])
+				);
+
+				//compute cost
+				float belowP = belowSA * invTotalSA;
+				float aboveP = aboveSA * invTotalSA;
+				float emptyBonus = (numTrisAbove == 0 || numTrisBelow == 0) ? costs.emptyBonus : 0.0f;
+
+				float cost = costs.traversal + 
+					costs.isect * (1.0f - emptyBonus) * (belowP * num_tests(numTrisBelow) + aboveP * num_tests(numTrisAbove));
+				if(cost < minCost)
+				{
+					minCost = cost;
+					bestAxis = axis;
+					bestOffset = j;
+				}
+			}
+
+			if(boundEdges[axis][j].start)
+				numTrisBelow++;
+		}
+
+		//exit if any good split was found
+		if(bestAxis >= 0)
+			break;
+	}
+
+	//determine if we should split:
+	//---------------
+	float leafCost = costs.isect * num_tests(numTris);
+
+	//TODO: better heuristic on whether to split/not split?
+	if(bestAxis == -1 || minCost > leafCost)
+		return make_leaf();
+	
+	//classify references as above and/or below split:
+	//---------------
+	const std::vector<KDtreeBoundEdge>& splitEdges = boundEdges[bestAxis];
+
+	for(uint32_t i = 0; i < numTris; i++)
+		refSides[nodeRefs[i]] = 0;
+
+	for(uint32_t i = 0; i < (uint32_t)bestOffset; i++)
+		if(splitEdges[i].start)
+			refSides[splitEdges[i].ref] |= FR_MESH_KDTREE_SIDE_BELOW;
+
+	for(uint32_t i = bestOffset + 1; i < 2 * numTris; i++)
+		if(!splitEdges[i].start)
+			refSides[splitEdges[i].ref] |= FR_MESH_KDTREE_SIDE_ABOVE;
+
+	float splitPos = splitEdges[bestOffset].pos;
+
+	bound3 belowBounds = bounds;
+	bound3 aboveBounds = bounds;
+	belowBounds.max[bestAxis] = aboveBounds.min[bestAxis] = splitPos;
+
+	//clip references straddling the split to each child, they may turn out to only touch one of them:
+	//---------------
+	std::vector<KDtreeBoundEdge> clippedEdgesBelow[3];
+	std::vector<KDtreeBoundEdge> clippedEdgesAbove[3];
+
+	auto clip_ref = [&](uint32_t ref, const bound3& childBounds, std::vector<KDtreeBoundEdge> clippedEdges[3]) -> bool {
+		bound3 box = { max(childBounds.min, refs.bounds[ref].min), min(childBounds.max, refs.bounds[ref].max) };
+
+		bound3 clipped;
+		if(!clip_tri_bounds(refs.tris[ref], box, clipped))
+			return false;
+
+		for(uint32_t axis = 0; axis < 3; axis++)
+		{
+			clippedEdges[axis].push_back({ref, clipped.min[axis], true});
+			clippedEdges[axis].push_back({ref, clipped.max[axis], false});
+		}
+
+		return true;
+	};
+
+	std::vector<uint32_t> refsBelow;
+	std::vector<uint32_t> refsAbove;
+	for(uint32_t i = 0; i < numTris; i++)
+	{
+		uint32_t ref = nodeRefs[i];
+		uint8_t& sides = refSides[ref];
+
+		//ends sort before starts, so a reference lying flat in the split plane is on neither side
+		if(sides == 0)
+			sides = FR_MESH_KDTREE_SIDE_BELOW;
+		else if(sides == (FR_MESH_KDTREE_SIDE_BELOW | FR_MESH_KDTREE_SIDE_ABOVE))
+		{
+			sides = FR_MESH_KDTREE_SIDE_CLIPPED;
+			if(clip_ref(ref, belowBounds, clippedEdgesBelow))
+				sides |= FR_MESH_KDTREE_SIDE_BELOW;
+			if(clip_ref(ref, aboveBounds, clippedEdgesAbove))
+				sides |= FR_MESH_KDTREE_SIDE_ABOVE;
+		}
+
+		if(sides & FR_MESH_KDTREE_SIDE_BELOW)
+			refsBelow.push_back(ref);
+		if(sides & FR_MESH_KDTREE_SIDE_ABOVE)
+			refsAbove.push_back(ref);
+	}
+
+	std::vector<uint32_t>().swap(nodeRefs);
+
+	//split sorted edge lists between children, merging in the clipped edges, free ours:
+	//---------------
+	std::vector<KDtreeBoundEdge> boundEdgesBelow[3];
+	std::vector<KDtreeBoundEdge> boundEdgesAbove[3];
+
+	auto merge_clipped = [](std::vector<KDtreeBoundEdge>& edges, std::vector<KDtreeBoundEdge>& clippedEdges) {
+		if(clippedEdges.empty())
+			return;
+
+		std::sort(clippedEdges.begin(), clippedEdges.end());
+
+		std::vector<KDtreeBoundEdge> merged(edges.size() + clippedEdges.size());
+		std::merge(edges.begin(), edges.end(), clippedEdges.begin(), clippedEdges.end(), merged.begin());
+		edges.swap(merged);
+	};
+
+	for(uint32_t axis = 0; axis < 3; axis++)
+	{
+		boundEdgesBelow[axis].reserve(2 * refsBelow.size());
+		boundEdgesAbove[axis].reserve(2 * refsAbove.size());
+
+		for(uint32_t i = 0; i < 2 * numTris; i++)
+		{
+			const KDtreeBoundEdge& edge = boundEdges[axis][i];
+			uint8_t sides = refSides[edge.ref];
+			if(sides & FR_MESH_KDTREE_SIDE_CLIPPED)
+				continue;
+
+			if(sides & FR_MESH_KDTREE_SIDE_BELOW)
+				boundEdgesBelow[axis].push_back(edge);
+			if(sides & FR_MESH_KDTREE_SIDE_ABOVE)
+				boundEdgesAbove[axis].push_back(edge);
+		}
+
+		std::vector<KDtreeBoundEdge>().swap(boundEdges[axis]);
+
+		merge_clipped(boundEdgesBelow[axis], clippedEdgesBelow[axis]);
+		merge_clipped(boundEdgesAbove[axis], clippedEdgesAbove[axis]);
+	}
+
+	//recursively build:
+	//---------------
+	node->leaf = false;
+	node->axis = bestAxis;
+	node->split = splitPos;
+
+	if(spawnDepth > 0 && numTris >= FR_MESH_KDTREE_PARALLEL_MIN_TRIS)
+	{
+		//build the above subtree on a new thread, with its own arena and scratch memory
+		KDtreeBuildArena& aboveArena = *arena.children.emplace_back(std::make_unique<KDtreeBuildArena>());
+		std::thread aboveThread([&]() {
+			std::vector<uint8_t> aboveRefSides(refSides.size());
+			node->children[1] = kdtree_build_recursive(
+				aboveArena, aboveBounds, refs, refsAbove, boundEdgesAbove, depth - 1, spawnDepth - 1, aboveRefSides
+			);
+		});
+
+		node->children[0] = kdtree_build_recursive(
+			arena, belowBounds, refs, refsBelow, boundEdgesBelow, depth - 1, spawnDepth - 1, refSides
+		);
+
+		aboveThread.join();
+	}
+	else
+	{
+		node->children[0] = kdtree_build_recursive(
+			arena, belowBounds, refs, refsBelow, boundEdgesBelow, depth - 1, 0, refSides
+		);
+		node->children[1] = kdtree_build_recursive(
+			arena, aboveBounds, refs, refsAbove, boundEdgesAbove, depth - 1, 0, refSides
+		);
+	}
+
+	return node;
+}
+
+void Mesh::kdtree_flatten(const KDtreeBuildNode* root)
+{
+	//sibling pairs are grouped into treelets that fill a cache line: starting from a pair whose parent is already placed,
+	//its descendants are added breadth first until the line is full. the pairs that dont fit start new treelets, which are
+	//placed depth first so whole subtrees also stay close together. the root is followed by a padding node to keep pairs aligned
+	//---------------
+	m_kdTree.resize(2);
+	m_kdTree[1].init_leaf(0, 0);
+
+	if(root->leaf)
+	{
+		m_kdTree[0].init_leaf((uint32_t)root->tris.size(), pack_tri_blocks((uint32_t)root->tris.size(), root->tris.data()));
+		return;
+	}
+
+	struct KDtreePendingPair
+	{
+		const KDtreeBuildNode* parent;
+		uint32_t parentIdx;
+	};
+
+	std::vector<KDtreePendingPair> treeletRoots = { { root, 0 } };
+	std::deque<KDtreePendingPair> treelet;
+	std::vector<KDtreePendingPair> leftover;
+
+	while(!treeletRoots.empty())
+	{
+		treelet.push_back(treeletRoots.back());
+		treeletRoots.pop_back();
+
+		//fill the rest of the current line, or a new one if it is full:
+		//---------------
+		uint32_t pairsLeft = (uint32_t)((m_kdTree.size() % (2 * FR_MESH_KDTREE_PAIRS_PER_LINE)) / 2);
+		pairsLeft = pairsLeft == 0 ? FR_MESH_KDTREE_PAIRS_PER_LINE : FR_MESH_KDTREE_PAIRS_PER_LINE - pairsLeft;
+
+		while(!treelet.empty())
+		{
+			KDtreePendingPair pair = treelet.front();
+			treelet.pop_front();
+
+			if(pairsLeft == 0)
+			{
+				leftover.push_back(pair);
+				continue;
+			}
+
+			pairsLeft--;
+
+			uint32_t childrenIdx = (uint32_t)m_kdTree.size();
+			m_kdTree.resize(childrenIdx + 2);
+			m_kdTree[pair.parentIdx].init_interior(pair.parent->axis, childrenIdx, pair.parent->split);
+
+			for(uint32_t i = 0; i < 2; i++)
+			{
+				const KDtreeBuildNode* child = pair.parent->children[i];
+				if(child->leaf)
+					m_kdTree[childrenIdx + i].init_leaf((uint32_t)child->tris.size(), pack_tri_blocks((uint32_t)child->tris.size(), child->tris.data()));
+				else
+					treelet.push_back({ child, childrenIdx + i });
+			}
+		}
+
+		//reversed so the first leftover pair is placed next:
+		for(auto it = leftover.rbegin(); it != leftover.rend(); it++)
+			treeletRoots.push_back(*it);
+		leftover.clear();
+	}
+}
+
+uint64_t Mesh::kdtree_cache_key() const
+{
+	//64-bit FNV-1a over 32-bit words:
+	//---------------
+	uint64_t hash = 0xCBF29CE484222325ull;
+	auto hash_word = [&](uint32_t word) {
+		hash ^= word;
+		hash *= 0x100000001B3ull;
+	};
+	auto hash_float = [&](float f) {
+		uint32_t word;
+		memcpy(&word, &f, sizeof(float));
+		hash_word(word);
+	};
+
+	//build parameters + layout:
+	//---------------
+	hash_word(FR_MESH_KDTREE_CACHE_VERSION);
+	hash_word((uint32_t)sizeof(KDtreeNode));
+	hash_word((uint32_t)sizeof(TriangleBlockSIMD));
+	const KDtreeCosts& costs = kdtree_costs();
+	hash_word(costs.maxTrisPerLeaf);
+	hash_float(costs.traversal);
+	hash_float(costs.isect);
+	hash_float(costs.emptyBonus);
+	hash_float(FR_MESH_KDTREE_CLIP_EPSILON);
+	hash_float(FR_MESH_KDTREE_EARLY_SPLIT_RATIO);
+	hash_word(FR_MESH_KDTREE_EARLY_SPLIT_MAX_DEPTH);
+
+	//indices + positions:
+	//---------------
+	hash_word(m_numTris);
+	for(uint32_t i = 0; i < m_numTris * 3; i++)
+	{
+		hash_word(m_indexView[i]);
+
+		vec3 pos = vert_pos_at(m_indexView[i]);
+		hash_float(pos.x);
+		hash_float(pos.y);
+		hash_float(pos.z);
+	}
+
+	//opacity classes decide which triangles are in the tree:
+	//---------------
+	for(uint32_t i = 0; i < m_triOpacity.size(); i++)
+		hash_word(m_triOpacity[i]);
+
+	return hash;
+}
+
+bool Mesh::kdtree_cache_load(uint64_t key)
+{
+	std::stringstream fileName;
+	fileName << std::hex << std::setw(16) << std::setfill('0') << key << ".kdtree";
+
+	std::ifstream file(std::filesystem::path(m_kdTreeCacheDir) / fileName.str(), std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	//validate header, anything unexpected is treated as a miss and rebuilt:
+	//---------------
+	KDtreeCacheHeader header;
+	if(!file.read(reinterpret_cast<char*>(&header), sizeof(KDtreeCacheHeader)))
+		return false;
+
+	if(header.magic != FR_MESH_KDTREE_CACHE_MAGIC || header.version != FR_MESH_KDTREE_CACHE_VERSION || 
+	   header.key != key || header.numTris != m_numTris || header.numNodes == 0)
+		return false;
+
+	//read tree:
+	//---------------
+	std::vector<KDtreeNode, AlignedAllocator<KDtreeNode, FR_CACHE_LINE_SIZE>> nodes(header.numNodes);
+	std::vector<TriangleBlockSIMD> triBlocks(header.numTriBlocks);
+
+	if(!file.read(reinterpret_cast<char*>(nodes.data()), nodes.size() * sizeof(KDtreeNode)) ||
+	   !file.read(reinterpret_cast<char*>(triBlocks.data()), triBlocks.size() * sizeof(TriangleBlockSIMD)))
+		return false;
+
+	if(kdtree_cache_checksum(nodes, triBlocks) != header.checksum)
+		return false;
+
+	//validate indices, so a corrupt file can never make traversal read out of bounds:
+	//---------------
+	for(uint32_t i = 0; i < header.numNodes; i++)
+	{
+		const KDtreeNode& node = nodes[i];
+		if(node.is_leaf())
+		{
+			uint64_t endBlock = (uint64_t)node.get_tri_blocks_offset() + (node.get_num_tris() + 7) / 8;
+			if(endBlock > header.numTriBlocks)
+				return false;
+		}
+		else if((uint64_t)node.get_above_child_idx() >= header.numNodes)
+			return false;
+	}
+
+	for(const TriangleBlockSIMD& block : triBlocks)
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		if(block.triIdx[i] != UINT32_MAX && block.triIdx[i] >= m_numTris)
+			return false;
+	}
+
+	m_kdTree = std::move(nodes);
+	m_triBlocks = std::move(triBlocks);
+	m_treeBounds = header.bounds;
+
+	return true;
+}
+
+void Mesh::kdtree_cache_save(uint64_t key) const
+{
+	std::stringstream fileName;
+	fileName << std::hex << std::setw(16) << std::setfill('0') << key << ".kdtree";
+
+	std::error_code error;
+	std::filesystem::create_directories(m_kdTreeCacheDir, error);
+
+	//write to a temporary file first, so concurrent renders never see a partial tree:
+	//---------------
+	std::filesystem::path path = std::filesystem::path(m_kdTreeCacheDir) / fileName.str();
+	std::filesystem::path tempPath = path;
+	tempPath += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "." + std::to_string(std::random_device{}()) + ".tmp";
+
+	KDtreeCacheHeader header;
+	header.magic = FR_MESH_KDTREE_CACHE_MAGIC;
+	header.version = FR_MESH_KDTREE_CACHE_VERSION;
+	header.key = key;
+	header.numTris = m_numTris;
+	header.numNodes = (uint32_t)m_kdTree.size();
+	header.numTriBlocks = (uint32_t)m_triBlocks.size();
+	header.bounds = m_treeBounds;
+	header.checksum = kdtree_cache_checksum(m_kdTree, m_triBlocks);
+
+	{
+		std::ofstream file(tempPath, std::ios::binary);
+		if(!file.is_open())
+		{
+			std::cout << "WARNING: failed to write kd tree cache file \"" << tempPath.string() << "\"" << std::endl;
+			return;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(KDtreeCacheHeader));
+		file.write(reinterpret_cast<const char*>(m_kdTree.data()), m_kdTree.size() * sizeof(KDtreeNode));
+		file.write(reinterpret_cast<const char*>(m_triBlocks.data()), m_triBlocks.size() * sizeof(TriangleBlockSIMD));
+	}
 
-	vec3 tvec = ray.origin() - v0;
-	u = dot(tvec, pvec) * invDet;
+	std::filesystem::rename(tempPath, path, error);
+	if(error)
+		std::filesystem::remove(tempPath, error);
+}
 
-	vec3 qvec = cross(tvec, v0v1);
-	v = dot(ray.direction(), qvec) * invDet;
+uint64_t Mesh::kdtree_cache_checksum(const std::vector<KDtreeNode, AlignedAllocator<KDtreeNode, FR_CACHE_LINE_SIZE>>& nodes, 
+                                     const std::vector<TriangleBlockSIMD>& triBlocks)
+{
+	//64-bit FNV-1a over the raw bytes:
+	//---------------
+	uint64_t hash = 0xCBF29CE484222325ull;
+	auto hash_bytes = [&](const void* data, size_t size) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		for(size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001B3ull;
+		}
+	};
 
-	t = dot(v0v2, qvec) * invDet;
+	hash_bytes(nodes.data(), nodes.size() * sizeof(KDtreeNode));
+	hash_bytes(triBlocks.data(), triBlocks.size() * sizeof(TriangleBlockSIMD));
+
+	return hash;
 }
 
-void Mesh::vert_attribs_setup()
+Mesh::KDtreeCosts Mesh::calibrate_kdtree_costs(bool force)
 {
-	//vertices must have a position, or the mesh isnt renderable:
-	//---------------
-	if((m_vertAttribs & VERTEX_ATTRIB_POSITION) == 0)
-		throw std::runtime_error("vertices MUST contain the POSITION attribute" );
+	KDtreeCosts costs = kdtree_default_costs();
+	if(!force && kdtree_costs_load(costs))
+	{
+		kdtree_costs() = costs;
+		return costs;
+	}
 
-	//calculate stride:
+	//generate a complete tree over the unit cube with random splits, children of node i are at 2i + 1 and 2i + 2:
 	//---------------
-	if(m_vertStride == UINT32_MAX)
+	Mesh mesh;
+	mesh.m_treeBounds = { vec3(0.0f), vec3(1.0f) };
+
+	uint32_t numInterior = (1u << FR_MESH_KDTREE_CALIBRATION_DEPTH) - 1;
+	mesh.m_kdTree.resize(2 * numInterior + 1);
+
+	uint32_t seed = 1;
+	auto rand_float = [&]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (float)(seed >> 8) / 16777216.0f;
+	};
+
+	std::vector<bound3> nodeBounds(mesh.m_kdTree.size());
+	nodeBounds[0] = mesh.m_treeBounds;
+	for(uint32_t i = 0; i < mesh.m_kdTree.size(); i++)
 	{
-		m_vertStride = 0;
+		//leaves remember their own index, so the visited nodes can be recovered
+		if(i >= numInterior)
+		{
+			mesh.m_kdTree[i].init_leaf(0, i);
+			continue;
+		}
 
-		if((m_vertAttribs & VERTEX_ATTRIB_POSITION) != 0)
-			m_vertStride += 3;
-		if((m_vertAttribs & VERTEX_ATTRIB_UV) != 0)
-			m_vertStride += 2;
-		if((m_vertAttribs & VERTEX_ATTRIB_NORMAL) != 0)
-			m_vertStride += 3;
+		const bound3& bounds = nodeBounds[i];
+		vec3 d = bounds.max - bounds.min;
+		uint32_t axis = (d.x > d.y && d.x > d.z) ? 0 : (d.y > d.z ? 1 : 2);
+		float split = bounds.min[axis] + d[axis] * (0.3f + 0.4f * rand_float());
+
+		mesh.m_kdTree[i].init_interior(axis, 2 * i + 1, split);
+		nodeBounds[2 * i + 1] = nodeBounds[2 * i + 2] = bounds;
+		nodeBounds[2 * i + 1].max[axis] = nodeBounds[2 * i + 2].min[axis] = split;
 	}
 
-	//calculate position offset (assume it comes first):
+	//generate blocks of small random triangles, leaves are cut from them:
 	//---------------
-	if(m_vertPosOffset == UINT32_MAX)
-		m_vertPosOffset = 0;
+	mesh.m_triBlocks.resize(FR_MESH_KDTREE_CALIBRATION_BLOCKS);
+	for(TriangleBlockSIMD& block : mesh.m_triBlocks)
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		vec3 v0 = vec3(rand_float(), rand_float(), rand_float());
+		vec3 e1 = (vec3(rand_float(), rand_float(), rand_float()) - vec3(0.5f)) * 0.02f;
+		vec3 e2 = (vec3(rand_float(), rand_float(), rand_float()) - vec3(0.5f)) * 0.02f;
+
+		block.v0x[i] = v0.x; block.v0y[i] = v0.y; block.v0z[i] = v0.z;
+		block.e1x[i] = e1.x; block.e1y[i] = e1.y; block.e1z[i] = e1.z;
+		block.e2x[i] = e2.x; block.e2y[i] = e2.y; block.e2z[i] = e2.z;
+		block.triIdx[i] = 0;
+	}
 
-	//calculate uv offset (assume it comes directly after position):
+	uint32_t numNodes = (uint32_t)mesh.m_kdTree.size();
+	mesh.move_to_arena(); //same memory layout as real meshes
+
+	std::vector<Ray> rays(FR_MESH_KDTREE_CALIBRATION_RAYS);
+	for(Ray& ray : rays)
+	{
+		vec3 orig = vec3(rand_float(), rand_float(), rand_float());
+		vec3 dir = normalize(vec3(rand_float(), rand_float(), rand_float()) - vec3(0.5f));
+		ray = Ray(orig, dir);
+	}
+
+	//count node visits, every ancestor of a visited leaf is visited exactly once:
 	//---------------
-	if(m_vertUvOffset == UINT32_MAX)
+	uint64_t numVisits = 0;
+	std::vector<uint32_t> visitedBy(numNodes, UINT32_MAX);
+	for(uint32_t i = 0; i < rays.size(); i++)
 	{
-		m_vertUvOffset = 0;
+		float tMax = INFINITY;
+		mesh.kdtree_traverse(rays[i], tMax, [&](uint32_t leafIdx, uint32_t, float) {
+			for(uint32_t node = leafIdx; visitedBy[node] != i; node = (node - 1) / 2)
+			{
+				visitedBy[node] = i;
+				numVisits++;
+				if(node == 0)
+					break;
+			}
 
-		if((m_vertAttribs & VERTEX_ATTRIB_POSITION) != 0)
-			m_vertUvOffset += 3;
+			return false;
+		});
 	}
 
-	//calculate normal offset (assume it comes after position and uv):
+	//time traversal and leaf tests, taking the fastest of several runs:
 	//---------------
-	if(m_vertNormalOffset == UINT32_MAX)
+	uint32_t testWidth = get_intersection_kernels().trisPerTest;
+	uint32_t testBlocks = testWidth / 8;
+
+	double traversalTime = INFINITY;
+	double isectTime = INFINITY;
+	uint64_t numLeaves = 0;
+	for(uint32_t run = 0; run < FR_MESH_KDTREE_CALIBRATION_RUNS; run++)
 	{
-		m_vertNormalOffset = 0;
+		auto startTime = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < rays.size(); i++)
+		{
+			float tMax = INFINITY;
+			mesh.kdtree_traverse(rays[i], tMax, [&](uint32_t, uint32_t, float) {
+				numLeaves++;
+				return false;
+			});
+		}
 
-		if((m_vertAttribs & VERTEX_ATTRIB_POSITION) != 0)
-			m_vertNormalOffset += 3;
-		if((m_vertAttribs & VERTEX_ATTRIB_UV) != 0)
-			m_vertNormalOffset += 2;
+		auto midTime = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < rays.size(); i++)
+		{
+			float tMin = INFINITY;
+			uint32_t triIdx;
+			float b0, b1;
+			uint32_t blocksOffset = (i * testBlocks) % (FR_MESH_KDTREE_CALIBRATION_BLOCKS - testBlocks + 1);
+			mesh.intersect_tri_blocks(blocksOffset, testWidth, rays[i], nullptr, tMin, triIdx, b0, b1);
+		}
+
+		auto endTime = std::chrono::steady_clock::now();
+		traversalTime = std::min(traversalTime, std::chrono::duration<double>(midTime - startTime).count());
+		isectTime = std::min(isectTime, std::chrono::duration<double>(endTime - midTime).count());
 	}
-}
 
-//-------------------------------------------//
+	if(numVisits == 0 || numLeaves == 0)
+	{
+		std::cout << "WARNING: kd tree cost calibration visited no nodes, keeping the defaults" << std::endl;
+		return kdtree_costs();
+	}
+
+	//costs are relative to a node visit:
+	//---------------
+	double visitTime = traversalTime / (double)numVisits;
+	double testTime = isectTime / (double)rays.size();
 
-void Mesh::KDtreeNode::init_interior(uint32_t axis, uint32_t _aboveChildIdx, float splitPos)
+	costs.traversal = 1.0f;
+	costs.isect = (float)(testTime / visitTime);
+	costs.maxTrisPerLeaf = testWidth;
+
+	log_verbose("calibrated kd tree costs: node visit ", visitTime * 1e9, "ns, ", testWidth, " triangle test ", 
+	            testTime * 1e9, "ns, isect cost ", costs.isect);
+
+	kdtree_costs() = costs;
+	kdtree_costs_save(costs);
+	return costs;
+}
+
+Mesh::KDtreeCosts& Mesh::kdtree_costs()
 {
-	flags = axis;
-	split = splitPos;
-	aboveChildIdx |= (_aboveChildIdx << 2);
+	static KDtreeCosts costs = kdtree_default_costs();
+	return costs;
 }
 
-void Mesh::KDtreeNode::init_leaf(uint32_t _numTris, uint32_t* tris, std::vector<uint32_t>& triIndices)
+Mesh::KDtreeCosts Mesh::kdtree_default_costs()
 {
-	flags = 3;
-	numTris |= (_numTris << 2);
+	KDtreeCosts costs;
+	costs.traversal = FR_MESH_KDTREE_TRAVERSAL_COST;
+	costs.isect = FR_MESH_KDTREE_ISECT_COST;
+	costs.emptyBonus = FR_MESH_KDTREE_EMPTY_BONUS;
+	costs.maxTrisPerLeaf = get_intersection_kernels().trisPerTest;
 
-	triIndicesOffset = (uint32_t)triIndices.size();
-	for(uint32_t i = 0; i < _numTris; i++)
-		triIndices.push_back(tris[i]);
+	return costs;
 }
 
-void Mesh::kdtree_build()
+std::string Mesh::kdtree_costs_file_name()
 {
-	//compute heuristic for maximum tree depth:
+	//64-bit FNV-1a over the cpu's brand string:
 	//---------------
-	uint32_t maxDepth = (uint32_t)std::roundf(8.0f + 1.3f * std::log2f((float)m_numTris));
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for(const char* c = get_cpu_name(); *c != '\0'; c++)
+	{
+		hash ^= (uint8_t)*c;
+		hash *= 0x100000001B3ull;
+	}
 
-	//compute bounds for each triangle:
+	std::stringstream fileName;
+	fileName << FR_MESH_KDTREE_COSTS_FILE_PREFIX << std::hex << std::setw(16) << std::setfill('0') << hash << ".txt";
+	return fileName.str();
+}
+
+bool Mesh::kdtree_costs_load(KDtreeCosts& costs)
+{
+	if(m_kdTreeCacheDir.empty())
+		return false;
+
+	std::ifstream file(std::filesystem::path(m_kdTreeCacheDir) / kdtree_costs_file_name());
+	if(!file.is_open())
+		return false;
+
+	//costs measured on a different cpu or at a different SIMD level are stale, the name guards against hash collisions:
 	//---------------
-	std::vector<bound3> triBounds(m_numTris);
-	bound3 bounds;
+	std::string cpuName;
+	uint32_t level;
+	KDtreeCosts loaded;
+	if(!std::getline(file, cpuName) || 
+	   !(file >> level >> loaded.traversal >> loaded.isect >> loaded.emptyBonus >> loaded.maxTrisPerLeaf))
+		return false;
 
-	for(uint32_t i = 0; i < m_numTris; i++)
-	{
-		uint32_t triIdx = i * 3;
-		uint32_t idx0 = m_indices[triIdx + 0] * m_vertStride;
-		uint32_t idx1 = m_indices[triIdx + 1] * m_vertStride;
-		uint32_t idx2 = m_indices[triIdx + 2] * m_vertStride;
+	if(cpuName != get_cpu_name() || level != (uint32_t)get_simd_level() || loaded.maxTrisPerLeaf == 0)
+		return false;
 
-		const vec3& v0 = *reinterpret_cast<const vec3*>(&m_verts.get()[idx0 + m_vertPosOffset]);
-		const vec3& v1 = *reinterpret_cast<const vec3*>(&m_verts.get()[idx1 + m_vertPosOffset]);
-		const vec3& v2 = *reinterpret_cast<const vec3*>(&m_verts.get()[idx2 + m_vertPosOffset]);
+	costs = loaded;
+	return true;
+}
+
+void Mesh::kdtree_costs_save(const KDtreeCosts& costs)
+{
+	if(m_kdTreeCacheDir.empty())
+		return;
 
-		vec3 triMin = min(min(v0, v1), v2);
-		vec3 triMax = max(max(v0, v1), v2);
+	std::error_code error;
+	std::filesystem::create_directories(m_kdTreeCacheDir, error);
 
-		triBounds[i] = { triMin, triMax };
-		bounds.min = min(bounds.min, triMin);
-		bounds.max = max(bounds.max, triMax);
+	std::ofstream file(std::filesystem::path(m_kdTreeCacheDir) / kdtree_costs_file_name());
+	if(!file.is_open())
+	{
+		std::cout << "WARNING: failed to write kd tree costs to \"" << m_kdTreeCacheDir << "\"" << std::endl;
+		return;
 	}
 
-	m_kdTreeBounds = bounds;
+	file << get_cpu_name() << std::endl;
+	file << (uint32_t)get_simd_level() << " " << costs.traversal << " " << costs.isect << " " << costs.emptyBonus << " " 
+	     << costs.maxTrisPerLeaf << std::endl;
+}
 
-	//allocate scratch mem:
-	//---------------
-	std::unique_ptr<KDtreeBoundEdge[]> scratchBufBoundEdges[3];
-	for(uint32_t i = 0; i < 3; i++)
-		scratchBufBoundEdges[i] = std::unique_ptr<KDtreeBoundEdge[]>(new KDtreeBoundEdge[m_numTris * 2]);
+//-------------------------------------------//
 
-	std::unique_ptr<uint32_t[]> scratchBufTrisBelow(new uint32_t[m_numTris]);
-	std::unique_ptr<uint32_t[]> scratchBufTrisAbove(new uint32_t[(maxDepth + 1) * m_numTris]);
+void Mesh::bvh_build()
+{
+	auto startTime = std::chrono::steady_clock::now();
 
-	//begin recursive build:
+	//compute bounds for each triangle:
 	//---------------
-	for(uint32_t i = 0; i < m_numTris; i++)
-		scratchBufTrisBelow[i] = i;
+	std::vector<bound3> triBounds = compute_tri_bounds();
 
-	uint32_t treeSize = 0;
-	uint32_t treeNextFree = 0;
+	//build binary tree with binned SAH, fully transparent triangles are left out:
+	//---------------
+	std::vector<uint32_t> tris = get_build_tris();
 
-	kdtree_build_recursive(
-		0, &treeSize, &treeNextFree, bounds, triBounds, m_numTris, scratchBufTrisBelow.get(), maxDepth,
-		scratchBufBoundEdges, scratchBufTrisBelow.get(), scratchBufTrisAbove.get()
-	);
-}
+	std::deque<BVHbuildNode> arena;
+	BVHbuildNode* root = bvh_build_recursive(arena, triBounds, tris.data(), (uint32_t)tris.size(), 0);
 
-void Mesh::kdtree_build_recursive(uint32_t idx, uint32_t* treeSize, uint32_t* treeNextFree,
-                                   const bound3& bounds, const std::vector<bound3>& triBounds, 
-                                   uint32_t numTris, uint32_t* tris, uint32_t depth, 
-                                   const std::unique_ptr<KDtreeBoundEdge[]> boundEdges[3],
-                                   uint32_t* trisBelow, uint32_t* trisAbove)
-{
-	//resize tree if needed:
+	m_treeBounds = root->bounds;
+
+	//collapse into wide nodes:
 	//---------------
-	if(*treeNextFree >= *treeSize)
+	m_triBlocks.clear();
+
+	size_t memory;
+	uint32_t numNodes;
+	if(m_accelerator == MESH_ACCELERATOR_BVH4)
 	{
-		uint32_t newTreeSize = std::max(2 * (*treeSize), 256u);
-		std::unique_ptr<KDtreeNode[]> newTree = std::unique_ptr<KDtreeNode[]>(new KDtreeNode[newTreeSize]);
+		bvh_flatten(root, m_bvh4);
+		numNodes = (uint32_t)m_bvh4.size();
+		memory = m_bvh4.size() * sizeof(BVHwideNode<4>);
+	}
+	else
+	{
+		bvh_flatten(root, m_bvh8);
+		numNodes = (uint32_t)m_bvh8.size();
+		memory = m_bvh8.size() * sizeof(BVHwideNode<8>);
+	}
 
-		if(*treeSize > 0) 
-			std::memcpy(newTree.get(), m_kdTree.get(), (*treeSize) * sizeof(KDtreeNode));
+	memory += m_triBlocks.size() * sizeof(TriangleBlockSIMD);
 
-		m_kdTree = std::move(newTree);
-		*treeSize = newTreeSize;
-	}
+	float buildTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	log_verbose("built bvh", (m_accelerator == MESH_ACCELERATOR_BVH4 ? 4 : 8), " for mesh \"", m_material, "\" (", 
+	            m_numTris, " tris, ", numNodes, " nodes, ", memory / 1024, "KB) in ", buildTime, "ms");
+}
 
-	(*treeNextFree)++;
+Mesh::BVHbuildNode* Mesh::bvh_build_recursive(std::deque<BVHbuildNode>& arena, const std::vector<bound3>& triBounds, 
+                                              uint32_t* tris, uint32_t numTris, uint32_t depth) const
+{
+	BVHbuildNode* node = &arena.emplace_back();
+	node->children[0] = node->children[1] = nullptr;
 
-	//stop recursion if at max depth or max tris:
+	//compute bounds of triangles + their centroids:
 	//---------------
-	if(numTris <= FR_MESH_KDTREE_MAX_TRIS_PER_NODE || depth == 0)
+	bound3 bounds = { vec3(INFINITY), vec3(-INFINITY) };
+	bound3 centroidBounds = { vec3(INFINITY), vec3(-INFINITY) };
+
+	for(uint32_t i = 0; i < numTris; i++)
 	{
-		m_kdTree[idx].init_leaf(numTris, tris, m_kdTreeTriIndices);
-		return;
+		const bound3& b = triBounds[tris[i]];
+		bounds.min = min(bounds.min, b.min);
+		bounds.max = max(bounds.max, b.max);
+
+		vec3 centroid = 0.5f * (b.min + b.max);
+		centroidBounds.min = min(centroidBounds.min, centroid);
+		centroidBounds.max = max(centroidBounds.max, centroid);
 	}
 
-	//find split axis + position:
+	node->bounds = bounds;
+
+	//find split axis + bucket with SAH:
 	//---------------
 	int32_t bestAxis = -1;
-	int32_t bestOffset = -1;
+	uint32_t bestBucket = 0;
 	float minCost = INFINITY;
 
+	vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
 	vec3 d = bounds.max - bounds.min;
-	float totalSA = 2.0f * (d.x * d.y + d.x * d.z + d.y * d.z);
-	float invTotalSA = 1.0f / totalSA;
+	float invTotalSA = 1.0f / (2.0f * (d.x * d.y + d.x * d.z + d.y * d.z));
 
-	uint32_t axes[3];
-	if(d.x > d.y)
-	{
-		if(d.x > d.z)
-		{
-			axes[0] = 0;
-			axes[1] = (d.y > d.z) ? 1 : 2;
-			axes[2] = (d.y > d.z) ? 2 : 1;
-		}
-		else
-		{
-			axes[0] = 2;
-			axes[1] = (d.x > d.y) ? 0 : 1;
-			axes[2] = (d.x > d.y) ? 1 : 0;
-		}
-	}
-	else
-	{
-		if(d.y > d.z)
-		{
-			axes[0] = 1;
-			axes[1] = (d.x > d.z) ? 0 : 2;
-			axes[2] = (d.x > d.z) ? 2 : 0;
-		}
-		else
-		{
-			axes[0] = 2;
-			axes[1] = (d.x > d.y) ? 0 : 1;
-			axes[2] = (d.x > d.y) ? 1 : 0;
-		}
-	}
+	auto get_bucket = [&](uint32_t tri, uint32_t axis) -> uint32_t {
+		float centroid = 0.5f * (triBounds[tri].min[axis] + triBounds[tri].max[axis]);
+		float offset = (centroid - centroidBounds.min[axis]) / centroidExtent[axis];
+		return std::min((uint32_t)(offset * FR_MESH_BVH_NUM_BUCKETS), (uint32_t)FR_MESH_BVH_NUM_BUCKETS - 1);
+	};
 
-	for(uint32_t i = 0; i < 3; i++)
+	auto surface_area = [](const bound3& b) -> float {
+		vec3 d = b.max - b.min;
+		return 2.0f * (d.x * d.y + d.x * d.z + d.y * d.z);
+	};
+
+	for(uint32_t axis = 0; axis < 3 && numTris > 1 && depth < FR_MESH_BVH_MAX_DEPTH; axis++)
 	{
-		uint32_t axis = axes[i];
+		if(centroidExtent[axis] <= 0.0f)
+			continue;
+
+		//sort triangles into buckets
+		struct Bucket
+		{
+			uint32_t count = 0;
+			bound3 bounds = { vec3(INFINITY), vec3(-INFINITY) };
+		} buckets[FR_MESH_BVH_NUM_BUCKETS];
 
-		//init bound edges
-		for(uint32_t j = 0; j < numTris; j++)
+		for(uint32_t i = 0; i < numTris; i++)
 		{
-			uint32_t tri = tris[j];
-			const bound3& b = triBounds[tri];
+			uint32_t b = get_bucket(tris[i], axis);
 
-			boundEdges[axis][2 * j    ] = {tri, b.min[axis], true};
-			boundEdges[axis][2 * j + 1] = {tri, b.max[axis], false};
+			buckets[b].count++;
+			buckets[b].bounds.min = min(buckets[b].bounds.min, triBounds[tris[i]].min);
+			buckets[b].bounds.max = max(buckets[b].bounds.max, triBounds[tris[i]].max);
 		}
 
-		std::sort(&boundEdges[axis][0], &boundEdges[axis][2 * numTris],
-			[](const KDtreeBoundEdge &e0, const KDtreeBoundEdge &e1) -> bool {
-				if(e0.pos == e1.pos)
-				{
-					if(e0.start == e1.start)
-						return e0.tri < e1.tri;
-					else
-						return (int)e0.start < (int)e1.start;
-				}
-				else 
-					return e0.pos < e1.pos; 
-			}
-		);
+		//sweep from above to get the cost of every split in linear time
+		float aboveCost[FR_MESH_BVH_NUM_BUCKETS];
+		bound3 aboveBounds = { vec3(INFINITY), vec3(-INFINITY) };
+		uint32_t numAbove = 0;
+		for(uint32_t i = FR_MESH_BVH_NUM_BUCKETS - 1; i > 0; i--)
+		{
+			aboveBounds.min = min(aboveBounds.min, buckets[i].bounds.min);
+			aboveBounds.max = max(aboveBounds.max, buckets[i].bounds.max);
+			numAbove += buckets[i].count;
 
-		//compute cost at each potential split, find the best
-		uint32_t numTrisBelow = 0;
-		uint32_t numTrisAbove = numTris;
+			aboveCost[i - 1] = numAbove > 0 ? numAbove * surface_area(aboveBounds) : -1.0f;
+		}
 
-		for(uint32_t j = 0; j < 2 * numTris; j++)
+		bound3 belowBounds = { vec3(INFINITY), vec3(-INFINITY) };
+		uint32_t numBelow = 0;
+		for(uint32_t i = 0; i < FR_MESH_BVH_NUM_BUCKETS - 1; i++)
 		{
-			if(!boundEdges[axis][j].start)
-				numTrisAbove--;
-
-			float edgePos = boundEdges[axis][j].pos;
-			if(edgePos > bounds.min[axis] && edgePos < bounds.max[axis])
-			{
-				//get sa
-				uint32_t otherAxis1 = (axis + 1) % 3;
-				uint32_t otherAxis2 = (axis + 2) % 3;
-				float belowSA = 2 * (
-					d[otherAxis1] * d[otherAxis2] +
-				    (edgePos - bounds.min[axis]) * (d[otherAxis1] + d[otherAxis2])
-				);
-				float aboveSA = 2 * (
-					d[otherAxis1] * d[otherAxis2] +
-					(bounds.max[axis] - edgePos) * (d[otherAxis1] + d[otherAxis2])
-				);
+			belowBounds.min = min(belowBounds.min, buckets[i].bounds.min);
+			belowBounds.max = max(belowBounds.max, buckets[i].bounds.max);
+			numBelow += buckets[i].count;
 
-				//compute cost
-				float belowP = belowSA * invTotalSA;
-				float aboveP = aboveSA * invTotalSA;
-				float emptyBonus = (numTrisAbove == 0 || numTrisBelow == 0) ? FR_MESH_KDTREE_EMPTY_BONUS : 0.0f;
+			if(numBelow == 0 || aboveCost[i] < 0.0f)
+				continue;
 
-				float cost = FR_MESH_KDTREE_TRAVERSAL_COST + 
-					FR_MESH_KDTREE_ISECT_COST * (1.0f - emptyBonus) * (belowP * numTrisBelow + aboveP * numTrisAbove);
-				if(cost < minCost)
-				{
-					minCost = cost;
-					bestAxis = axis;
-					bestOffset = j;
-				}
+			float cost = FR_MESH_BVH_TRAVERSAL_COST + 
+				FR_MESH_BVH_ISECT_COST * (numBelow * surface_area(belowBounds) + aboveCost[i]) * invTotalSA;
+			if(cost < minCost)
+			{
+				minCost = cost;
+				bestAxis = axis;
+				bestBucket = i;
 			}
-
-			if(boundEdges[axis][j].start)
-				numTrisBelow++;
 		}
-
-		//exit if any good split was found
-		if(bestAxis >= 0)
-			break;
 	}
 
-	//determine if we should split:
+	//create leaf if no split was found, or if splitting isnt worth it:
 	//---------------
-	float leafCost = FR_MESH_KDTREE_ISECT_COST * (float)numTris;
+	float leafCost = FR_MESH_BVH_ISECT_COST * (float)numTris;
 
-	//TODO: better heuristic on whether to split/not split?
-	if(bestAxis == -1 || minCost > leafCost)
+	if(bestAxis == -1 || (numTris <= FR_MESH_BVH_MAX_TRIS_PER_LEAF && minCost >= leafCost))
 	{
-		m_kdTree[idx].init_leaf(numTris, tris, m_kdTreeTriIndices);
-		return;
+		node->tris.assign(tris, tris + numTris);
+		return node;
 	}
-	
-	//get triangles above and below split:
-	//---------------
-	uint32_t numTrisBelow = 0;
-	for(uint32_t i = 0; i < (uint32_t)bestOffset; i++)
-		if(boundEdges[bestAxis][i].start)
-			trisBelow[numTrisBelow++] = boundEdges[bestAxis][i].tri;
 
-	uint32_t numTrisAbove = 0;
-	for(uint32_t i = bestOffset + 1; i < 2 * numTris; i++)
-		if(!boundEdges[bestAxis][i].start)
-			trisAbove[numTrisAbove++] = boundEdges[bestAxis][i].tri;
-
-	//recursively build:
+	//partition triangles, recursively build:
 	//---------------
-	bound3 belowBounds = bounds;
-	bound3 aboveBounds = bounds;
-			
-	float splitPos = boundEdges[bestAxis][bestOffset].pos;
-	belowBounds.max[bestAxis] = aboveBounds.min[bestAxis] = splitPos;
-
-	uint32_t belowIdx = idx + 1;
-	kdtree_build_recursive(
-		belowIdx, treeSize, treeNextFree, belowBounds, triBounds, 
-		numTrisBelow, trisBelow, depth - 1, 
-		boundEdges, trisBelow, trisAbove + numTris
+	uint32_t* mid = std::partition(tris, tris + numTris,
+		[&](uint32_t tri) { return get_bucket(tri, bestAxis) <= bestBucket; }
 	);
+	uint32_t numTrisBelow = (uint32_t)(mid - tris);
 
-	uint32_t aboveIdx = *treeNextFree;
-	kdtree_build_recursive(
-		aboveIdx, treeSize, treeNextFree, aboveBounds, triBounds, 
-		numTrisAbove, trisAbove, depth - 1, 
-		boundEdges, trisBelow, trisAbove + numTris
-	);
+	node->children[0] = bvh_build_recursive(arena, triBounds, tris, numTrisBelow, depth + 1);
+	node->children[1] = bvh_build_recursive(arena, triBounds, mid, numTris - numTrisBelow, depth + 1);
 
-	//init node:
-	//---------------
-	m_kdTree[idx].init_interior(bestAxis, aboveIdx, splitPos);
+	return node;
 }
 
-bool Mesh::kdtree_intersect_leaf_node(const KDtreeNode* node, const Ray& ray, const std::shared_ptr<const Texture<float>>& alphaMask, 
-                                      float& tMin, uint32_t& minIdx0, uint32_t& minIdx1, uint32_t& minIdx2,
-                                      vec3& minV0, vec3& minV1, vec3& minV2, float& minB0, float& minB1) const
+template<uint32_t W>
+uint32_t Mesh::bvh_flatten(const BVHbuildNode* node, std::vector<BVHwideNode<W>>& nodes)
 {
-	bool hit = false;
-	
-	uint32_t numTris = node->get_num_tris();
-	uint32_t numBatches = numTris / 8;
-	uint32_t remainingTris = numTris % 8;
-
-	//process in batches of 4 with SIMD:
+	//collapse binary tree, opening the largest interior child until there are W children:
 	//---------------
-	for(uint32_t batch = 0; batch < numBatches; batch++) 
+	const BVHbuildNode* children[W];
+	uint32_t numChildren = 0;
+
+	if(node->children[0] == nullptr)
+		children[numChildren++] = node;
+	else
 	{
-		uint32_t baseIdx = batch * 8;
-		
-		vec3 v0[8], v1[8], v2[8];
-		uint32_t idx0[8], idx1[8], idx2[8];
-		
-		for(uint32_t i = 0; i < 8; i++) 
-		{
-			uint32_t triIdx = m_kdTreeTriIndices[node->get_tri_indices_offset() + baseIdx + i] * 3;
-			idx0[i] = m_indices[triIdx + 0] * m_vertStride;
-			idx1[i] = m_indices[triIdx + 1] * m_vertStride;
-			idx2[i] = m_indices[triIdx + 2] * m_vertStride;
-			
-			v0[i] = *reinterpret_cast<const vec3*>(&m_verts[idx0[i] + m_vertPosOffset]);
-			v1[i] = *reinterpret_cast<const vec3*>(&m_verts[idx1[i] + m_vertPosOffset]);
-			v2[i] = *reinterpret_cast<const vec3*>(&m_verts[idx2[i] + m_vertPosOffset]);
-		}
-		
-		IntersectTriangleResultSIMD results = intersect_triangles_simd(ray, v0, v1, v2);
-		
-		float tVals[8], uVals[8], vVals[8];
-		_mm256_storeu_ps(tVals, results.t);
-		_mm256_storeu_ps(uVals, results.u);
-		_mm256_storeu_ps(vVals, results.v);
-		
-		int hitMask = _mm256_movemask_ps(_mm256_castsi256_ps(results.hit));
+		children[numChildren++] = node->children[0];
+		children[numChildren++] = node->children[1];
+	}
 
-		for(uint32_t i = 0; i < 8; i++) 
+	while(numChildren < W)
+	{
+		int32_t largest = -1;
+		float largestSA = -INFINITY;
+		for(uint32_t i = 0; i < numChildren; i++)
 		{
-			if((hitMask & (1 << i)) && tVals[i] < tMin && 
-			   test_alpha_mask(alphaMask, idx0[i], idx1[i], idx2[i], uVals[i], vVals[i])) 
+			if(children[i]->children[0] == nullptr)
+				continue;
+
+			vec3 d = children[i]->bounds.max - children[i]->bounds.min;
+			float sa = d.x * d.y + d.x * d.z + d.y * d.z;
+			if(sa > largestSA)
 			{
-				hit = true;
-				tMin = tVals[i];
-				minIdx0 = idx0[i];
-				minIdx1 = idx1[i];
-				minIdx2 = idx2[i];
-				minV0 = v0[i];
-				minV1 = v1[i];
-				minV2 = v2[i];
-				minB0 = uVals[i];
-				minB1 = vVals[i];
+				largestSA = sa;
+				largest = i;
 			}
 		}
+
+		if(largest == -1)
+			break;
+
+		const BVHbuildNode* opened = children[largest];
+		children[largest] = opened->children[0];
+		children[numChildren++] = opened->children[1];
 	}
 
-	//process in batches of 4 with SIMD:
+	//create node, recursively flatten children:
 	//---------------
-	for(uint32_t i = numBatches * 8; i < numTris; i++) 
+	uint32_t idx = (uint32_t)nodes.size();
+	nodes.emplace_back();
+
+	for(uint32_t i = 0; i < W; i++)
 	{
-		uint32_t triIdx = m_kdTreeTriIndices[node->get_tri_indices_offset() + i] * 3;
-		uint32_t idx0 = m_indices[triIdx + 0] * m_vertStride;
-		uint32_t idx1 = m_indices[triIdx + 1] * m_vertStride;
-		uint32_t idx2 = m_indices[triIdx + 2] * m_vertStride;
-		
-		const vec3& v0 = *reinterpret_cast<const vec3*>(&m_verts[idx0 + m_vertPosOffset]);
-		const vec3& v1 = *reinterpret_cast<const vec3*>(&m_verts[idx1 + m_vertPosOffset]);
-		const vec3& v2 = *reinterpret_cast<const vec3*>(&m_verts[idx2 + m_vertPosOffset]);
-		
-		float t;
-		float b0, b1;
-		if(intersect_triangle(ray, v0, v1, v2, t, b0, b1) && t < tMin &&
-		   test_alpha_mask(alphaMask, idx0, idx1, idx2, b0, b1)) 
+		nodes[idx].minX[i] = nodes[idx].minY[i] = nodes[idx].minZ[i] = INFINITY;
+		nodes[idx].maxX[i] = nodes[idx].maxY[i] = nodes[idx].maxZ[i] = -INFINITY;
+		nodes[idx].children[i] = 0;
+		nodes[idx].numTris[i] = 0;
+	}
+
+	for(uint32_t i = 0; i < numChildren; i++)
+	{
+		const BVHbuildNode* child = children[i];
+
+		uint32_t childIdx;
+		uint32_t numTris;
+		if(child->children[0] == nullptr)
+		{
+			numTris = (uint32_t)child->tris.size();
+			childIdx = pack_tri_blocks(numTris, child->tris.data());
+		}
+		else
 		{
-			hit = true;
-			tMin = t;
-			minIdx0 = idx0;
-			minIdx1 = idx1;
-			minIdx2 = idx2;
-			minV0 = v0;
-			minV1 = v1;
-			minV2 = v2;
-			minB0 = b0;
-			minB1 = b1;
+			numTris = 0;
+			childIdx = bvh_flatten(child, nodes);
 		}
+
+		//empty leaves keep their inverted bounds, so they are never visited
+		if(child->children[0] == nullptr && numTris == 0)
+			continue;
+
+		BVHwideNode<W>& wideNode = nodes[idx];
+		wideNode.minX[i] = child->bounds.min.x;
+		wideNode.minY[i] = child->bounds.min.y;
+		wideNode.minZ[i] = child->bounds.min.z;
+		wideNode.maxX[i] = child->bounds.max.x;
+		wideNode.maxY[i] = child->bounds.max.y;
+		wideNode.maxZ[i] = child->bounds.max.z;
+		wideNode.children[i] = childIdx;
+		wideNode.numTris[i] = numTris;
 	}
 
-	return hit;
+	return idx;
 }
 
 //-------------------------------------------//
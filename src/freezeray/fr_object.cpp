@@ -2,6 +2,12 @@
 
 //-------------------------------------------//
 
+#define FR_OBJECT_BVH_MAX_COMPONENTS_PER_NODE 2
+#define FR_OBJECT_BVH_TRAVERSAL_COST 1.0f
+#define FR_OBJECT_BVH_ISECT_COST 4.0f
+
+//-------------------------------------------//
+
 namespace fr
 {
 
@@ -10,23 +16,9 @@ Object::Object(const std::vector<std::shared_ptr<const Mesh>>& meshes, const std
 	//assign each mesh its material, add to vector:
 	//---------------
 	for(uint32_t i = 0; i < meshes.size(); i++)
-	{
-		std::shared_ptr<const Material> mat = nullptr;
-		for(uint32_t j = 0; j < materials.size(); j++)
-		{
-			if(meshes[i]->get_material() == materials[j]->get_name())
-				mat = materials[j];
-		}
-
-		//set to default material if not found
-		if(mat == nullptr)
-		{
-			std::cout << "ERROR: no material found" << std::endl;
-			//TODO!!!!
-		}
+		m_components.push_back({meshes[i], find_material(meshes[i]->get_material(), materials), nullptr});
 
-		m_components.push_back({meshes[i], mat});
-	}
+	bvh_build();
 }
 
 Object::Object(const std::shared_ptr<const Mesh>& mesh, const std::shared_ptr<const Material>& material) :
@@ -35,64 +27,174 @@ Object::Object(const std::shared_ptr<const Mesh>& mesh, const std::shared_ptr<co
 
 }
 
+Object::Object(const std::shared_ptr<const Shape>& shape, const std::shared_ptr<const Material>& material) :
+	Object(std::vector<ObjectComponent>({ { nullptr, material, shape } }))
+{
+
+}
+
 Object::Object(const std::vector<ObjectComponent>& components) :
 	m_components(components)
 {
-
+	bvh_build();
 }
 
-bool Object::intersect(const Ray& ray, float& minT, vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs, std::shared_ptr<const Material>& material) const
+bool Object::intersect(const Ray& ray, float tMax, float& minT, uint32_t& componentIdx, uint32_t& triIdx, vec2& barycentrics) const
 {
-	//loop over every mesh, check for intersection:
+	//traverse bvh, check for intersection with every mesh that starts before the closest hit:
 	//---------------
 	bool hit = false;
-	minT = INFINITY;
+	minT = tMax;
 
-	for(uint32_t i = 0; i < m_components.size(); i++)
-	{
-		std::shared_ptr<const Material> mat = m_components[i].material;
+	m_bvh.intersect(ray, minT, [&](uint32_t idx, float& curMinT) {
+		const ObjectComponent& component = m_components[idx];
+
+		Ray componentRay = ray.transformed(m_componentTransforms[idx]);
 
 		float t;
-		vec2 newUV;
-		vec3 newNormal;
-		IntersectionInfo::Derivatives newDerivs;
-		if(m_components[i].mesh->intersect(ray, mat->get_alpha_mask(), t, newUV, newNormal, newDerivs) && t < minT)
+		uint32_t newTriIdx = 0;
+		vec2 newBarycentrics = vec2(0.0f);
+		bool componentHit;
+		if(component.shape != nullptr)
+			componentHit = component.shape->intersect(componentRay, curMinT, t);
+		else
+			componentHit = component.mesh->intersect(componentRay, component.material->get_alpha_mask(), curMinT, t, newTriIdx, newBarycentrics);
+
+		if(componentHit && t < curMinT)
 		{
-			hit |= true;
-			minT = t;
-			uv = newUV;
-			normal = newNormal;
-			material = mat;
-			derivs = newDerivs;
+			hit = true;
+			curMinT = t;
+			componentIdx = idx;
+			triIdx = newTriIdx;
+			barycentrics = newBarycentrics;
 		}
-	}
+	});
 
 	return hit;
 }
 
+FR_TARGET_AVX2 uint32_t Object::intersect8(const RayPacket8& rays, uint32_t rayMask, float* tMax, uint32_t* componentIdx, uint32_t* triIdx, vec2* barycentrics) const
+{
+	//same as intersect, each mesh is only tested with the rays that hit its bounds:
+	//---------------
+	uint32_t hitMask = 0;
+
+	m_bvh.intersect8(rays, rayMask, tMax, [&](uint32_t idx, uint32_t meshRayMask, float* curTMax) {
+		const ObjectComponent& component = m_components[idx];
+		RayPacket8 componentRays = rays.transformed(m_componentTransforms[idx]);
+
+		uint32_t meshHitMask = 0;
+		if(component.shape != nullptr)
+		{
+			//shapes are cheap enough to intersect one ray at a time
+			for(uint32_t i = 0; i < 8; i++)
+			{
+				float t;
+				if((meshRayMask & (1 << i)) && component.shape->intersect(componentRays.get_ray(i), curTMax[i], t))
+				{
+					meshHitMask |= 1 << i;
+					curTMax[i] = t;
+					triIdx[i] = 0;
+					barycentrics[i] = vec2(0.0f);
+				}
+			}
+		}
+		else
+			meshHitMask = component.mesh->intersect8(componentRays, meshRayMask, component.material->get_alpha_mask(), curTMax, triIdx, barycentrics);
+		for(uint32_t i = 0; i < 8; i++)
+			if(meshHitMask & (1 << i))
+				componentIdx[i] = idx;
+
+		hitMask |= meshHitMask;
+	});
+
+	return hitMask;
+}
+
+bool Object::occluded(const Ray& ray, float tMax) const
+{
+	return m_bvh.occluded(ray, tMax, [&](uint32_t componentIdx) {
+		const ObjectComponent& component = m_components[componentIdx];
+		Ray componentRay = ray.transformed(m_componentTransforms[componentIdx]);
+
+		if(component.shape != nullptr)
+			return component.shape->occluded(componentRay, tMax);
+		else
+			return component.mesh->occluded(componentRay, component.material->get_alpha_mask(), tMax);
+	});
+}
+
+const ObjectComponent& Object::get_component(uint32_t idx) const
+{
+	return m_components[idx];
+}
+
+const Transform3x4& Object::get_component_transform(uint32_t idx) const
+{
+	return m_componentTransforms[idx];
+}
+
 bound3 Object::get_bounds() const
 {
-	bound3 bounds;
-	bounds.min = vec3( INFINITY);
-	bounds.max = vec3(-INFINITY);
+	return m_bvh.get_bounds();
+}
+
+std::shared_ptr<const Object> Object::from_obj(const std::string& objPath, const std::string& mtlPath, bool opacityIsMask, MeshAccelerator accelerator,
+                                               VertexFormat vertexFormat)
+{
+	std::vector<std::shared_ptr<const Material>> materials = Material::from_mtl(mtlPath, opacityIsMask);
 
+	//materials are loaded first so the meshes can classify their triangles against the alpha masks:
+	//---------------
+	std::unordered_map<std::string, std::shared_ptr<const Texture<float>>> alphaMasks;
+	for(uint32_t i = 0; i < materials.size(); i++)
+	{
+		std::shared_ptr<const Texture<float>> alphaMask = materials[i]->get_alpha_mask();
+		if(alphaMask != nullptr)
+			alphaMasks[materials[i]->get_name()] = alphaMask;
+	}
+
+	//instances that share a mesh still each have their own material:
+	//---------------
+	std::vector<MeshInstance> instances = Mesh::from_obj(objPath, accelerator, alphaMasks, vertexFormat);
+
+	std::vector<ObjectComponent> components;
+	for(uint32_t i = 0; i < instances.size(); i++)
+		components.push_back({instances[i].mesh, find_material(instances[i].material, materials), nullptr, instances[i].offset});
+
+	return std::make_shared<Object>(components);
+}
+
+void Object::bvh_build()
+{
+	m_componentTransforms.resize(m_components.size());
+	std::vector<bound3> componentBounds(m_components.size());
 	for(uint32_t i = 0; i < m_components.size(); i++)
 	{
-		bound3 meshBounds = m_components[i].mesh->get_bounds();
+		const ObjectComponent& component = m_components[i];
+		m_componentTransforms[i] = Transform3x4(translate(-1.0f * component.offset));
 
-		bounds.min = min(bounds.min, meshBounds.min);
-		bounds.max = max(bounds.max, meshBounds.max);
+		componentBounds[i] = component.shape != nullptr ? component.shape->get_bounds() : component.mesh->get_bounds();
+		componentBounds[i].min = componentBounds[i].min + component.offset;
+		componentBounds[i].max = componentBounds[i].max + component.offset;
 	}
 
-	return bounds;
+	m_bvh = BVH(componentBounds, FR_OBJECT_BVH_MAX_COMPONENTS_PER_NODE, FR_OBJECT_BVH_TRAVERSAL_COST, FR_OBJECT_BVH_ISECT_COST);
 }
 
-std::shared_ptr<const Object> Object::from_obj(const std::string& objPath, const std::string& mtlPath, bool opacityIsMask)
+std::shared_ptr<const Material> Object::find_material(const std::string& name, const std::vector<std::shared_ptr<const Material>>& materials)
 {
-	std::vector<std::shared_ptr<const Mesh>> meshes = Mesh::from_obj(objPath);
-	std::vector<std::shared_ptr<const Material>> materials = Material::from_mtl(mtlPath, opacityIsMask);
+	std::shared_ptr<const Material> mat = nullptr;
+	for(uint32_t i = 0; i < materials.size(); i++)
+	{
+		if(name == materials[i]->get_name())
+			mat = materials[i];
+	}
+
+	if(mat == nullptr)
+		throw std::invalid_argument("no material named \"" + name + "\" was found");
 
-	return std::make_shared<Object>(meshes, materials);
+	return mat;
 }
 
 }; //namespace fr
\ No newline at end of file
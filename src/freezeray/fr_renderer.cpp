@@ -2,13 +2,19 @@
 
 #include "freezeray/fr_ray.hpp"
 #include "freezeray/fr_globals.hpp"
+#include "freezeray/fr_log.hpp"
 #include "fr_thread_pool.hpp"
 
 #include <math.h>
+#include <string.h>
 #include <thread>
-#include <mutex>
-#include <queue>
+#include <vector>
 #include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <typeinfo>
 
 //-------------------------------------------//
 
@@ -31,12 +37,33 @@ struct ImageTile
 
 //-------------------------------------------//
 
-Renderer::Renderer(const std::shared_ptr<const Camera>& cam, uint32_t imageW, uint32_t imageH) : 
+//FNV-1a over the indices, so neighbouring spans get unrelated prng seeds
+static uint32_t hash_seed(uint32_t tile, uint32_t round, uint32_t span)
+{
+	uint32_t hash = 2166136261u;
+	for(uint32_t value : {tile, round, span})
+	for(uint32_t i = 0; i < 4; i++)
+	{
+		hash ^= (value >> (i * 8)) & 0xFF;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+//-------------------------------------------//
+
+uint32_t Renderer::m_numThreads = 0;
+
+//-------------------------------------------//
+
+Renderer::Renderer(const std::shared_ptr<const Camera>& cam, uint32_t imageW, uint32_t imageH, uint32_t samplesPerPixel) : 
 	m_cam(cam),
 	m_camInvView(inverse(m_cam->view())),
 	m_camInvProj(inverse(m_cam->proj())),
 	m_imageW(imageW), 
-	m_imageH(imageH)
+	m_imageH(imageH),
+	m_samplesPerPixel(samplesPerPixel)
 {
 
 }
@@ -50,7 +77,7 @@ void Renderer::render(const std::shared_ptr<const Scene>& scene, std::function<v
 {
 	//generate workgroups:
 	//---------------
-	std::queue<ImageTile> workGroups;
+	std::vector<ImageTile> workGroups;
 
 	uint32_t xDivs = (m_imageW + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
 	uint32_t yDivs = (m_imageH + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
@@ -72,85 +99,442 @@ void Renderer::render(const std::shared_ptr<const Scene>& scene, std::function<v
 		uint32_t xMax = xMin + xBaseSize + (x < xRemain ? 1 : 0) - 1;
 		uint32_t yMax = yMin + yBaseSize + (y < yRemain ? 1 : 0) - 1;
 
-		workGroups.push( {idx, xMin, yMin, xMax, yMax} );
+		workGroups.push_back( {idx, xMin, yMin, xMax, yMax} );
 	}
 
-	//define processing func:
+	//create film, resuming from the last checkpoint if asked to:
 	//---------------
-	bool shouldDisplay = false;
-	std::condition_variable displayCV;
-	std::condition_variable displayCVmain;
-	std::mutex displayMutex;
+	Film film(m_imageW, m_imageH, (uint32_t)workGroups.size());
 
-	std::atomic<uint64_t> threadsRendering = 0;
+	bool checkpoint = !m_checkpointPath.empty();
+	uint64_t checkpointKey = checkpoint ? checkpoint_key(scene) : 0;
+	bool resumed = checkpoint && m_resume && film.load(m_checkpointPath, checkpointKey);
+	if(resumed)
+		std::cout << "resuming from checkpoint \"" << m_checkpointPath << "\" with " << (float)film.get_total_samples() / ((uint64_t)m_imageW * m_imageH) << " samples per pixel" << std::endl;
 
-	auto processWorkgroup = [&](const ImageTile& tile) {
-		//wait for main thread to display
+	//tiles are copied here once they finish a round, so a checkpoint never contains a tile with only some of its spans sampled
+	std::unique_ptr<Film> checkpointFilm = checkpoint ? std::make_unique<Film>(film) : nullptr;
+
+	//create framebuffer. writes to a tile's pixels (in the framebuffer or checkpoint film) happen under its own seqlock,
+	//so neither the preview nor checkpoints ever have to pause the workers:
+	//---------------
+	std::vector<vec3> framebuffer((size_t)m_imageW * m_imageH);
+	std::unique_ptr<std::atomic<uint32_t>[]> tileSeqs = std::make_unique<std::atomic<uint32_t>[]>(workGroups.size());
+
+	//an odd sequence number marks the tile as being written, so threads sharing a split tile also exclude each other
+	auto beginTileWrite = [&](const ImageTile& tile) {
+		std::atomic<uint32_t>& seq = tileSeqs[tile.id];
+		uint32_t start;
+		while(true)
 		{
-			std::unique_lock<std::mutex> lock(displayMutex);
-			displayCV.wait(lock, [&]{ return !shouldDisplay; });
+			start = seq.load(std::memory_order_relaxed);
+			if(start % 2 == 0 && seq.compare_exchange_weak(start, start + 1, std::memory_order_relaxed))
+				break;
+
+			std::this_thread::yield();
 		}
+		std::atomic_thread_fence(std::memory_order_release);
+
+		return start;
+	};
 
-		//create prng
-		std::shared_ptr<PRNG> prng = std::make_shared<PRNG>(tile.id);
+	auto endTileWrite = [&](const ImageTile& tile, uint32_t start) {
+		tileSeqs[tile.id].store(start + 2, std::memory_order_release);
+	};
 
-		//increment threads rendering
-		threadsRendering.fetch_add(1);
-		
-		for(int32_t y = tile.endY; y >= (int32_t)tile.startY; y--)
-		for(uint32_t x = tile.startX; x <= tile.endX; x++)
+	//calls read until it ran without a write to the tile in the meantime, writes are short so this rarely retries.
+	//returns false without calling read if the tile was never written
+	auto readTile = [&](const ImageTile& tile, const std::function<void()>& read) {
+		std::atomic<uint32_t>& seq = tileSeqs[tile.id];
+		while(true)
 		{
-			//generate ray for current pixel
-			Ray cameraRay = get_camera_ray(x, (uint32_t)y);
-			Ray cameraRayDifferentialX = get_camera_ray(x + 1, (uint32_t)y);
-			Ray cameraRayDifferentialY = get_camera_ray(x, (uint32_t)y + 1);
+			uint32_t start = seq.load(std::memory_order_acquire);
+			if(start == 0)
+				return false;
+			if(start % 2 != 0)
+			{
+				std::this_thread::yield();
+				continue;
+			}
 
-			cameraRay = Ray(cameraRay, cameraRayDifferentialX, cameraRayDifferentialY);
+			read();
 
-			//get color of pixel
-			vec3 color = li(prng, scene, cameraRay);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(seq.load(std::memory_order_relaxed) == start)
+				return true;
+		}
+	};
+
+	auto publishPixels = [&](const ImageTile& tile, uint32_t y, uint32_t startX, uint32_t endX) {
+		uint32_t start = beginTileWrite(tile);
 
-			//write color to given buffer
+		for(uint32_t x = startX; x <= endX; x++)
+		{
+			vec3 color = film.get_pixel(x, y).mean;
 			color.r = std::max(std::min(color.r, 1.0f), 0.0f);
 			color.g = std::max(std::min(color.g, 1.0f), 0.0f);
 			color.b = std::max(std::min(color.b, 1.0f), 0.0f);
-			color = linear_to_srgb(color);
 
-			writePixel(x, (uint32_t)y, color);
+			framebuffer[x + m_imageW * y] = linear_to_srgb(color);
+		}
+
+		endTileWrite(tile, start);
+	};
+
+	auto commitTile = [&](const ImageTile& tile) {
+		uint32_t start = beginTileWrite(tile);
+
+		for(uint32_t y = tile.startY; y <= tile.endY; y++)
+		for(uint32_t x = tile.startX; x <= tile.endX; x++)
+			checkpointFilm->get_pixel(x, y) = film.get_pixel(x, y);
+
+		checkpointFilm->get_tile_rounds(tile.id) = film.get_tile_rounds(tile.id);
+
+		endTileWrite(tile, start);
+	};
+
+	std::vector<vec3> snapshot;
+	auto writeTiles = [&]() {
+		for(const ImageTile& tile : workGroups)
+		{
+			uint32_t tileW = tile.endX - tile.startX + 1;
+			uint32_t tileH = tile.endY - tile.startY + 1;
+			snapshot.resize(tileW * tileH);
+
+			//tiles that haven't been rendered yet keep whatever was displayed before:
+			//---------------
+			bool written = readTile(tile, [&]() {
+				for(uint32_t y = 0; y < tileH; y++)
+					memcpy(&snapshot[tileW * y], &framebuffer[tile.startX + m_imageW * (tile.startY + y)], tileW * sizeof(vec3));
+			});
+
+			if(!written)
+				continue;
+
+			for(uint32_t y = 0; y < tileH; y++)
+			for(uint32_t x = 0; x < tileW; x++)
+				writePixel(tile.startX + x, tile.startY + y, snapshot[x + tileW * y]);
+		}
+	};
+
+	std::unique_ptr<Film> checkpointSnapshot = checkpoint ? std::make_unique<Film>(film) : nullptr;
+	auto saveCheckpoint = [&]() {
+		for(const ImageTile& tile : workGroups)
+		{
+			readTile(tile, [&]() {
+				for(uint32_t y = tile.startY; y <= tile.endY; y++)
+				for(uint32_t x = tile.startX; x <= tile.endX; x++)
+					checkpointSnapshot->get_pixel(x, y) = checkpointFilm->get_pixel(x, y);
+
+				checkpointSnapshot->get_tile_rounds(tile.id) = checkpointFilm->get_tile_rounds(tile.id);
+			});
+		}
+
+		checkpointSnapshot->save(m_checkpointPath, checkpointKey);
+	};
+
+	//without adaptive sampling, the first round is a 1 spp prepass whose timings order the tiles for the second. with it, each
+	//round is ordered by the previous one. the first adaptive round takes minSamples, so pixels whose first few samples happen
+	//to agree (e.g. all missed a small light) don't stop early:
+	//---------------
+	bool adaptive = m_maxRelativeError > 0.0f;
+	uint32_t minSamples = adaptive ? std::min(m_minSamples, m_samplesPerPixel) : m_samplesPerPixel;
+	uint32_t firstRoundSamples = adaptive ? minSamples : std::min(m_samplesPerPixel, 1u);
+	uint32_t roundSamples = adaptive ? m_samplesPerRound : m_samplesPerPixel;
+
+	auto pixelDone = [&](const PixelEstimate& estimate) {
+		if(estimate.numSamples >= m_samplesPerPixel)
+			return true;
+
+		return adaptive && estimate.numSamples >= minSamples && estimate.relative_error() <= m_maxRelativeError;
+	};
+
+	auto tileDone = [&](const ImageTile& tile) {
+		for(uint32_t y = tile.startY; y <= tile.endY; y++)
+		for(uint32_t x = tile.startX; x <= tile.endX; x++)
+		{
+			if(!pixelDone(film.get_pixel(x, y)))
+				return false;
+		}
+
+		return true;
+	};
+
+	//progress is measured in samples, pixels that are done only count the samples they actually took:
+	//---------------
+	std::atomic<uint64_t> samplesTaken = film.get_total_samples();
+	auto sampleBudget = [&]() {
+		uint64_t budget = 0;
+		for(uint32_t y = 0; y < m_imageH; y++)
+		for(uint32_t x = 0; x < m_imageW; x++)
+		{
+			const PixelEstimate& estimate = film.get_pixel(x, y);
+			budget += pixelDone(estimate) ? estimate.numSamples : m_samplesPerPixel;
+		}
+
+		return std::max(budget, (uint64_t)1);
+	};
+
+	//define processing funcs. tiles are processed in spans of up to 8 pixels in a row, which each get their own prng seeded
+	//from the tile's round, so idle threads can take spans from tiles still in flight without changing the result:
+	//---------------
+	uint32_t numThreads = get_num_threads();
+
+	std::unique_ptr<WorkRange[]> tileSpans = std::make_unique<WorkRange[]>(workGroups.size());
+	std::unique_ptr<std::atomic<uint32_t>[]> tileSpansLeft = std::make_unique<std::atomic<uint32_t>[]>(workGroups.size());
+	std::unique_ptr<std::atomic<uint64_t>[]> tileCosts = std::make_unique<std::atomic<uint64_t>[]>(workGroups.size());
+	std::unique_ptr<std::atomic<uint32_t>[]> inFlight = std::make_unique<std::atomic<uint32_t>[]>(numThreads); //tile id + 1, 0 if free
+	std::atomic<uint64_t> busyTime = 0;
+
+	auto numSpans = [](const ImageTile& tile) {
+		return ((tile.endX - tile.startX + 8) / 8) * (tile.endY - tile.startY + 1);
+	};
+
+	auto processSpan = [&](const ImageTile& tile, uint32_t span) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		uint32_t spansPerRow = (tile.endX - tile.startX + 8) / 8;
+		uint32_t y = tile.endY - span / spansPerRow;
+		uint32_t startX = tile.startX + (span % spansPerRow) * 8;
+		uint32_t endX = std::min(startX + 7, tile.endX);
+
+		std::shared_ptr<PRNG> prng = std::make_shared<PRNG>(hash_seed(tile.id, film.get_tile_rounds(tile.id), span));
+
+		//packet traversal is written with AVX, so its only used if the cpu supports it
+		bool primaryPackets = use_primary_packets() && get_simd_level() >= SIMD_LEVEL_AVX2;
+
+		//gather the span's unfinished pixels and generate their rays:
+		//---------------
+		uint32_t pixelXs[8];
+		uint32_t numRays = 0;
+		for(uint32_t x = startX; x <= endX; x++)
+		{
+			if(!pixelDone(film.get_pixel(x, y)))
+				pixelXs[numRays++] = x;
+		}
+
+		Ray cameraRays[8];
+		for(uint32_t i = 0; i < numRays; i++)
+		{
+			Ray cameraRay = get_camera_ray(pixelXs[i], y);
+			Ray cameraRayDifferentialX = get_camera_ray(pixelXs[i] + 1, y);
+			Ray cameraRayDifferentialY = get_camera_ray(pixelXs[i], y + 1);
+
+			cameraRays[i] = Ray(cameraRay, cameraRayDifferentialX, cameraRayDifferentialY);
+		}
+
+		//trace them together, they are coherent enough to share traversal:
+		//---------------
+		HitPacket8 primaryHits;
+		if(primaryPackets && numRays > 0)
+			scene->intersect8(RayPacket8(cameraRays, numRays), primaryHits);
+
+		uint32_t samplesAdded = 0;
+		for(uint32_t i = 0; i < numRays; i++)
+		{
+			//take this round's samples
+			PixelEstimate& estimate = film.get_pixel(pixelXs[i], y);
+			uint32_t numSamples = std::min(estimate.numSamples == 0 ? firstRoundSamples : roundSamples, m_samplesPerPixel - estimate.numSamples);
+
+			if(primaryPackets)
+				li_primary(prng, scene, cameraRays[i], (primaryHits.hitMask & (1 << i)) != 0, primaryHits.hits[i], numSamples, estimate);
+			else
+				li(prng, scene, cameraRays[i], numSamples, estimate);
+
+			samplesAdded += numSamples;
+		}
+
+		publishPixels(tile, y, startX, endX);
+
+		uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		tileCosts[tile.id].fetch_add(time, std::memory_order_relaxed);
+		busyTime.fetch_add(time, std::memory_order_relaxed);
+		samplesTaken.fetch_add(samplesAdded, std::memory_order_relaxed);
+
+		//whoever finishes the tile's last span advances its round
+		if(tileSpansLeft[tile.id].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			film.get_tile_rounds(tile.id)++;
+			if(checkpoint)
+				commitTile(tile);
 		}
+	};
+
+	auto processWorkgroup = [&](const ImageTile& tile) {
+		//share the tile's spans, there's always a free slot since each thread has at most 1 tile in flight
+		tileSpansLeft[tile.id].store(numSpans(tile));
+		tileSpans[tile.id].reset(0, numSpans(tile));
+
+		uint32_t slot = 0;
+		for(uint32_t expected = 0; !inFlight[slot].compare_exchange_strong(expected, tile.id + 1); expected = 0)
+			slot = (slot + 1) % numThreads;
+
+		uint32_t span;
+		while(tileSpans[tile.id].pop(span))
+			processSpan(tile, span);
+
+		inFlight[slot].store(0);
+	};
+
+	//once the pool runs dry, idle threads take spans one at a time from the back of the in flight tile with the most left:
+	//---------------
+	auto help = [&]() {
+		uint32_t tileId = UINT32_MAX;
+		uint32_t mostSpans = 0;
+		for(uint32_t i = 0; i < numThreads; i++)
+		{
+			uint32_t slot = inFlight[i].load();
+			if(slot == 0)
+				continue;
+
+			uint32_t size = tileSpans[slot - 1].size();
+			if(size > mostSpans)
+			{
+				tileId = slot - 1;
+				mostSpans = size;
+			}
+		}
+
+		if(tileId == UINT32_MAX)
+			return false;
 
-		//decrement threads rendering, notify main thread
-		if(threadsRendering.fetch_sub(1) == 1)
-			displayCVmain.notify_one();
+		uint32_t begin, end;
+		if(tileSpans[tileId].steal(1, 1, begin, end))
+			processSpan(workGroups[tileId], begin);
+
+		return true;
 	};
 
-	//start thread groups, display periodically:
+	//show what a resumed render already has:
 	//---------------
-	uint64_t numThreads = std::thread::hardware_concurrency();
-	ThreadPool<ImageTile> pool(numThreads, workGroups, processWorkgroup);
+	std::vector<ImageTile> activeTiles;
+	for(const ImageTile& tile : workGroups)
+	{
+		if(resumed)
+		{
+			for(uint32_t y = tile.startY; y <= tile.endY; y++)
+				publishPixels(tile, y, tile.startX, tile.endX);
+		}
 
-	while(!pool.complete())
+		if(!tileDone(tile))
+			activeTiles.push_back(tile);
+	}
+
+	//render in rounds, most expensive tiles first. display and checkpoint periodically, writePixel is only ever called from this thread:
+	//---------------
+	std::chrono::steady_clock::time_point renderStart = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point nextDisplay = renderStart + std::chrono::seconds(displayFrequency);
+	std::chrono::steady_clock::time_point nextCheckpoint = renderStart + std::chrono::seconds(m_checkpointInterval);
+
+	uint32_t numRounds = 0;
+	for(; !activeTiles.empty(); numRounds++)
 	{
-		std::this_thread::sleep_for(std::chrono::seconds(displayFrequency));
+		uint64_t budget = sampleBudget();
 
-		shouldDisplay = true;
+		{
+			ThreadPool<ImageTile> pool(numThreads, activeTiles, processWorkgroup, help);
 
-		std::unique_lock<std::mutex> lock(displayMutex);
-		displayCVmain.wait(lock, [&]{ return threadsRendering.load() == 0; });
+			while(!pool.wait_until(checkpoint ? std::min(nextDisplay, nextCheckpoint) : nextDisplay))
+			{
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
 
-		display(pool.progress());
+				if(now >= nextDisplay)
+				{
+					writeTiles();
+					display(std::min((float)samplesTaken.load() / budget, 1.0f));
 
-		shouldDisplay = false;
-		displayCV.notify_all();
+					nextDisplay = std::chrono::steady_clock::now() + std::chrono::seconds(displayFrequency);
+				}
+
+				if(checkpoint && now >= nextCheckpoint)
+				{
+					saveCheckpoint();
+					nextCheckpoint = std::chrono::steady_clock::now() + std::chrono::seconds(m_checkpointInterval);
+				}
+			}
+		}
+
+		//drop tiles whose pixels are all done, order the rest by how long they took this round:
+		//---------------
+		activeTiles.erase(std::remove_if(activeTiles.begin(), activeTiles.end(), tileDone), activeTiles.end());
+		std::stable_sort(activeTiles.begin(), activeTiles.end(), [&](const ImageTile& a, const ImageTile& b) {
+			return tileCosts[a.id].load() > tileCosts[b.id].load();
+		});
+
+		for(const ImageTile& tile : activeTiles)
+			tileCosts[tile.id].store(0);
 	}
 
-	//display final result:
+	//display final result, the finished film is consistent so it's saved directly:
 	//---------------
-	display(pool.progress());
+	writeTiles();
+	display(1.0f);
+
+	if(checkpoint)
+		film.save(m_checkpointPath, checkpointKey);
+
+	//report how much of the threads' time went to rendering, idle time is mostly spent waiting for the last tiles of a round:
+	//---------------
+	uint64_t renderTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - renderStart).count();
+	log_verbose("thread utilization: ", 100.0 * busyTime.load() / ((double)renderTime * numThreads), "% of ", numThreads, " threads over ", numRounds, " rounds");
+
+	if(adaptive)
+		log_verbose("adaptive sampling took ", (float)film.get_total_samples() / ((uint64_t)m_imageW * m_imageH), " samples per pixel on average (max ", m_samplesPerPixel, ")");
 }
 
 //-------------------------------------------//
 
+void Renderer::set_num_threads(uint32_t numThreads)
+{
+	m_numThreads = numThreads;
+}
+
+uint32_t Renderer::get_num_threads()
+{
+	if(m_numThreads > 0)
+		return m_numThreads;
+
+	//hardware_concurrency() may return 0 if it can't be determined
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void Renderer::set_adaptive_sampling(float maxRelativeError, uint32_t minSamples, uint32_t samplesPerRound)
+{
+	if(maxRelativeError < 0.0f)
+		throw std::invalid_argument("max relative error must be non-negative");
+	if(minSamples < 2)
+		throw std::invalid_argument("at least 2 samples are needed to estimate variance");
+	if(samplesPerRound < 1)
+		throw std::invalid_argument("rounds must take at least 1 sample");
+
+	m_maxRelativeError = maxRelativeError;
+	m_minSamples = minSamples;
+	m_samplesPerRound = samplesPerRound;
+}
+
+void Renderer::set_checkpoint(const std::string& path, uint32_t interval, bool resume)
+{
+	if(interval == 0)
+		throw std::invalid_argument("checkpoint interval must be at least 1 second");
+
+	m_checkpointPath = path;
+	m_checkpointInterval = interval;
+	m_resume = resume;
+}
+
+//-------------------------------------------//
+
+void Renderer::li_primary(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, bool, const HitRecord&,
+                          uint32_t numSamples, PixelEstimate& estimate) const
+{
+	li(prng, scene, ray, numSamples, estimate);
+}
+
+bool Renderer::use_primary_packets() const
+{
+	return false;
+}
+
 vec3 Renderer::sample_one_light(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const IntersectionInfo& hitInfo, const vec3& wo) const
 {
 	//choose random light index:
@@ -256,20 +640,28 @@ vec3 Renderer::sample_one_light_mis(const std::shared_ptr<PRNG>& prng, const std
 			//trace ray, get light contrib
 			vec3 rayPos = hitInfo.pos + FR_EPSILON * wi;
 
+			//only the light matters here, so the hit is only shaded if it is on the sampled light
 			Ray ray(rayPos, wi);
+			HitRecord hitBsdf;
 			IntersectionInfo hitInfoBsdf;
 			
-			if(scene->intersect(ray, hitInfoBsdf))
+			if(scene->intersect(ray, hitBsdf))
 			{
-				if(hitInfoBsdf.light.get() == light.get())
+				if(hitBsdf.light == light.get())
+				{
+					scene->shade(ray, hitBsdf, hitInfoBsdf, false);
 					li = light->le(hitInfoBsdf, -1.0f * wi);
+				}
 				else
 					li = vec3(0.0f);
 			}
 			else
 			{
 				if(light->is_infinite())
+				{
+					scene->shade_miss(ray, hitInfoBsdf);
 					li = light->le(hitInfoBsdf, -1.0f * wi);
+				}
 				else
 					li = vec3(0.0f);
 			}
@@ -290,17 +682,11 @@ bool Renderer::trace_visibility_ray(const std::shared_ptr<const Scene>& scene, c
 	vec3 rayDir = normalize(visInfo.endPos - visInfo.startPos);
 	rayPos = rayPos + FR_EPSILON * rayDir;
 
-	Ray ray(rayPos, rayDir);
-	IntersectionInfo hitInfo;
-	bool hit = scene->intersect(ray, hitInfo);
-
-	if(!hit)
-		return true;
+	//the ray is offset by FR_EPSILON, and we allow hits up to FR_EPSILON before the end point
+	float tMax = distance(visInfo.startPos, visInfo.endPos) - 2.0f * FR_EPSILON;
 
-	float minDist = distance(visInfo.startPos, visInfo.endPos);
-	float dist = distance(visInfo.startPos, hitInfo.pos);
-
-	return (dist + FR_EPSILON) > minDist;
+	Ray ray(rayPos, rayDir);
+	return !scene->occluded(ray, tMax);
 }
 
 Ray Renderer::get_camera_ray(uint32_t x, uint32_t y) const
@@ -322,6 +708,47 @@ Ray Renderer::get_camera_ray(vec2 uv) const
 	return Ray(rayOrig.xyz(), normalize(rayDir.xyz()));	
 }
 
+uint64_t Renderer::checkpoint_key(const std::shared_ptr<const Scene>& scene) const
+{
+	//64-bit FNV-1a over 32-bit words:
+	//---------------
+	uint64_t hash = 0xCBF29CE484222325ull;
+	auto hash_word = [&](uint32_t word) {
+		hash ^= word;
+		hash *= 0x100000001B3ull;
+	};
+	auto hash_float = [&](float f) {
+		uint32_t word;
+		memcpy(&word, &f, sizeof(float));
+		hash_word(word);
+	};
+
+	//scene + camera:
+	//---------------
+	uint64_t sceneHash = scene->get_hash();
+	hash_word((uint32_t)sceneHash);
+	hash_word((uint32_t)(sceneHash >> 32));
+
+	for(uint32_t col = 0; col < 4; col++)
+	for(uint32_t row = 0; row < 4; row++)
+	{
+		hash_float(m_camInvView.m[col][row]);
+		hash_float(m_camInvProj.m[col][row]);
+	}
+
+	//sampling, the renderer's type stands in for its own settings:
+	//---------------
+	for(const char* c = typeid(*this).name(); *c != '\0'; c++)
+		hash_word((uint8_t)*c);
+
+	hash_word(m_samplesPerPixel);
+	hash_float(m_maxRelativeError);
+	hash_word(m_minSamples);
+	hash_word(m_samplesPerRound);
+
+	return hash;
+}
+
 float Renderer::mis_power_heuristic(uint32_t nf, float pdff, uint32_t ng, float pdfg)
 {
 	float f = nf * pdff;
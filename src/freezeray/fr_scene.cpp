@@ -1,5 +1,12 @@
 #include "freezeray/fr_scene.hpp"
 #include "freezeray/fr_globals.hpp"
+#include <string.h>
+
+//-------------------------------------------//
+
+#define FR_SCENE_BVH_MAX_OBJECTS_PER_NODE 4
+#define FR_SCENE_BVH_TRAVERSAL_COST 1.0f
+#define FR_SCENE_BVH_ISECT_COST 8.0f
 
 //-------------------------------------------//
 
@@ -30,13 +37,7 @@ Scene::Scene(const std::vector<ObjectReference>& objects, std::vector<std::uniqu
 	m_worldBounds.max = vec3(-INFINITY);
 
 	for(uint32_t i = 0; i < objects.size(); i++)
-	{
-		bound3 objBounds = transform_bounds(objects[i].object->get_bounds(), objects[i].transform);
-		m_worldBounds.min = min(m_worldBounds.min, objBounds.min);
-		m_worldBounds.max = max(m_worldBounds.max, objBounds.max);
-
 		add_object_reference(objects[i].object, nullptr, objects[i].transform);
-	}
 
 	//add lights:
 	//---------------
@@ -47,16 +48,13 @@ Scene::Scene(const std::vector<ObjectReference>& objects, std::vector<std::uniqu
 
 		mat4 lightTransform;
 		std::shared_ptr<const Mesh> lightMesh = light->get_mesh(lightTransform);
+		std::shared_ptr<const Shape> lightShape = light->get_shape(lightTransform);
 
-		if(lightMesh != nullptr)
+		if(lightMesh != nullptr || lightShape != nullptr)
 		{
-			std::vector<ObjectComponent> componentList = { { lightMesh, lightMaterial } };
+			std::vector<ObjectComponent> componentList = { { lightMesh, lightMaterial, lightShape } };
 			std::shared_ptr<const Object> lightObject = std::make_shared<Object>(componentList);
 
-			bound3 lightBounds = transform_bounds(lightMesh->get_bounds(), lightTransform);
-			m_worldBounds.min = min(m_worldBounds.min, lightBounds.min);
-			m_worldBounds.max = max(m_worldBounds.max, lightBounds.max);
-
 			add_object_reference(lightObject, light, lightTransform);
 		}
 
@@ -66,6 +64,14 @@ Scene::Scene(const std::vector<ObjectReference>& objects, std::vector<std::uniqu
 		m_lights.push_back(light);
 	}
 
+	//build bvh over all object references:
+	//---------------
+	std::vector<bound3> objectBounds(m_objects.size());
+	for(uint32_t i = 0; i < m_objects.size(); i++)
+		objectBounds[i] = m_objects[i].bounds;
+
+	m_bvh = BVH(objectBounds, FR_SCENE_BVH_MAX_OBJECTS_PER_NODE, FR_SCENE_BVH_TRAVERSAL_COST, FR_SCENE_BVH_ISECT_COST);
+
 	//preprocess lights:
 	//---------------
 	for(uint32_t i = 0; i < m_lights.size(); i++)
@@ -74,80 +80,155 @@ Scene::Scene(const std::vector<ObjectReference>& objects, std::vector<std::uniqu
 
 bool Scene::intersect(const Ray& worldRay, IntersectionInfo& hitInfo) const
 {
-	float minT = INFINITY;
+	HitRecord hit;
+	if(intersect(worldRay, hit))
+	{
+		shade(worldRay, hit, hitInfo);
+		return true;
+	}
+	else
+	{
+		shade_miss(worldRay, hitInfo);
+		return false;
+	}
+}
 
-	
-	vec3 minHitPos;
-	vec3 minNormal;
-	vec2 minUV;
-	IntersectionInfo::Derivatives minDerivs;
-	std::shared_ptr<const Material> minMaterial;
-	std::shared_ptr<const Light> minLight;
+bool Scene::intersect(const Ray& worldRay, HitRecord& hit) const
+{
+	//the object rays are never renormalized, so t is the same in world and object space,
+	//this lets us compare hits across objects without transforming them back to world space
 
-	bool hit = false;
+	hit.t = INFINITY;
+	bool found = false;
 
-	for(uint32_t i = 0; i < m_objects.size(); i++)
-	{
-		Ray objectRay = worldRay.transformed(m_objects[i].invTransform, m_objects[i].invTransformNoTranslate);
+	//traverse bvh, intersect each object whose bounds start before the closest hit:
+	//---------------
+	m_bvh.intersect(worldRay, hit.t, [&](uint32_t objectIdx, float& tMax) {
+		const ObjectReferenceFull& object = m_objects[objectIdx];
+		Ray objectRay = worldRay.transformed(object.invTransform);
 
 		float t;
-		vec2 uv;
-		vec3 objectNormal;
-		IntersectionInfo::Derivatives derivs;
-		std::shared_ptr<const Material> material;
-		if(m_objects[i].object->intersect(objectRay, t, uv, objectNormal, derivs, material))
+		uint32_t componentIdx;
+		uint32_t triIdx;
+		vec2 barycentrics;
+		if(object.object->intersect(objectRay, tMax, t, componentIdx, triIdx, barycentrics))
 		{
-			hit |= true;
+			found = true;
+
+			tMax = t;
+			hit.objectIdx = objectIdx;
+			hit.componentIdx = componentIdx;
+			hit.triIdx = triIdx;
+			hit.barycentrics = barycentrics;
+		}
+	});
+
+	if(!found)
+		return false;
 
-			vec3 objectHitPos = objectRay.at(t);
-			vec3 worldHitPos = (m_objects[i].transform * vec4(objectHitPos, 1.0)).xyz();
-			t = distance(worldRay.origin(), worldHitPos);
+	const ObjectReferenceFull& object = m_objects[hit.objectIdx];
+	hit.material = object.object->get_component(hit.componentIdx).material.get();
+	hit.light = object.light.get();
 
-			if(t < minT)
-			{
-				minT = t;
+	return true;
+}
+
+FR_TARGET_AVX2 void Scene::intersect8(const RayPacket8& worldRays, HitPacket8& hits) const
+{
+	//same as intersect, t is the same in world and object space so it can be compared across objects:
+	//---------------
+	alignas(32) float tMax[8];
+	for(uint32_t i = 0; i < 8; i++)
+		tMax[i] = INFINITY;
 
-				minHitPos = worldHitPos;
-				minNormal = (m_objects[i].transformNoTranslate * vec4(objectNormal, 1.0)).xyz();
+	hits.hitMask = 0;
 
-				minUV = uv;
-				minDerivs = derivs;
-				minMaterial = material;
-				minLight = m_objects[i].light;
-			}
+	m_bvh.intersect8(worldRays, worldRays.active_mask(), tMax, [&](uint32_t objectIdx, uint32_t rayMask, float* curTMax) {
+		const ObjectReferenceFull& object = m_objects[objectIdx];
+		RayPacket8 objectRays = worldRays.transformed(object.invTransform);
+
+		uint32_t componentIdx[8];
+		uint32_t triIdx[8];
+		vec2 barycentrics[8];
+		uint32_t objectHitMask = object.object->intersect8(objectRays, rayMask, curTMax, componentIdx, triIdx, barycentrics);
+
+		for(uint32_t i = 0; i < 8; i++)
+		{
+			if(!(objectHitMask & (1 << i)))
+				continue;
+
+			hits.hits[i].objectIdx = objectIdx;
+			hits.hits[i].componentIdx = componentIdx[i];
+			hits.hits[i].triIdx = triIdx[i];
+			hits.hits[i].barycentrics = barycentrics[i];
 		}
-	}
 
-	hitInfo.wo = -1.0f * worldRay.direction();
-	hitInfo.bsdf = nullptr;
-	hitInfo.camera = nullptr;
+		hits.hitMask |= objectHitMask;
+	});
 
-	if(hit)
+	//fill in materials + lights:
+	//---------------
+	for(uint32_t i = 0; i < 8; i++)
 	{
-		hitInfo.light = minLight;
+		hits.hits[i].t = tMax[i];
+		if(!(hits.hitMask & (1 << i)))
+			continue;
 
-		hitInfo.pos = minHitPos;
+		const ObjectReferenceFull& object = m_objects[hits.hits[i].objectIdx];
+		hits.hits[i].material = object.object->get_component(hits.hits[i].componentIdx).material.get();
+		hits.hits[i].light = object.light.get();
+	}
+}
 
-		hitInfo.shadingNormal = normalize(minNormal);
-		hitInfo.uv = minUV;
+void Scene::shade(const Ray& worldRay, const HitRecord& hit, IntersectionInfo& hitInfo, bool buildBsdf) const
+{
+	const ObjectReferenceFull& object = m_objects[hit.objectIdx];
+	const ObjectComponent& component = object.object->get_component(hit.componentIdx);
 
-		hitInfo.derivatives = minDerivs;
+	//compute surface attributes in object space:
+	//---------------
+	Ray objectRay = worldRay.transformed(object.invTransform);
+	Ray componentRay = objectRay.transformed(object.object->get_component_transform(hit.componentIdx));
 
-		hitInfo.bsdf = minMaterial->get_bsdf(hitInfo);
-	}
+	vec3 objectNormal;
+	if(component.shape != nullptr)
+		component.shape->get_hit_attribs(componentRay, hit.t, hitInfo.uv, objectNormal, hitInfo.derivatives);
 	else
-	{
-		hitInfo.light = nullptr;
+		component.mesh->get_hit_attribs(componentRay, hit.t, hit.triIdx, hit.barycentrics, hitInfo.uv, objectNormal, hitInfo.derivatives);
 
-		hitInfo.pos = worldRay.direction() * 2.0f * get_world_radius();
-		
-		hitInfo.shadingNormal = vec3(0.0f);
-		hitInfo.uv = vec2(0.0f);
+	//transform to world space, build bsdf:
+	//---------------
+	hitInfo.wo = -1.0f * worldRay.direction();
+	hitInfo.camera = nullptr;
+	hitInfo.light = object.light;
 
-		hitInfo.derivatives = {};
-	}
+	hitInfo.pos = object.transform.apply_point(objectRay.at(hit.t));
+	hitInfo.shadingNormal = normalize(object.transform.apply_vector(objectNormal));
+
+	hitInfo.bsdf = buildBsdf ? component.material->get_bsdf(hitInfo) : nullptr;
+}
+
+void Scene::shade_miss(const Ray& worldRay, IntersectionInfo& hitInfo) const
+{
+	hitInfo.wo = -1.0f * worldRay.direction();
+	hitInfo.bsdf = nullptr;
+	hitInfo.camera = nullptr;
+	hitInfo.light = nullptr;
+
+	hitInfo.pos = worldRay.direction() * 2.0f * get_world_radius();
+	
+	hitInfo.shadingNormal = vec3(0.0f);
+	hitInfo.uv = vec2(0.0f);
+	hitInfo.derivatives = {};
+}
 
-	return hit;
+bool Scene::occluded(const Ray& worldRay, float tMax) const
+{
+	//same as intersect, t is the same in world and object space, so tMax can be passed through as-is
+	return m_bvh.occluded(worldRay, tMax, [&](uint32_t objectIdx) {
+		const ObjectReferenceFull& object = m_objects[objectIdx];
+		return object.object->occluded(worldRay.transformed(object.invTransform), tMax);
+	});
 }
 
 const std::vector<std::shared_ptr<const Light>>& Scene::get_lights() const
@@ -170,23 +251,61 @@ float Scene::get_world_radius() const
 	return std::max(length(m_worldBounds.min), length(m_worldBounds.max));
 }
 
+uint64_t Scene::get_hash() const
+{
+	//64-bit FNV-1a over 32-bit words:
+	//---------------
+	uint64_t hash = 0xCBF29CE484222325ull;
+	auto hash_word = [&](uint32_t word) {
+		hash ^= word;
+		hash *= 0x100000001B3ull;
+	};
+	auto hash_vec3 = [&](const vec3& v) {
+		for(uint32_t i = 0; i < 3; i++)
+		{
+			uint32_t word;
+			memcpy(&word, &v[i], sizeof(float));
+			hash_word(word);
+		}
+	};
+
+	//objects, the transformed origin and axes cover the whole transform:
+	//---------------
+	hash_word((uint32_t)m_objects.size());
+	for(const ObjectReferenceFull& object : m_objects)
+	{
+		hash_word(object.light != nullptr);
+
+		hash_vec3(object.transform.apply_point(vec3(0.0f)));
+		hash_vec3(object.transform.apply_vector(vec3(1.0f, 0.0f, 0.0f)));
+		hash_vec3(object.transform.apply_vector(vec3(0.0f, 1.0f, 0.0f)));
+		hash_vec3(object.transform.apply_vector(vec3(0.0f, 0.0f, 1.0f)));
+
+		hash_vec3(object.bounds.min);
+		hash_vec3(object.bounds.max);
+	}
+
+	//lights:
+	//---------------
+	hash_word((uint32_t)m_lights.size());
+	for(const std::shared_ptr<const Light>& light : m_lights)
+		hash_vec3(light->power());
+
+	return hash;
+}
+
 void Scene::add_object_reference(const std::shared_ptr<const Object>& object, const std::shared_ptr<const Light>& light, const mat4& transform)
 {
 	ObjectReferenceFull ref;
 	ref.object = object;
 	ref.light = light;
 
-	ref.transform = transform;
-	ref.transformNoTranslate = transform;
-	ref.transformNoTranslate.m[3][0] = 0.0f;
-	ref.transformNoTranslate.m[3][1] = 0.0f;
-	ref.transformNoTranslate.m[3][2] = 0.0f;
-
-	ref.invTransform = inverse(transform);
-	ref.invTransformNoTranslate = ref.invTransform;
-	ref.invTransformNoTranslate.m[3][0] = 0.0f;
-	ref.invTransformNoTranslate.m[3][1] = 0.0f;
-	ref.invTransformNoTranslate.m[3][2] = 0.0f;
+	ref.transform = Transform3x4(transform);
+	ref.invTransform = Transform3x4(inverse(transform));
+
+	ref.bounds = transform_bounds(object->get_bounds(), transform);
+	m_worldBounds.min = min(m_worldBounds.min, ref.bounds.min);
+	m_worldBounds.max = max(m_worldBounds.max, ref.bounds.max);
 
 	m_objects.push_back(ref);
 }
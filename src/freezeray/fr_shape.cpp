@@ -0,0 +1,54 @@
+#include "freezeray/fr_shape.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+bool Shape::occluded(const Ray& ray, float tMax) const
+{
+	float t;
+	return intersect(ray, tMax, t);
+}
+
+void Shape::get_hit_attribs(const Ray& ray, float t, vec2& uv, vec3& normal, IntersectionInfo::Derivatives& derivs) const
+{
+	vec3 p = ray.at(t);
+	get_surface_attribs(p, uv, normal);
+
+	//calculate derivatives by intersecting the differentials with the tangent plane:
+	//---------------
+	if(ray.has_differentials())
+	{
+		Ray rayX = ray.differential_x();
+		Ray rayY = ray.differential_y();
+
+		float planeDist = dot(normal, p);
+		float tx = (planeDist - dot(normal, rayX.origin())) / dot(normal, rayX.direction());
+		float ty = (planeDist - dot(normal, rayY.origin())) / dot(normal, rayY.direction());
+
+		vec3 px = rayX.at(tx);
+		vec3 py = rayY.at(ty);
+
+		vec2 uvx, uvy;
+		vec3 normalX, normalY;
+		get_surface_attribs(px, uvx, normalX);
+		get_surface_attribs(py, uvy, normalY);
+
+		derivs.dpdx = px - p;
+		derivs.dpdy = py - p;
+		derivs.duvdx = uvx - uv;
+		derivs.duvdy = uvy - uv;
+
+		//take the shorter way around the seam:
+		if(periodic_u())
+		{
+			derivs.duvdx.x -= std::round(derivs.duvdx.x);
+			derivs.duvdy.x -= std::round(derivs.duvdy.x);
+		}
+	}
+	else
+		derivs = {vec3(0.0f), vec3(0.0f), vec2(0.0f), vec2(0.0f)};
+}
+
+}; //namespace fr
\ No newline at end of file
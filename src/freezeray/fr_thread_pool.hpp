@@ -1,6 +1,6 @@
 /* fr_thread_pool.hpp
  *
- * contains a very basic, incomplete thread pool implementation
+ * contains a work stealing thread pool implementation
  * for use in renderers
  */
 
@@ -8,48 +8,136 @@
 #define FR_THREAD_POOL_H
 
 #include <stdint.h>
-#include <queue>
+#include <vector>
+#include <algorithm>
+#include <memory>
 #include <thread>
 #include <atomic>
 #include <functional>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "freezeray/fr_globals.hpp"
 
 //-------------------------------------------//
 
 namespace fr
 {
 
+//a range of indices that an owner pops from the front of while other threads steal from the back. packed into a single
+//64 bit atomic, so neither side ever needs a lock. padded so owners of neighbouring ranges don't contend for a cache line
+class alignas(FR_CACHE_LINE_SIZE) WorkRange
+{
+public:
+	//only safe while nobody can steal, i.e. the range is empty or not yet shared
+	inline void reset(uint32_t begin, uint32_t end) { m_range.store(pack(begin, end)); }
+	inline uint32_t size() const { uint64_t range = m_range.load(); return range_end(range) - range_begin(range); }
+
+	bool pop(uint32_t& idx)
+	{
+		uint64_t cur = m_range.load();
+		while(range_begin(cur) < range_end(cur))
+		{
+			if(m_range.compare_exchange_weak(cur, pack(range_begin(cur) + 1, range_end(cur))))
+			{
+				idx = range_begin(cur);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	//takes the back half, but at most maxSize indices. fails if fewer than minSize indices remain
+	bool steal(uint32_t minSize, uint32_t maxSize, uint32_t& begin, uint32_t& end)
+	{
+		uint64_t cur = m_range.load();
+		while(range_end(cur) - range_begin(cur) >= std::max(minSize, 1u))
+		{
+			uint32_t size = range_end(cur) - range_begin(cur);
+			uint32_t stealBegin = range_end(cur) - std::min((size + 1) / 2, maxSize);
+
+			if(m_range.compare_exchange_weak(cur, pack(range_begin(cur), stealBegin)))
+			{
+				begin = stealBegin;
+				end = range_end(cur);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+private:
+	std::atomic<uint64_t> m_range = 0;
+
+	static inline uint64_t pack(uint32_t begin, uint32_t end) { return ((uint64_t)end << 32) | begin; }
+	static inline uint32_t range_begin(uint64_t range) { return (uint32_t)range; }
+	static inline uint32_t range_end(uint64_t range) { return (uint32_t)(range >> 32); }
+};
+
+//-------------------------------------------//
+
+//worker i owns work groups i, i + numWorkers, i + 2 * numWorkers, ..., which it processes in order, so groups are started
+//roughly in the order they are given. once its own range is empty, a worker steals the back half of the largest remaining
+//range, and once there's nothing left to steal it calls help (if given) until that returns false. no work groups are added
+//after construction, so a worker can exit as soon as every range is empty
 template <typename WorkGroup>
 class ThreadPool
 {
 public:
-	ThreadPool(uint64_t numWorkers, const std::queue<WorkGroup>& workGroups, std::function<void(const WorkGroup&)> process) :
-		m_workGroups(workGroups), m_numWorkGroupsInitial((uint32_t)workGroups.size()), m_process(process)
+	ThreadPool(uint64_t numWorkers, const std::vector<WorkGroup>& workGroups, std::function<void(const WorkGroup&)> process,
+	           std::function<bool()> help = nullptr) :
+		m_workGroups(workGroups), m_process(process), m_help(help)
 	{
+		numWorkers = std::max(numWorkers, (uint64_t)1);
+		m_ranges = std::make_unique<WorkRange[]>(numWorkers);
+		m_numRanges = (uint32_t)numWorkers;
+
+		//interleave the groups, each worker's range is contiguous in m_order:
+		//---------------
+		uint32_t numGroups = (uint32_t)m_workGroups.size();
+		m_order.resize(numGroups);
+
+		uint32_t begin = 0;
+		for(uint32_t i = 0; i < m_numRanges; i++)
+		{
+			uint32_t end = begin;
+			for(uint32_t group = i; group < numGroups; group += m_numRanges)
+				m_order[end++] = group;
+
+			m_ranges[i].reset(begin, end);
+			begin = end;
+		}
+
+		//start workers:
+		//---------------
 		m_activeThreads = numWorkers;
 
-		for(uint64_t i = 0; i < numWorkers; i++)
+		for(uint32_t i = 0; i < m_numRanges; i++)
 		{
 			m_workers.emplace_back(
 				[this, i] {
 					while(true)
 					{
-						WorkGroup group;
-
+						//another thief can empty a freshly stolen range before we pop from it, so steal until either succeeds
+						uint32_t idx;
+						if(!m_ranges[i].pop(idx))
 						{
-							std::unique_lock<std::mutex> lock(m_queueMutex);
-							
-							if(m_workGroups.empty())
-							{
-								m_activeThreads.fetch_sub(1);
-								return;
-							}
-
-							group = m_workGroups.front();
-							m_workGroups.pop();
+							if(steal(i) || (m_help && m_help()))
+								continue;
+
+							break;
 						}
 
-						m_process(group);
+						m_process(m_workGroups[m_order[idx]]);
+						m_numCompleted.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					if(m_activeThreads.fetch_sub(1) == 1)
+					{
+						std::unique_lock<std::mutex> lock(m_completeMutex);
+						m_completeCV.notify_all();
 					}
 				}
 			);
@@ -61,12 +149,19 @@ public:
 		return m_activeThreads.load() == 0;
 	}
 
+	//returns whether the pool completed before the given time
+	bool wait_until(std::chrono::steady_clock::time_point time)
+	{
+		std::unique_lock<std::mutex> lock(m_completeMutex);
+		return m_completeCV.wait_until(lock, time, [this]{ return complete(); });
+	}
+
 	float progress()
 	{
-		std::unique_lock<std::mutex> lock(m_queueMutex);
+		if(m_workGroups.empty())
+			return 1.0f;
 
-		uint64_t numWorking = m_workGroups.size() + m_activeThreads.load();
-		return 1.0f - (float)numWorking / (float)m_numWorkGroupsInitial;			
+		return (float)m_numCompleted.load(std::memory_order_relaxed) / (float)m_workGroups.size();
 	}
 
 	~ThreadPool()
@@ -78,11 +173,53 @@ public:
 private:
 	std::vector<std::thread> m_workers;
 	std::atomic<uint64_t> m_activeThreads = 0;
+	std::atomic<uint64_t> m_numCompleted = 0;
 
-	uint32_t m_numWorkGroupsInitial;
-	std::queue<WorkGroup> m_workGroups;
-	std::mutex m_queueMutex;
+	//only used to wake wait_until() once the last worker exits
+	std::mutex m_completeMutex;
+	std::condition_variable m_completeCV;
+
+	std::vector<WorkGroup> m_workGroups;
+	std::vector<uint32_t> m_order;
+	std::unique_ptr<WorkRange[]> m_ranges;
+	uint32_t m_numRanges;
 	std::function<void(const WorkGroup&)> m_process;
+	std::function<bool()> m_help;
+
+	//only called once the worker's own range is empty, so nobody else can be stealing from it while it's refilled
+	bool steal(uint32_t worker)
+	{
+		while(true)
+		{
+			//find the victim with the most remaining work:
+			//---------------
+			uint32_t victim = UINT32_MAX;
+			uint32_t victimSize = 0;
+			for(uint32_t i = 1; i < m_numRanges; i++)
+			{
+				uint32_t candidate = (worker + i) % m_numRanges;
+
+				uint32_t size = m_ranges[candidate].size();
+				if(size > victimSize)
+				{
+					victim = candidate;
+					victimSize = size;
+				}
+			}
+
+			if(victim == UINT32_MAX)
+				return false;
+
+			//take the back half, look again if the owner or other thieves emptied it first:
+			//---------------
+			uint32_t begin, end;
+			if(m_ranges[victim].steal(1, UINT32_MAX, begin, end))
+			{
+				m_ranges[worker].reset(begin, end);
+				return true;
+			}
+		}
+	}
 };
 
 }; //namespace fr
@@ -0,0 +1,121 @@
+#include "freezeray/fr_kernels.hpp"
+
+#include <immintrin.h>
+#include <float.h>
+
+//NOTE: this file is compiled with AVX2 enabled, it must only be called through get_intersection_kernels()
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+bool intersect_tri_blocks_avx2(const float rayOrig[3], const float rayDir[3], const TriangleBlockSIMD* blocks, uint32_t numBlocks,
+                               float tMax, TriangleBlockHits* hits)
+{
+	//load ray into SIMD registers:
+	//---------------
+	__m256 roX = _mm256_set1_ps(rayOrig[0]);
+	__m256 roY = _mm256_set1_ps(rayOrig[1]);
+	__m256 roZ = _mm256_set1_ps(rayOrig[2]);
+
+	__m256 rdX = _mm256_set1_ps(rayDir[0]);
+	__m256 rdY = _mm256_set1_ps(rayDir[1]);
+	__m256 rdZ = _mm256_set1_ps(rayDir[2]);
+
+	__m256 tMaxV = _mm256_set1_ps(tMax);
+
+	//test 8 triangles at a time:
+	//---------------
+	bool anyHit = false;
+	for(uint32_t i = 0; i < numBlocks; i++)
+	{
+		const TriangleBlockSIMD& block = blocks[i];
+
+		__m256 v0x = _mm256_load_ps(block.v0x);
+		__m256 v0y = _mm256_load_ps(block.v0y);
+		__m256 v0z = _mm256_load_ps(block.v0z);
+
+		__m256 v0v1x = _mm256_load_ps(block.e1x);
+		__m256 v0v1y = _mm256_load_ps(block.e1y);
+		__m256 v0v1z = _mm256_load_ps(block.e1z);
+
+		__m256 v0v2x = _mm256_load_ps(block.e2x);
+		__m256 v0v2y = _mm256_load_ps(block.e2y);
+		__m256 v0v2z = _mm256_load_ps(block.e2z);
+
+		__m256 pvecX = _mm256_sub_ps(_mm256_mul_ps(rdY, v0v2z), _mm256_mul_ps(rdZ, v0v2y));
+		__m256 pvecY = _mm256_sub_ps(_mm256_mul_ps(rdZ, v0v2x), _mm256_mul_ps(rdX, v0v2z));
+		__m256 pvecZ = _mm256_sub_ps(_mm256_mul_ps(rdX, v0v2y), _mm256_mul_ps(rdY, v0v2x));
+
+		__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0v1x, pvecX), _mm256_mul_ps(v0v1y, pvecY)), _mm256_mul_ps(v0v1z, pvecZ));
+		__m256 absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+		__m256 detMask = _mm256_cmp_ps(absDet, _mm256_set1_ps(FLT_EPSILON), _CMP_LT_OS);
+		__m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+		__m256 tvecX = _mm256_sub_ps(roX, v0x);
+		__m256 tvecY = _mm256_sub_ps(roY, v0y);
+		__m256 tvecZ = _mm256_sub_ps(roZ, v0z);
+
+		__m256 u = _mm256_mul_ps(
+			_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tvecX, pvecX), _mm256_mul_ps(tvecY, pvecY)), _mm256_mul_ps(tvecZ, pvecZ)),
+			invDet
+		);
+		__m256 uMask = _mm256_or_ps(_mm256_cmp_ps(u, _mm256_setzero_ps(), _CMP_LT_OS), _mm256_cmp_ps(u, _mm256_set1_ps(1.0f), _CMP_GT_OS));
+
+		__m256 qvecX = _mm256_sub_ps(_mm256_mul_ps(tvecY, v0v1z), _mm256_mul_ps(tvecZ, v0v1y));
+		__m256 qvecY = _mm256_sub_ps(_mm256_mul_ps(tvecZ, v0v1x), _mm256_mul_ps(tvecX, v0v1z));
+		__m256 qvecZ = _mm256_sub_ps(_mm256_mul_ps(tvecX, v0v1y), _mm256_mul_ps(tvecY, v0v1x));
+
+		__m256 v = _mm256_mul_ps(
+			_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rdX, qvecX), _mm256_mul_ps(rdY, qvecY)), _mm256_mul_ps(rdZ, qvecZ)),
+			invDet
+		);
+		__m256 vMask = _mm256_or_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LT_OS), _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_GT_OS));
+
+		__m256 t = _mm256_mul_ps(
+			_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0v2x, qvecX), _mm256_mul_ps(v0v2y, qvecY)), _mm256_mul_ps(v0v2z, qvecZ)),
+			invDet
+		);
+		__m256 tMask = _mm256_cmp_ps(t, _mm256_set1_ps(FR_KERNEL_EPSILON), _CMP_LE_OS);
+
+		__m256 missMask = _mm256_or_ps(_mm256_or_ps(_mm256_or_ps(detMask, uMask), vMask), tMask);
+		__m256 inRange = _mm256_cmp_ps(t, tMaxV, _CMP_LT_OS);
+
+		uint32_t hitMask = (uint32_t)_mm256_movemask_ps(_mm256_andnot_ps(missMask, inRange));
+		hits[i].mask = hitMask;
+		if(hitMask == 0)
+			continue;
+
+		anyHit = true;
+		_mm256_storeu_ps(hits[i].t, t);
+		_mm256_storeu_ps(hits[i].u, u);
+		_mm256_storeu_ps(hits[i].v, v);
+	}
+
+	return anyHit;
+}
+
+uint32_t intersect_boxes8_avx2(const float* bounds, const float rayOrig[3], const float invRayDir[3], const bool dirIsNeg[3],
+                               float tMax, float* tNear)
+{
+	const float* minBounds = bounds;
+	const float* maxBounds = bounds + 3 * 8;
+
+	__m256 tNearX = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps((dirIsNeg[0] ? maxBounds : minBounds) + 0 ), _mm256_set1_ps(rayOrig[0])), _mm256_set1_ps(invRayDir[0]));
+	__m256 tNearY = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps((dirIsNeg[1] ? maxBounds : minBounds) + 8 ), _mm256_set1_ps(rayOrig[1])), _mm256_set1_ps(invRayDir[1]));
+	__m256 tNearZ = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps((dirIsNeg[2] ? maxBounds : minBounds) + 16), _mm256_set1_ps(rayOrig[2])), _mm256_set1_ps(invRayDir[2]));
+	__m256 tFarX  = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps((dirIsNeg[0] ? minBounds : maxBounds) + 0 ), _mm256_set1_ps(rayOrig[0])), _mm256_set1_ps(invRayDir[0]));
+	__m256 tFarY  = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps((dirIsNeg[1] ? minBounds : maxBounds) + 8 ), _mm256_set1_ps(rayOrig[1])), _mm256_set1_ps(invRayDir[1]));
+	__m256 tFarZ  = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps((dirIsNeg[2] ? minBounds : maxBounds) + 16), _mm256_set1_ps(rayOrig[2])), _mm256_set1_ps(invRayDir[2]));
+
+	//tFar is padded slightly to stay conservative in the face of rounding error
+	__m256 tNearV = _mm256_max_ps(_mm256_max_ps(tNearX, tNearY), _mm256_max_ps(tNearZ, _mm256_setzero_ps()));
+	__m256 tFarV = _mm256_mul_ps(_mm256_min_ps(_mm256_min_ps(tFarX, tFarY), tFarZ), _mm256_set1_ps(1.0f + 2.0f * FR_KERNEL_EPSILON));
+	tFarV = _mm256_min_ps(tFarV, _mm256_set1_ps(tMax));
+
+	_mm256_storeu_ps(tNear, tNearV);
+	return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tNearV, tFarV, _CMP_LE_OQ));
+}
+
+}; //namespace fr
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "freezeray/fr_kernels.hpp"
+
+#include <immintrin.h>
+#include <float.h>
+
+//NOTE: this file is compiled with AVX-512F enabled, it must only be called through get_intersection_kernels()
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//loads 8 floats from each of 2 blocks into a single register. only masked inserts and extracts are used, gcc implements the
+//unmasked ones (and the 256 <-> 512 bit casts) with an undefined source register that it then warns about
+static inline __m512 load_block_pair(const float* lo, const float* hi)
+{
+	__m512d loD = _mm512_maskz_broadcast_f64x4(0x0F, _mm256_castps_pd(_mm256_load_ps(lo)));
+	return _mm512_castpd_ps(_mm512_mask_broadcast_f64x4(loD, 0xF0, _mm256_castps_pd(_mm256_load_ps(hi))));
+}
+
+static inline void store_block_pair(float* lo, float* hi, __m512 val)
+{
+	__m512d valD = _mm512_castps_pd(val);
+	_mm256_storeu_ps(lo, _mm256_castpd_ps(_mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0x0F, valD, 0)));
+	_mm256_storeu_ps(hi, _mm256_castpd_ps(_mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0x0F, valD, 1)));
+}
+
+//-------------------------------------------//
+
+bool intersect_tri_blocks_avx512(const float rayOrig[3], const float rayDir[3], const TriangleBlockSIMD* blocks, uint32_t numBlocks,
+                                 float tMax, TriangleBlockHits* hits)
+{
+	//load ray into SIMD registers:
+	//---------------
+	__m512 roX = _mm512_set1_ps(rayOrig[0]);
+	__m512 roY = _mm512_set1_ps(rayOrig[1]);
+	__m512 roZ = _mm512_set1_ps(rayOrig[2]);
+
+	__m512 rdX = _mm512_set1_ps(rayDir[0]);
+	__m512 rdY = _mm512_set1_ps(rayDir[1]);
+	__m512 rdZ = _mm512_set1_ps(rayDir[2]);
+
+	__m512 tMaxV = _mm512_set1_ps(tMax);
+
+	//test 16 triangles (2 blocks) at a time, an odd last block is paired with itself and its upper half ignored:
+	//---------------
+	bool anyHit = false;
+	for(uint32_t i = 0; i < numBlocks; i += 2)
+	{
+		const TriangleBlockSIMD& lo = blocks[i];
+		const TriangleBlockSIMD& hi = blocks[i + 1 < numBlocks ? i + 1 : i];
+		__mmask16 validMask = i + 1 < numBlocks ? 0xFFFF : 0x00FF;
+
+		__m512 v0x = load_block_pair(lo.v0x, hi.v0x);
+		__m512 v0y = load_block_pair(lo.v0y, hi.v0y);
+		__m512 v0z = load_block_pair(lo.v0z, hi.v0z);
+
+		__m512 v0v1x = load_block_pair(lo.e1x, hi.e1x);
+		__m512 v0v1y = load_block_pair(lo.e1y, hi.e1y);
+		__m512 v0v1z = load_block_pair(lo.e1z, hi.e1z);
+
+		__m512 v0v2x = load_block_pair(lo.e2x, hi.e2x);
+		__m512 v0v2y = load_block_pair(lo.e2y, hi.e2y);
+		__m512 v0v2z = load_block_pair(lo.e2z, hi.e2z);
+
+		__m512 pvecX = _mm512_sub_ps(_mm512_mul_ps(rdY, v0v2z), _mm512_mul_ps(rdZ, v0v2y));
+		__m512 pvecY = _mm512_sub_ps(_mm512_mul_ps(rdZ, v0v2x), _mm512_mul_ps(rdX, v0v2z));
+		__m512 pvecZ = _mm512_sub_ps(_mm512_mul_ps(rdX, v0v2y), _mm512_mul_ps(rdY, v0v2x));
+
+		__m512 det = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(v0v1x, pvecX), _mm512_mul_ps(v0v1y, pvecY)), _mm512_mul_ps(v0v1z, pvecZ));
+		__mmask16 detMask = _mm512_cmp_ps_mask(_mm512_abs_ps(det), _mm512_set1_ps(FLT_EPSILON), _CMP_LT_OS);
+		__m512 invDet = _mm512_div_ps(_mm512_set1_ps(1.0f), det);
+
+		__m512 tvecX = _mm512_sub_ps(roX, v0x);
+		__m512 tvecY = _mm512_sub_ps(roY, v0y);
+		__m512 tvecZ = _mm512_sub_ps(roZ, v0z);
+
+		__m512 u = _mm512_mul_ps(
+			_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(tvecX, pvecX), _mm512_mul_ps(tvecY, pvecY)), _mm512_mul_ps(tvecZ, pvecZ)),
+			invDet
+		);
+		__mmask16 uMask = _mm512_cmp_ps_mask(u, _mm512_setzero_ps(), _CMP_LT_OS) | _mm512_cmp_ps_mask(u, _mm512_set1_ps(1.0f), _CMP_GT_OS);
+
+		__m512 qvecX = _mm512_sub_ps(_mm512_mul_ps(tvecY, v0v1z), _mm512_mul_ps(tvecZ, v0v1y));
+		__m512 qvecY = _mm512_sub_ps(_mm512_mul_ps(tvecZ, v0v1x), _mm512_mul_ps(tvecX, v0v1z));
+		__m512 qvecZ = _mm512_sub_ps(_mm512_mul_ps(tvecX, v0v1y), _mm512_mul_ps(tvecY, v0v1x));
+
+		__m512 v = _mm512_mul_ps(
+			_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(rdX, qvecX), _mm512_mul_ps(rdY, qvecY)), _mm512_mul_ps(rdZ, qvecZ)),
+			invDet
+		);
+		__mmask16 vMask = _mm512_cmp_ps_mask(v, _mm512_setzero_ps(), _CMP_LT_OS) |
+		                  _mm512_cmp_ps_mask(_mm512_add_ps(u, v), _mm512_set1_ps(1.0f), _CMP_GT_OS);
+
+		__m512 t = _mm512_mul_ps(
+			_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(v0v2x, qvecX), _mm512_mul_ps(v0v2y, qvecY)), _mm512_mul_ps(v0v2z, qvecZ)),
+			invDet
+		);
+		__mmask16 tMask = _mm512_cmp_ps_mask(t, _mm512_set1_ps(FR_KERNEL_EPSILON), _CMP_LE_OS);
+
+		__mmask16 missMask = detMask | uMask | vMask | tMask;
+		__mmask16 inRange = _mm512_cmp_ps_mask(t, tMaxV, _CMP_LT_OS);
+
+		uint32_t hitMask = (uint32_t)(inRange & ~missMask & validMask);
+
+		hits[i].mask = hitMask & 0xFF;
+		if(i + 1 < numBlocks)
+			hits[i + 1].mask = hitMask >> 8;
+
+		if(hitMask == 0)
+			continue;
+
+		//the upper half of an odd last block is written to a dummy so hits isnt overrun
+		TriangleBlockHits dummy;
+		TriangleBlockHits& hitsHi = i + 1 < numBlocks ? hits[i + 1] : dummy;
+
+		anyHit = true;
+		store_block_pair(hits[i].t, hitsHi.t, t);
+		store_block_pair(hits[i].u, hitsHi.u, u);
+		store_block_pair(hits[i].v, hitsHi.v, v);
+	}
+
+	return anyHit;
+}
+
+}; //namespace fr
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "freezeray/fr_kernels.hpp"
+
+#include <smmintrin.h>
+#include <float.h>
+
+//NOTE: this file is compiled with SSE4.2 enabled, it is the fallback for cpus without AVX2
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+//tests the 4 triangles starting at lane offset in a block, returns a mask of the lanes hit before tMax
+static inline uint32_t intersect_tri_half_block(const TriangleBlockSIMD& block, uint32_t offset, const __m128* rayOrig, const __m128* rayDir,
+                                                __m128 tMax, __m128& t, __m128& u, __m128& v)
+{
+	__m128 roX = rayOrig[0];
+	__m128 roY = rayOrig[1];
+	__m128 roZ = rayOrig[2];
+
+	__m128 rdX = rayDir[0];
+	__m128 rdY = rayDir[1];
+	__m128 rdZ = rayDir[2];
+
+	__m128 v0x = _mm_load_ps(block.v0x + offset);
+	__m128 v0y = _mm_load_ps(block.v0y + offset);
+	__m128 v0z = _mm_load_ps(block.v0z + offset);
+
+	__m128 v0v1x = _mm_load_ps(block.e1x + offset);
+	__m128 v0v1y = _mm_load_ps(block.e1y + offset);
+	__m128 v0v1z = _mm_load_ps(block.e1z + offset);
+
+	__m128 v0v2x = _mm_load_ps(block.e2x + offset);
+	__m128 v0v2y = _mm_load_ps(block.e2y + offset);
+	__m128 v0v2z = _mm_load_ps(block.e2z + offset);
+
+	__m128 pvecX = _mm_sub_ps(_mm_mul_ps(rdY, v0v2z), _mm_mul_ps(rdZ, v0v2y));
+	__m128 pvecY = _mm_sub_ps(_mm_mul_ps(rdZ, v0v2x), _mm_mul_ps(rdX, v0v2z));
+	__m128 pvecZ = _mm_sub_ps(_mm_mul_ps(rdX, v0v2y), _mm_mul_ps(rdY, v0v2x));
+
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v0v1x, pvecX), _mm_mul_ps(v0v1y, pvecY)), _mm_mul_ps(v0v1z, pvecZ));
+	__m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+	__m128 detMask = _mm_cmplt_ps(absDet, _mm_set1_ps(FLT_EPSILON));
+	__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	__m128 tvecX = _mm_sub_ps(roX, v0x);
+	__m128 tvecY = _mm_sub_ps(roY, v0y);
+	__m128 tvecZ = _mm_sub_ps(roZ, v0z);
+
+	u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tvecX, pvecX), _mm_mul_ps(tvecY, pvecY)), _mm_mul_ps(tvecZ, pvecZ)), invDet);
+	__m128 uMask = _mm_or_ps(_mm_cmplt_ps(u, _mm_setzero_ps()), _mm_cmpgt_ps(u, _mm_set1_ps(1.0f)));
+
+	__m128 qvecX = _mm_sub_ps(_mm_mul_ps(tvecY, v0v1z), _mm_mul_ps(tvecZ, v0v1y));
+	__m128 qvecY = _mm_sub_ps(_mm_mul_ps(tvecZ, v0v1x), _mm_mul_ps(tvecX, v0v1z));
+	__m128 qvecZ = _mm_sub_ps(_mm_mul_ps(tvecX, v0v1y), _mm_mul_ps(tvecY, v0v1x));
+
+	v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rdX, qvecX), _mm_mul_ps(rdY, qvecY)), _mm_mul_ps(rdZ, qvecZ)), invDet);
+	__m128 vMask = _mm_or_ps(_mm_cmplt_ps(v, _mm_setzero_ps()), _mm_cmpgt_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+
+	t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v0v2x, qvecX), _mm_mul_ps(v0v2y, qvecY)), _mm_mul_ps(v0v2z, qvecZ)), invDet);
+	__m128 tMask = _mm_cmple_ps(t, _mm_set1_ps(FR_KERNEL_EPSILON));
+
+	__m128 missMask = _mm_or_ps(_mm_or_ps(_mm_or_ps(detMask, uMask), vMask), tMask);
+	__m128 inRange = _mm_cmplt_ps(t, tMax);
+
+	return (uint32_t)_mm_movemask_ps(_mm_andnot_ps(missMask, inRange));
+}
+
+//tests 4 boxes, whose bounds arrays are each stride floats apart
+static inline uint32_t intersect_boxes_half(const float* bounds, uint32_t stride, const float rayOrig[3], const float invRayDir[3],
+                                            const bool dirIsNeg[3], float tMax, float* tNear)
+{
+	const float* minBounds = bounds;
+	const float* maxBounds = bounds + 3 * stride;
+
+	__m128 tNearX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps((dirIsNeg[0] ? maxBounds : minBounds) + 0 * stride), _mm_set1_ps(rayOrig[0])), _mm_set1_ps(invRayDir[0]));
+	__m128 tNearY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps((dirIsNeg[1] ? maxBounds : minBounds) + 1 * stride), _mm_set1_ps(rayOrig[1])), _mm_set1_ps(invRayDir[1]));
+	__m128 tNearZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps((dirIsNeg[2] ? maxBounds : minBounds) + 2 * stride), _mm_set1_ps(rayOrig[2])), _mm_set1_ps(invRayDir[2]));
+	__m128 tFarX  = _mm_mul_ps(_mm_sub_ps(_mm_load_ps((dirIsNeg[0] ? minBounds : maxBounds) + 0 * stride), _mm_set1_ps(rayOrig[0])), _mm_set1_ps(invRayDir[0]));
+	__m128 tFarY  = _mm_mul_ps(_mm_sub_ps(_mm_load_ps((dirIsNeg[1] ? minBounds : maxBounds) + 1 * stride), _mm_set1_ps(rayOrig[1])), _mm_set1_ps(invRayDir[1]));
+	__m128 tFarZ  = _mm_mul_ps(_mm_sub_ps(_mm_load_ps((dirIsNeg[2] ? minBounds : maxBounds) + 2 * stride), _mm_set1_ps(rayOrig[2])), _mm_set1_ps(invRayDir[2]));
+
+	//tFar is padded slightly to stay conservative in the face of rounding error
+	__m128 tNearV = _mm_max_ps(_mm_max_ps(tNearX, tNearY), _mm_max_ps(tNearZ, _mm_setzero_ps()));
+	__m128 tFarV = _mm_mul_ps(_mm_min_ps(_mm_min_ps(tFarX, tFarY), tFarZ), _mm_set1_ps(1.0f + 2.0f * FR_KERNEL_EPSILON));
+	tFarV = _mm_min_ps(tFarV, _mm_set1_ps(tMax));
+
+	_mm_storeu_ps(tNear, tNearV);
+	return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tNearV, tFarV));
+}
+
+//-------------------------------------------//
+
+bool intersect_tri_blocks_sse4(const float rayOrig[3], const float rayDir[3], const TriangleBlockSIMD* blocks, uint32_t numBlocks,
+                               float tMax, TriangleBlockHits* hits)
+{
+	__m128 rayOrigV[3] = { _mm_set1_ps(rayOrig[0]), _mm_set1_ps(rayOrig[1]), _mm_set1_ps(rayOrig[2]) };
+	__m128 rayDirV[3]  = { _mm_set1_ps(rayDir[0]),  _mm_set1_ps(rayDir[1]),  _mm_set1_ps(rayDir[2])  };
+	__m128 tMaxV = _mm_set1_ps(tMax);
+
+	//each block is tested as 2 halves of 4 triangles:
+	//---------------
+	bool anyHit = false;
+	for(uint32_t i = 0; i < numBlocks; i++)
+	{
+		__m128 tLo, uLo, vLo;
+		__m128 tHi, uHi, vHi;
+		uint32_t hitMask  = intersect_tri_half_block(blocks[i], 0, rayOrigV, rayDirV, tMaxV, tLo, uLo, vLo);
+		         hitMask |= intersect_tri_half_block(blocks[i], 4, rayOrigV, rayDirV, tMaxV, tHi, uHi, vHi) << 4;
+
+		hits[i].mask = hitMask;
+		if(hitMask == 0)
+			continue;
+
+		anyHit = true;
+		_mm_storeu_ps(hits[i].t, tLo);
+		_mm_storeu_ps(hits[i].u, uLo);
+		_mm_storeu_ps(hits[i].v, vLo);
+		_mm_storeu_ps(hits[i].t + 4, tHi);
+		_mm_storeu_ps(hits[i].u + 4, uHi);
+		_mm_storeu_ps(hits[i].v + 4, vHi);
+	}
+
+	return anyHit;
+}
+
+uint32_t intersect_boxes4_sse4(const float* bounds, const float rayOrig[3], const float invRayDir[3], const bool dirIsNeg[3],
+                               float tMax, float* tNear)
+{
+	return intersect_boxes_half(bounds, 4, rayOrig, invRayDir, dirIsNeg, tMax, tNear);
+}
+
+uint32_t intersect_boxes8_sse4(const float* bounds, const float rayOrig[3], const float invRayDir[3], const bool dirIsNeg[3],
+                               float tMax, float* tNear)
+{
+	uint32_t hitMask  = intersect_boxes_half(bounds    , 8, rayOrig, invRayDir, dirIsNeg, tMax, tNear    );
+	         hitMask |= intersect_boxes_half(bounds + 4, 8, rayOrig, invRayDir, dirIsNeg, tMax, tNear + 4) << 4;
+
+	return hitMask;
+}
+
+}; //namespace fr
\ No newline at end of file
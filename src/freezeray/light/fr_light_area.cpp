@@ -14,14 +14,9 @@ LightArea::LightArea(const std::shared_ptr<const Mesh>& mesh, const mat4& transf
 	if(!m_mesh)
 		throw std::invalid_argument("mesh must not be NULL");
 
-	//compute inv transforms:
+	//compute inv transform:
 	//---------------
-	m_invTransform = inverse(transform);
-
-	m_invTransformNoTranslate = m_invTransform;
-	m_invTransformNoTranslate.m[3][0] = 0.0f;
-	m_invTransformNoTranslate.m[3][1] = 0.0f;
-	m_invTransformNoTranslate.m[3][2] = 0.0f;	
+	m_invTransform = Transform3x4(inverse(transform));
 
 	//generate triangle distribution:
 	//---------------
@@ -53,10 +48,39 @@ LightArea::LightArea(const std::shared_ptr<const Mesh>& mesh, const mat4& transf
 	m_triDistribution = std::make_unique<DistributionDiscrete<uint32_t>>(pmf);
 }
 
+LightArea::LightArea(const std::shared_ptr<const Shape>& shape, const mat4& transform, const vec3& intensity) :
+	Light(false, false), m_shape(shape), m_transform(transform), m_intensity(intensity)
+{
+	//validate:
+	//---------------
+	if(!m_shape)
+		throw std::invalid_argument("shape must not be NULL");
+
+	vec3 axes[3] = {
+		(transform * vec4(1.0f, 0.0f, 0.0f, 0.0f)).xyz(),
+		(transform * vec4(0.0f, 1.0f, 0.0f, 0.0f)).xyz(),
+		(transform * vec4(0.0f, 0.0f, 1.0f, 0.0f)).xyz()
+	};
+
+	float scale2 = dot(axes[0], axes[0]);
+	for(uint32_t i = 0; i < 3; i++)
+	for(uint32_t j = i; j < 3; j++)
+	{
+		float expected = i == j ? scale2 : 0.0f;
+		if(std::abs(dot(axes[i], axes[j]) - expected) > 1e-3f * scale2)
+			throw std::invalid_argument("shape lights only support rotations, translations, and uniform scales");
+	}
+
+	//compute inv transform + world space area:
+	//---------------
+	m_invTransform = Transform3x4(inverse(transform));
+	m_area = m_shape->get_area() * scale2;
+}
+
 vec3 LightArea::sample_li(const IntersectionInfo& hitInfo, const vec3& u, vec3& wiWorld, VisibilityTestInfo& vis, float& pdf) const
 {
 	vec3 normal;
-	vec3 pos = sample_mesh_area(u, pdf, normal);
+	vec3 pos = m_shape ? sample_shape_area(u, pdf, normal) : sample_mesh_area(u, pdf, normal);
 	vec3 toLight = pos - hitInfo.pos;
 
 	wiWorld = normalize(toLight);
@@ -76,7 +100,16 @@ float LightArea::pdf_li(const IntersectionInfo& hitInfo, const vec3& w) const
 	vec2 uv;
 	vec3 normal;
 	IntersectionInfo::Derivatives derivs;
-	if(!m_mesh->intersect(ray.transformed(m_invTransform, m_invTransformNoTranslate), nullptr, t, uv, normal, derivs))
+	if(m_shape)
+	{
+		Ray objRay = ray.transformed(m_invTransform);
+		if(!m_shape->intersect(objRay, INFINITY, t))
+			return 0.0f;
+
+		m_shape->get_hit_attribs(objRay, t, uv, normal, derivs);
+		normal = normalize((m_transform * vec4(normal, 0.0f)).xyz());
+	}
+	else if(!m_mesh->intersect(ray.transformed(m_invTransform), nullptr, t, uv, normal, derivs))
 		return 0.0f;
 
 	return t * t / (std::abs(dot(normal, -1.0f * w)) * m_area);
@@ -92,7 +125,7 @@ vec3 LightArea::sample_le(const vec3& u1, const vec3& u2, Ray& ray, vec3& normal
 	//sample position:
 	//---------------
 	vec3 objNormal;
-	vec3 pos = sample_mesh_area(u1, pdfPos, objNormal);
+	vec3 pos = m_shape ? sample_shape_area(u1, pdfPos, objNormal) : sample_mesh_area(u1, pdfPos, objNormal);
 	normal = normalize((m_transform * vec4(objNormal, 0.0f)).xyz());
 
 	//sample direction:
@@ -134,6 +167,12 @@ std::shared_ptr<const Mesh> LightArea::get_mesh(mat4& transform) const
 	return m_mesh;
 }
 
+std::shared_ptr<const Shape> LightArea::get_shape(mat4& transform) const
+{
+	transform = m_transform;
+	return m_shape;
+}
+
 vec3 LightArea::sample_mesh_area(const vec3& u, float& pdf, vec3& objNormal) const
 {
 	//get triangle:
@@ -171,4 +210,13 @@ vec3 LightArea::sample_mesh_area(const vec3& u, float& pdf, vec3& objNormal) con
     return b0 * v0 + b1 * v1 + b2 * v2;
 }
 
+vec3 LightArea::sample_shape_area(const vec3& u, float& pdf, vec3& objNormal) const
+{
+	//the transform preserves area ratios, so uniform in object space is uniform in world space
+	vec3 pos = m_shape->sample_area(vec2(u.x, u.y), objNormal);
+	pdf = 1.0f / m_area;
+
+	return (m_transform * vec4(pos, 1.0f)).xyz();
+}
+
 }; //namespace fr
\ No newline at end of file
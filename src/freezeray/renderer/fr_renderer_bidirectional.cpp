@@ -47,9 +47,8 @@ private:
 //-------------------------------------------//
 
 RendererBidirectional::RendererBidirectional(std::shared_ptr<const Camera> cam, uint32_t imageW, uint32_t imageH, uint32_t maxDepth, uint32_t samplesPerPixel, bool importanceSampling, bool multipleImportanceSampling) :
-	Renderer(cam, imageW, imageH),
+	Renderer(cam, imageW, imageH, samplesPerPixel),
 	m_maxDepth(maxDepth), 
-	m_samplesPerPixel(samplesPerPixel), 
 	m_importanceSampling(importanceSampling),
 	m_mis(multipleImportanceSampling)
 {
@@ -61,10 +60,9 @@ RendererBidirectional::~RendererBidirectional()
 
 }
 
-vec3 RendererBidirectional::li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray) const
+void RendererBidirectional::li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, uint32_t numSamples, PixelEstimate& estimate) const
 {
-	vec3 li = vec3(0.0f);
-	for(uint32_t i = 0; i < m_samplesPerPixel; i++)
+	for(uint32_t i = 0; i < numSamples; i++)
 	{
 		std::vector<PathVertex> cameraSubpath = trace_camera_subpath(prng, scene, ray, m_maxDepth);
 		std::vector<PathVertex> lightSubpath = trace_light_subpath(prng, scene, ray, m_maxDepth);
@@ -90,14 +88,13 @@ vec3 RendererBidirectional::li(const std::shared_ptr<PRNG>& prng, const std::sha
 			}
 		}
 
+		//invalid samples still count towards the sample count, as if they had contributed nothing
 		if(std::isinf(l.x) || std::isinf(l.y) || std::isinf(l.z) ||
 		   std::isnan(l.x) || std::isnan(l.y) || std::isnan(l.z))
-		   continue;
+		   l = vec3(0.0f);
 
-		li = li + l;
+		estimate.add_sample(l);
 	}
-
-	return li / (float)m_samplesPerPixel;
 }
 
 void RendererBidirectional::trace_walk(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, TransportMode mode, vec3 mult, float pdf, std::vector<PathVertex>& vertices, uint32_t depth) const
@@ -108,18 +105,20 @@ void RendererBidirectional::trace_walk(const std::shared_ptr<PRNG>& prng, const
 	Ray curRay = ray;
 	for(uint32_t i = 0; i < depth; i++)
 	{
-		//compute intersection
+		//compute intersection, only shade what the vertex actually needs
+		HitRecord hit;
 		IntersectionInfo hitInfo;
-		bool hit = scene->intersect(curRay, hitInfo);
+		bool didHit = scene->intersect(curRay, hit);
 
 		//negate ray direction to get wo:
 		vec3 wo = -1.0f * curRay.direction();
 
 		//add infinite lights + break if nothing hit
-		if(!hit)
+		if(!didHit)
 		{
 			if(mode == TransportMode::RADIANCE)
 			{
+				scene->shade_miss(curRay, hitInfo);
 				PathVertex lightVert = PathVertex::from_light(nullptr, hitInfo, mult, pdfFwd);
 				vertices.push_back(lightVert);
 			}
@@ -127,6 +126,8 @@ void RendererBidirectional::trace_walk(const std::shared_ptr<PRNG>& prng, const
 			break;
 		}
 
+		scene->shade(curRay, hit, hitInfo);
+
 		//add vertex
 		PathVertex vert = PathVertex::from_surface(hitInfo, mult, pdfFwd, vertices[vertices.size() - 1]);
 		vertices.push_back(vert);
@@ -68,15 +68,15 @@ void RendererMetropolis::render(const std::shared_ptr<const Scene>& scene,
                                 std::function<void(uint32_t, uint32_t, vec3)> writePixel, 
                                 std::function<void(float)> display, uint32_t displayFrequency)
 {
-	uint64_t numThreads = std::thread::hardware_concurrency();
+	uint32_t numThreads = get_num_threads();
 
 	//generate bootstrapping samples:
 	//---------------
 	std::vector<std::pair<uint32_t, float>> bootstrapSamples(m_numBootstrap * (m_maxDepth + 1));
 
-	std::queue<uint32_t> bootstrapWorkGroups;
+	std::vector<uint32_t> bootstrapWorkGroups(m_numBootstrap);
 	for(uint32_t i = 0; i < m_numBootstrap; i++)
-		bootstrapWorkGroups.push(i);
+		bootstrapWorkGroups[i] = i;
 
 	auto processBootstrapWorkGroup = [&](uint32_t idx) {
 		for(uint32_t i = 0; i <= m_maxDepth; i++)
@@ -123,9 +123,9 @@ void RendererMetropolis::render(const std::shared_ptr<const Scene>& scene,
 	//---------------
 	uint64_t totalMutations = (uint64_t)m_imageW * (uint64_t)m_imageH * (uint64_t)m_mutationsPerPixel;
 
-	std::queue<uint32_t> markovChains;
+	std::vector<uint32_t> markovChains(m_numChains);
 	for(uint32_t i = 0; i < m_numChains; i++)
-		markovChains.push(i);
+		markovChains[i] = i;
 
 	auto processMarkovChain = [&](uint32_t idx) {
 		uint64_t numMutations = totalMutations / m_numChains;
@@ -7,9 +7,8 @@ namespace fr
 {
 
 RendererPath::RendererPath(std::shared_ptr<const Camera> cam, uint32_t imageW, uint32_t imageH, uint32_t maxDepth, uint32_t samplesPerPixel, bool importanceSampling, bool multipleImportanceSampling) :
-	Renderer(cam, imageW, imageH),
+	Renderer(cam, imageW, imageH, samplesPerPixel),
 	m_maxDepth(maxDepth), 
-	m_samplesPerPixel(samplesPerPixel), 
 	m_importanceSampling(importanceSampling),
 	m_mis(multipleImportanceSampling)
 {
@@ -21,23 +20,38 @@ RendererPath::~RendererPath()
 
 }
 
-vec3 RendererPath::li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray) const
+void RendererPath::li(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, uint32_t numSamples, PixelEstimate& estimate) const
+{
+	HitRecord hitRecord;
+	bool hit = scene->intersect(ray, hitRecord);
+
+	li_primary(prng, scene, ray, hit, hitRecord, numSamples, estimate);
+}
+
+void RendererPath::li_primary(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, bool initialHit, const HitRecord& hitRecord,
+                              uint32_t numSamples, PixelEstimate& estimate) const
 {
 	IntersectionInfo initialHitInfo;
-	bool initialHit = scene->intersect(ray, initialHitInfo);
+	if(initialHit)
+		scene->shade(ray, hitRecord, initialHitInfo);
+	else
+		scene->shade_miss(ray, initialHitInfo);
 
-	vec3 li = vec3(0.0f);
-	for(uint32_t i = 0; i < m_samplesPerPixel; i++)
+	for(uint32_t i = 0; i < numSamples; i++)
 	{
+		//invalid samples still count towards the sample count, as if they had contributed nothing
 		vec3 contrib = trace_path(prng, scene, ray, initialHit, initialHitInfo);
 		if(std::isinf(contrib.x) || std::isinf(contrib.y) || std::isinf(contrib.z) ||
 		   std::isnan(contrib.x) || std::isnan(contrib.y) || std::isnan(contrib.z))
-		   continue;
+		   contrib = vec3(0.0f);
 
-		li = li + contrib;
+		estimate.add_sample(contrib);
 	}
+}
 
-	return li / (float)m_samplesPerPixel;
+bool RendererPath::use_primary_packets() const
+{
+	return true;
 }
 
 vec3 RendererPath::trace_path(const std::shared_ptr<PRNG>& prng, const std::shared_ptr<const Scene>& scene, const Ray& ray, bool initialHit, const IntersectionInfo& initialHitInfo) const
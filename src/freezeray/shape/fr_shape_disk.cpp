@@ -0,0 +1,59 @@
+#include "freezeray/shape/fr_shape_disk.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+ShapeDisk::ShapeDisk(float radius) :
+	m_radius(radius)
+{
+	if(m_radius <= 0.0f)
+		throw std::invalid_argument("radius must be positive");
+}
+
+bound3 ShapeDisk::get_bounds() const
+{
+	return { vec3(-m_radius, 0.0f, -m_radius), vec3(m_radius, 0.0f, m_radius) };
+}
+
+float ShapeDisk::get_area() const
+{
+	return FR_PI * m_radius * m_radius;
+}
+
+bool ShapeDisk::intersect(const Ray& ray, float tMax, float& t) const
+{
+	//intersect with the plane y = 0, then check the radius:
+	//---------------
+	if(ray.direction().y == 0.0f)
+		return false;
+
+	float tPlane = -ray.origin().y / ray.direction().y;
+	if(tPlane <= FR_EPSILON || tPlane >= tMax)
+		return false;
+
+	vec3 pos = ray.at(tPlane);
+	if(pos.x * pos.x + pos.z * pos.z > m_radius * m_radius)
+		return false;
+
+	t = tPlane;
+	return true;
+}
+
+vec3 ShapeDisk::sample_area(const vec2& u, vec3& normal) const
+{
+	float r = m_radius * std::sqrt(u.x);
+	float theta = FR_2_PI * u.y;
+
+	normal = FR_UP_DIR;
+	return vec3(r * std::cos(theta), 0.0f, r * std::sin(theta));
+}
+
+void ShapeDisk::get_surface_attribs(const vec3& pos, vec2& uv, vec3& normal) const
+{
+	uv = vec2(pos.x, pos.z) / (2.0f * m_radius) + 0.5f;
+	normal = FR_UP_DIR;
+}
+
+}; //namespace fr
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "freezeray/shape/fr_shape_rectangle.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+ShapeRectangle::ShapeRectangle(const vec2& size) :
+	m_size(size)
+{
+	if(m_size.x <= 0.0f || m_size.y <= 0.0f)
+		throw std::invalid_argument("size must be positive");
+}
+
+bound3 ShapeRectangle::get_bounds() const
+{
+	return { vec3(-0.5f * m_size.x, 0.0f, -0.5f * m_size.y), vec3(0.5f * m_size.x, 0.0f, 0.5f * m_size.y) };
+}
+
+float ShapeRectangle::get_area() const
+{
+	return m_size.x * m_size.y;
+}
+
+bool ShapeRectangle::intersect(const Ray& ray, float tMax, float& t) const
+{
+	//intersect with the plane y = 0, then check the extents:
+	//---------------
+	if(ray.direction().y == 0.0f)
+		return false;
+
+	float tPlane = -ray.origin().y / ray.direction().y;
+	if(tPlane <= FR_EPSILON || tPlane >= tMax)
+		return false;
+
+	vec3 pos = ray.at(tPlane);
+	if(std::abs(pos.x) > 0.5f * m_size.x || std::abs(pos.z) > 0.5f * m_size.y)
+		return false;
+
+	t = tPlane;
+	return true;
+}
+
+vec3 ShapeRectangle::sample_area(const vec2& u, vec3& normal) const
+{
+	normal = FR_UP_DIR;
+	return vec3((u.x - 0.5f) * m_size.x, 0.0f, (u.y - 0.5f) * m_size.y);
+}
+
+void ShapeRectangle::get_surface_attribs(const vec3& pos, vec2& uv, vec3& normal) const
+{
+	uv = vec2(pos.x / m_size.x, pos.z / m_size.y) + 0.5f;
+	normal = FR_UP_DIR;
+}
+
+}; //namespace fr
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "freezeray/shape/fr_shape_sphere.hpp"
+
+//-------------------------------------------//
+
+namespace fr
+{
+
+ShapeSphere::ShapeSphere(float radius) :
+	m_radius(radius)
+{
+	if(m_radius <= 0.0f)
+		throw std::invalid_argument("radius must be positive");
+}
+
+bound3 ShapeSphere::get_bounds() const
+{
+	return { vec3(-m_radius), vec3(m_radius) };
+}
+
+float ShapeSphere::get_area() const
+{
+	return 2.0f * FR_2_PI * m_radius * m_radius;
+}
+
+bool ShapeSphere::intersect(const Ray& ray, float tMax, float& t) const
+{
+	const vec3& orig = ray.origin();
+	const vec3& dir = ray.direction();
+
+	//solve |orig + t * dir|^2 = r^2, the discriminant is computed from the closest point on the ray to stay precise for distant rays:
+	//---------------
+	float a = dot(dir, dir);
+	float halfB = dot(orig, dir);
+	float c = dot(orig, orig) - m_radius * m_radius;
+
+	vec3 closest = orig - (halfB / a) * dir;
+	float discrim = a * (m_radius * m_radius - dot(closest, closest));
+	if(discrim < 0.0f)
+		return false;
+
+	float q = -(halfB + std::copysign(std::sqrt(discrim), halfB));
+	float t0 = q / a;
+	float t1 = q != 0.0f ? c / q : t0; //q is only 0 for a double root, which is then at t0
+	if(t0 > t1)
+		std::swap(t0, t1);
+
+	//return nearest root in range:
+	//---------------
+	if(t0 > FR_EPSILON && t0 < tMax)
+		t = t0;
+	else if(t1 > FR_EPSILON && t1 < tMax)
+		t = t1;
+	else
+		return false;
+
+	return true;
+}
+
+vec3 ShapeSphere::sample_area(const vec2& u, vec3& normal) const
+{
+	float y = 1.0f - 2.0f * u.x;
+	float r = std::sqrt(std::max(0.0f, 1.0f - y * y));
+	float phi = FR_2_PI * u.y;
+
+	normal = vec3(r * std::cos(phi), y, r * std::sin(phi));
+	return m_radius * normal;
+}
+
+void ShapeSphere::get_surface_attribs(const vec3& pos, vec2& uv, vec3& normal) const
+{
+	normal = normalize(pos);
+
+	uv.x = std::atan2(normal.z, normal.x) * FR_INV_2_PI + 0.5f;
+	uv.y = std::acos(std::min(std::max(normal.y, -1.0f), 1.0f)) * FR_INV_PI;
+}
+
+}; //namespace fr
\ No newline at end of file
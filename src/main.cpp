@@ -1,12 +1,15 @@
 #include <SDL2/SDL.h>
 #include <iostream>
 #include <iomanip>
+#include <vector>
+#include <string>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "example_scene.hpp"
 #include "freezeray/renderer/fr_renderer_path.hpp"
 #include "freezeray/renderer/fr_renderer_bidirectional.hpp"
 #include "freezeray/renderer/fr_renderer_metropolis.hpp"
+#include "freezeray/fr_log.hpp"
 #include "freezeray/texture/stb_image.h"
 #include "stb_image_write.h"
 
@@ -14,16 +17,59 @@
 
 int main(int argc, char** argv)
 {
+	//parse args, flags can go anywhere:
+	//---------------
+	std::vector<std::string> paths;
+	bool recalibrate = false;
+	bool lazyBuild = false;
+	uint32_t numThreads = 0;
+	float maxRelativeError = 0.0f;
+	bool checkpoint = false;
+	bool resume = false;
+	bool verbose = false;
+	for(int32_t i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if(arg == "--calibrate")
+			recalibrate = true;
+		else if(arg == "--lazy")
+			lazyBuild = true;
+		else if(arg == "--threads" && i + 1 < argc)
+			numThreads = (uint32_t)std::stoul(argv[++i]);
+		else if(arg == "--adaptive" && i + 1 < argc)
+			maxRelativeError = std::stof(argv[++i]);
+		else if(arg == "--checkpoint")
+			checkpoint = true;
+		else if(arg == "--resume")
+			resume = true;
+		else if(arg == "--verbose")
+			verbose = true;
+		else
+			paths.push_back(arg);
+	}
+
 	//validate:
 	//---------------
-	if(argc < 2)
+	if(paths.size() < 1)
 	{
 		std::cout << "ERROR: no output path specified" << std::endl;
 		return -1;
 	}
 
-	//load scene:
+	//with --verbose, build times and render statistics are printed:
 	//---------------
+	fr::set_verbose(verbose);
+
+	//load scene, reusing kd trees built and costs measured in previous runs. with --lazy, meshes are only built once a ray reaches them:
+	//---------------
+	fr::Mesh::set_kdtree_cache_dir("cache/kdtrees");
+	fr::Mesh::calibrate_kdtree_costs(recalibrate);
+	fr::Mesh::set_lazy_build(lazyBuild);
+
+	//with --threads N, render with N workers instead of one per hardware thread:
+	//---------------
+	fr::Renderer::set_num_threads(numThreads);
+
 	ExampleScene scene = example_material_demo("assets/skyboxes/noon_sunny.hdr");
 	//ExampleScene scene = example_cornell_box();
 	//ExampleScene scene = example_sponza();
@@ -83,6 +129,15 @@ int main(int argc, char** argv)
 		50
 	);*/
 
+	//with --adaptive E, pixels stop sampling once their relative error is below E:
+	//---------------
+	renderer->set_adaptive_sampling(maxRelativeError);
+
+	//with --checkpoint, the partial render is saved next to the output every few minutes. --resume continues from that save:
+	//---------------
+	if(checkpoint || resume)
+		renderer->set_checkpoint(paths[0] + ".checkpoint", 300, resume);
+
 	//start rendering:
 	//---------------
 	unsigned int startTime = SDL_GetTicks();
@@ -125,7 +180,7 @@ int main(int argc, char** argv)
 
 	//save file to texture:
 	//---------------
-	stbi_write_png(argv[1], scene.windowWidth, scene.windowHeight, 4, outTex.get(), scene.windowWidth * sizeof(uint32_t));
+	stbi_write_png(paths[0].c_str(), scene.windowWidth, scene.windowHeight, 4, outTex.get(), scene.windowWidth * sizeof(uint32_t));
 
 	//print total rendering time:
 	//---------------
@@ -135,16 +190,16 @@ int main(int argc, char** argv)
 
 	//compute MSE if output texture given:
 	//---------------
-	if(argc >= 3)
+	if(paths.size() >= 2)
 	{
 		uint32_t width;
 		uint32_t height;
 		uint32_t channels;
-		uint8_t* refImage = stbi_load(argv[2], (int*)&width, (int*)&height, (int*)&channels, 4);
+		uint8_t* refImage = stbi_load(paths[1].c_str(), (int*)&width, (int*)&height, (int*)&channels, 4);
 
 		if(!refImage) 
 		{
-			std::cout << "error loading reference image: " << argv[2] << std::endl;
+			std::cout << "error loading reference image: " << paths[1] << std::endl;
 			return -1;
 		}
 		